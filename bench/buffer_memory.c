@@ -0,0 +1,108 @@
+// Reports the buffer memory of a window and the time to draw a full frame at common output scales, once at the exact
+// fractional scale and once at the next integer scale, which the compositor would have to scale down. Also checks that
+// the content buffer exactly fills the hole in the decor at every scale. The logical window size can be given as the
+// first two arguments.
+
+#include "canvas.h"
+#include "decor.h"
+#include "swapchain.h"
+#include "utils.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_FRAMES 50
+
+static const int32_t bench_scales[] = {120, 150, 180, 210, 240, 300};
+
+#define BENCH_SCALE_COUNT (sizeof(bench_scales) / sizeof(bench_scales[0]))
+
+struct bench_result
+{
+    size_t bytes;
+    double frame_ms;
+    // Transparent decor pixels that are not exactly covered by the content buffer.
+    int64_t hole_mismatch;
+};
+
+static struct bench_result bench_scale(int32_t width, int32_t height, int32_t scale)
+{
+    struct bench_result result = {0};
+    int32_t decor_width;
+    int32_t decor_height;
+    int32_t content_width;
+    int32_t content_height;
+    decor_buffer_size(width, height, scale, &decor_width, &decor_height);
+    decor_content_buffer_size(width, height, scale, &content_width, &content_height);
+
+    // One decor buffer plus the content swapchain.
+    size_t decor_bytes = (size_t) decor_width * decor_height * 4;
+    size_t content_bytes = (size_t) content_width * content_height * 4;
+    result.bytes = decor_bytes + content_bytes * SWAPCHAIN_LENGTH;
+
+    uint32_t *decor_pixels = malloc(decor_bytes);
+    uint32_t *content_pixels = malloc(content_bytes);
+
+    if (decor_pixels == NULL || content_pixels == NULL)
+    {
+        fprintf(stderr, "error (bench): Out of memory.\n");
+        exit(1);
+    }
+
+    int32_t tile_size = scale_length(CANVAS_TILE_SIZE, scale);
+    uint64_t start_ns = get_monotonic_time_ns();
+
+    for (int i = 0; i < BENCH_FRAMES; ++i)
+    {
+        decor_draw(decor_pixels, width, height, scale);
+        canvas_draw(content_pixels, content_width, 0, 0, content_width, content_height, i, i, tile_size);
+    }
+
+    result.frame_ms = (get_monotonic_time_ns() - start_ns) / 1e6 / BENCH_FRAMES;
+
+    int64_t hole = 0;
+
+    for (size_t i = 0; i < (size_t) decor_width * decor_height; ++i)
+    {
+        hole += decor_pixels[i] == 0;
+    }
+
+    result.hole_mismatch = hole - (int64_t) content_width * content_height;
+
+    free(decor_pixels);
+    free(content_pixels);
+
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int32_t width = argc > 2 ? atoi(argv[1]) : 1280;
+    int32_t height = argc > 2 ? atoi(argv[2]) : 720;
+    bool consistent = true;
+
+    printf("info (bench): Window of %dx%d, %d frames per scale.\n", width, height, BENCH_FRAMES);
+
+    for (size_t i = 0; i < BENCH_SCALE_COUNT; ++i)
+    {
+        int32_t scale = bench_scales[i];
+        int32_t integer_scale = (scale + SCALE_DENOMINATOR - 1) / SCALE_DENOMINATOR * SCALE_DENOMINATOR;
+        struct bench_result exact = bench_scale(width, height, scale);
+        struct bench_result rounded = bench_scale(width, height, integer_scale);
+        consistent = consistent && exact.hole_mismatch == 0 && rounded.hole_mismatch == 0;
+
+        printf("info (bench): scale %.2f: %.2f MiB, %.2fms per frame. At %d: %.2f MiB, %.2fms per frame (%.0f%% more memory).\n",
+               (double) scale / SCALE_DENOMINATOR, exact.bytes / 1048576.0, exact.frame_ms, integer_scale / SCALE_DENOMINATOR,
+               rounded.bytes / 1048576.0, rounded.frame_ms, 100.0 * rounded.bytes / exact.bytes - 100.0);
+
+        if (exact.hole_mismatch != 0)
+        {
+            printf("info (bench): scale %.2f: content buffer misses the decor hole by %" PRId64 " pixels.\n", (double) scale / SCALE_DENOMINATOR,
+                   exact.hole_mismatch);
+        }
+    }
+
+    return consistent ? 0 : 1;
+}
@@ -0,0 +1,328 @@
+// Runs the client against the mock compositor inside one process and drives it through scripted phases: a pointer
+// storm over content and decor, scrolling and a configure storm, followed by idling with the pointer outside and inside
+// a window, before closing all windows. Reports the time per phase, the CPU time spent idling and the requests the
+// compositor received.
+// Arguments are passed on to the client, which opens two windows.
+//
+// The client is built from the same sources as `wayland-window`, with its `main` renamed to `wayland_window_main`.
+
+#include "compositor.h"
+#include "decor.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define BENCH_WINDOWS 2
+#define BENCH_TIMEOUT_MS 10000
+#define BENCH_POINTER_EVENTS 20000
+#define BENCH_SCROLL_EVENTS 2000
+#define BENCH_CONFIGURES 200
+// Time for kinetic scrolling and redraws of the earlier phases to end before idling is measured.
+#define BENCH_IDLE_SETTLE_MS 1500
+#define BENCH_IDLE_MS 2000
+// Idling may take at most this share of the idle time, mostly for the mock compositor's own wakeups.
+#define BENCH_IDLE_MAX_CPU 0.01
+// Events are sent in bursts of this size, each followed by a sync, so the socket buffers never fill up.
+#define BENCH_BURST 100
+
+// Evdev code, see `linux/input-event-codes.h`.
+#define BENCH_AXIS_VERTICAL 0
+
+int wayland_window_main(int argc, char **argv);
+
+struct script
+{
+    struct mock_compositor *mock;
+    atomic_bool client_done;
+    bool failed;
+};
+
+static bool script_sync(struct script *script)
+{
+    if (!mock_compositor_sync(script->mock, BENCH_TIMEOUT_MS))
+    {
+        fprintf(stderr, "error (bench): The client did not answer a ping in time.\n");
+        script->failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+static void print_phase(const char *name, uint64_t start_ns, int events)
+{
+    double elapsed_ms = (get_monotonic_time_ns() - start_ns) / 1e6;
+    printf("info (bench): %s: events=%d time=%.1fms per event=%.2fus.\n", name, events, elapsed_ms, elapsed_ms * 1000.0 / events);
+}
+
+// Motion over the content, then over the titlebar and the top border, which change the cursor on the way.
+static bool run_pointer_storm(struct script *script, struct mock_surface *content, struct mock_surface *decor)
+{
+    uint64_t start_ns = get_monotonic_time_ns();
+    mock_pointer_enter(script->mock, content, 10, 10);
+
+    for (int i = 0; i < BENCH_POINTER_EVENTS / 2; ++i)
+    {
+        mock_pointer_motion(script->mock, 10 + i % 500, 10 + (i / 7) % 300);
+
+        if (i % BENCH_BURST == BENCH_BURST - 1 && !script_sync(script))
+        {
+            return false;
+        }
+    }
+
+    mock_pointer_enter(script->mock, decor, BORDER_WIDTH + 10, BORDER_WIDTH / 2.0);
+
+    for (int i = 0; i < BENCH_POINTER_EVENTS / 2; ++i)
+    {
+        double y_position = i % 2 == 0 ? BORDER_WIDTH / 2.0 : BORDER_WIDTH + TITLEBAR_WIDTH / 2.0;
+        mock_pointer_motion(script->mock, BORDER_WIDTH + 10 + i % 500, y_position);
+
+        if (i % BENCH_BURST == BENCH_BURST - 1 && !script_sync(script))
+        {
+            return false;
+        }
+    }
+
+    mock_pointer_leave(script->mock);
+
+    if (!script_sync(script))
+    {
+        return false;
+    }
+
+    print_phase("pointer storm", start_ns, BENCH_POINTER_EVENTS);
+
+    return true;
+}
+
+// Wheel notches, then finger scrolling in short gestures that each end with a stop.
+static bool run_scroll(struct script *script, struct mock_surface *content)
+{
+    uint64_t start_ns = get_monotonic_time_ns();
+    mock_pointer_enter(script->mock, content, 100, 100);
+
+    for (int i = 0; i < BENCH_SCROLL_EVENTS; ++i)
+    {
+        if (i < BENCH_SCROLL_EVENTS / 2)
+        {
+            mock_pointer_axis(script->mock, BENCH_AXIS_VERTICAL, i % 20 < 10 ? 15 : -15, i % 20 < 10 ? 1 : -1);
+        }
+        else
+        {
+            mock_pointer_axis(script->mock, BENCH_AXIS_VERTICAL, i % 10 == 9 ? 0 : 4.5, 0);
+        }
+
+        if (i % BENCH_BURST == BENCH_BURST - 1 && !script_sync(script))
+        {
+            return false;
+        }
+    }
+
+    mock_pointer_leave(script->mock);
+
+    if (!script_sync(script))
+    {
+        return false;
+    }
+
+    print_phase("scroll", start_ns, BENCH_SCROLL_EVENTS);
+
+    return true;
+}
+
+static bool run_configure_storm(struct script *script)
+{
+    static const int32_t sizes[][2] = {{800, 600}, {640, 480}, {1024, 768}, {500, 700}};
+    uint64_t start_ns = get_monotonic_time_ns();
+
+    for (int i = 0; i < BENCH_CONFIGURES; ++i)
+    {
+        for (size_t j = 0; j < BENCH_WINDOWS; ++j)
+        {
+            struct mock_toplevel *toplevel = mock_compositor_get_toplevel(script->mock, j);
+            const int32_t *size = sizes[(i + j) % 4];
+
+            if (toplevel != NULL)
+            {
+                mock_toplevel_configure(toplevel, size[0], size[1]);
+            }
+        }
+
+        if (!script_sync(script))
+        {
+            return false;
+        }
+    }
+
+    print_phase("configure storm", start_ns, BENCH_CONFIGURES * BENCH_WINDOWS);
+
+    return true;
+}
+
+// User and system time of the whole process, including the mock compositor.
+static uint64_t get_cpu_time_us(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return (uint64_t) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static void measure_idle(struct script *script, const char *name)
+{
+    usleep(BENCH_IDLE_SETTLE_MS * 1000);
+    uint64_t start_us = get_cpu_time_us();
+    usleep(BENCH_IDLE_MS * 1000);
+    double cpu_ms = (get_cpu_time_us() - start_us) / 1000.0;
+    printf("info (bench): %s: cpu=%.2fms over %dms (%.2f%%).\n", name, cpu_ms, BENCH_IDLE_MS, cpu_ms * 100.0 / BENCH_IDLE_MS);
+
+    if (cpu_ms > BENCH_IDLE_MS * BENCH_IDLE_MAX_CPU)
+    {
+        fprintf(stderr, "error (bench): The client is busy while idle.\n");
+        script->failed = true;
+    }
+}
+
+// Nothing may run while the pointer is outside, and a cursor that is not animated must not cost anything either.
+static bool run_idle(struct script *script, struct mock_surface *content)
+{
+    measure_idle(script, "idle, pointer outside");
+
+    mock_pointer_enter(script->mock, content, 100, 100);
+
+    if (!script_sync(script))
+    {
+        return false;
+    }
+
+    measure_idle(script, "idle, pointer over content");
+    mock_pointer_leave(script->mock);
+
+    return script_sync(script);
+}
+
+static void *script_run(void *data)
+{
+    struct script *script = data;
+
+    if (!mock_compositor_wait_toplevels(script->mock, BENCH_WINDOWS, BENCH_TIMEOUT_MS))
+    {
+        fprintf(stderr, "error (bench): The client did not map its windows in time.\n");
+        script->failed = true;
+        kill(getpid(), SIGTERM);
+        return NULL;
+    }
+
+    struct mock_surface *content = mock_toplevel_get_surface(mock_compositor_get_toplevel(script->mock, 0));
+    struct mock_surface *decor = content != NULL ? mock_surface_get_subsurface(content, 0) : NULL;
+
+    if (content == NULL || decor == NULL)
+    {
+        fprintf(stderr, "error (bench): The first window has no decor.\n");
+        script->failed = true;
+    }
+    else
+    {
+        // Later phases are pointless once the client stopped answering.
+        if (run_pointer_storm(script, content, decor) && run_scroll(script, content) && run_configure_storm(script))
+        {
+            run_idle(script, content);
+        }
+    }
+
+    // The client exits once its last window is closed.
+    for (size_t i = 0; i < BENCH_WINDOWS; ++i)
+    {
+        struct mock_toplevel *toplevel = mock_compositor_get_toplevel(script->mock, i);
+
+        if (toplevel != NULL)
+        {
+            mock_toplevel_close(toplevel);
+        }
+    }
+
+    uint64_t deadline_ns = get_monotonic_time_ns() + (uint64_t) BENCH_TIMEOUT_MS * 1000000;
+
+    while (!atomic_load(&script->client_done) && get_monotonic_time_ns() < deadline_ns)
+    {
+        usleep(10000);
+    }
+
+    if (!atomic_load(&script->client_done))
+    {
+        fprintf(stderr, "error (bench): The client did not exit after its windows were closed.\n");
+        script->failed = true;
+        kill(getpid(), SIGTERM);
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct mock_compositor_options options = {
+        .frame_interval_ms = 16,
+        .layout = "us",
+    };
+
+    // Blocked before the mock compositor and the script thread start, so that both inherit the mask and the SIGTERM of
+    // the script only reaches the client's signalfd.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    struct script script = {0};
+    script.mock = mock_compositor_create(&options);
+    int fd = script.mock != NULL ? mock_compositor_connect(script.mock) : -1;
+
+    if (fd == -1)
+    {
+        fprintf(stderr, "error (bench): Failed to start the mock compositor.\n");
+        return 1;
+    }
+
+    // `wl_display_connect` takes over this fd instead of looking for a socket.
+    char socket[16];
+    snprintf(socket, sizeof(socket), "%d", fd);
+    setenv("WAYLAND_SOCKET", socket, 1);
+
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, script_run, &script) != 0)
+    {
+        fprintf(stderr, "error (bench): Failed to start the script thread.\n");
+        mock_compositor_destroy(script.mock);
+        return 1;
+    }
+
+    char windows[16];
+    snprintf(windows, sizeof(windows), "%d", BENCH_WINDOWS);
+    char *client_argv[16] = {"wayland-window", "--windows", windows};
+    int client_argc = 3;
+
+    for (int i = 1; i < argc && client_argc < 15; ++i)
+    {
+        client_argv[client_argc++] = argv[i];
+    }
+
+    int result = wayland_window_main(client_argc, client_argv);
+    atomic_store(&script.client_done, true);
+    pthread_join(thread, NULL);
+
+    mock_compositor_print_stats(script.mock);
+    mock_compositor_print_requests(script.mock);
+    mock_compositor_destroy(script.mock);
+
+    return result != 0 || script.failed ? 1 : 0;
+}
@@ -0,0 +1,223 @@
+#include "harness.h"
+#include "compositor.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// Path below `/proc` for the process, `self` for zero.
+static void get_proc_path(char *buffer, size_t size, pid_t pid, const char *name)
+{
+    if (pid == 0)
+    {
+        snprintf(buffer, size, "/proc/self/%s", name);
+    }
+    else
+    {
+        snprintf(buffer, size, "/proc/%d/%s", (int) pid, name);
+    }
+}
+
+size_t bench_get_rss_bytes(pid_t pid)
+{
+    char path[64];
+    get_proc_path(path, sizeof(path), pid, "statm");
+    FILE *file = fopen(path, "r");
+    size_t pages = 0;
+    size_t resident = 0;
+
+    if (file != NULL)
+    {
+        if (fscanf(file, "%zu %zu", &pages, &resident) != 2)
+        {
+            resident = 0;
+        }
+
+        fclose(file);
+    }
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+int bench_get_fd_count(pid_t pid)
+{
+    char path[64];
+    get_proc_path(path, sizeof(path), pid, "fd");
+    DIR *directory = opendir(path);
+    int count = 0;
+
+    if (directory == NULL)
+    {
+        return -1;
+    }
+
+    for (struct dirent *entry = readdir(directory); entry != NULL; entry = readdir(directory))
+    {
+        count += entry->d_name[0] != '.';
+    }
+
+    closedir(directory);
+
+    // Our own listing holds the fd of the directory.
+    return pid == 0 ? count - 1 : count;
+}
+
+size_t bench_get_shm_bytes(pid_t pid)
+{
+    char path[64];
+    get_proc_path(path, sizeof(path), pid, "maps");
+    FILE *file = fopen(path, "r");
+    char line[512];
+    size_t bytes = 0;
+
+    if (file == NULL)
+    {
+        return 0;
+    }
+
+    // Pool files are named by `create_shm_file`.
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        unsigned long start;
+        unsigned long end;
+
+        if (strstr(line, "/wl_shm-") != NULL && sscanf(line, "%lx-%lx", &start, &end) == 2)
+        {
+            bytes += end - start;
+        }
+    }
+
+    fclose(file);
+
+    return bytes;
+}
+
+uint64_t bench_get_cpu_time_us(pid_t pid)
+{
+    char path[64];
+    get_proc_path(path, sizeof(path), pid, "stat");
+    FILE *file = fopen(path, "r");
+    char line[1024];
+    unsigned long user = 0;
+    unsigned long system = 0;
+
+    if (file == NULL)
+    {
+        return 0;
+    }
+
+    // The name in the second field may contain spaces, the fields after it are counted from its closing parenthesis.
+    if (fgets(line, sizeof(line), file) != NULL)
+    {
+        char *fields = strrchr(line, ')');
+
+        if (fields == NULL || sscanf(fields, ") %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &user, &system) != 2)
+        {
+            user = 0;
+            system = 0;
+        }
+    }
+
+    fclose(file);
+
+    return (uint64_t) (user + system) * 1000000 / sysconf(_SC_CLK_TCK);
+}
+
+pid_t bench_spawn_client(struct mock_compositor *mock, const char *path, char *const *argv)
+{
+    int fd = mock_compositor_connect(mock);
+
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    // Everything the child needs is prepared here, as only async-signal-safe calls may follow the fork of a process
+    // with threads. The duplicate is inherited, the original is close-on-exec.
+    int client_fd = fcntl(fd, F_DUPFD, 3);
+    close(fd);
+    size_t count = 0;
+
+    while (environ[count] != NULL)
+    {
+        count += 1;
+    }
+
+    char socket[32];
+    snprintf(socket, sizeof(socket), "WAYLAND_SOCKET=%d", client_fd);
+    char **envp = malloc((count + 2) * sizeof(char *));
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    if (client_fd == -1 || envp == NULL || null_fd == -1)
+    {
+        if (client_fd != -1)
+        {
+            close(client_fd);
+        }
+
+        if (null_fd != -1)
+        {
+            close(null_fd);
+        }
+
+        free(envp);
+        return -1;
+    }
+
+    size_t envc = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (strncmp(environ[i], "WAYLAND_SOCKET=", 15) != 0)
+        {
+            envp[envc++] = environ[i];
+        }
+    }
+
+    envp[envc++] = socket;
+    envp[envc] = NULL;
+
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        dup2(null_fd, STDOUT_FILENO);
+        execve(path, argv, envp);
+        _exit(127);
+    }
+
+    close(client_fd);
+    close(null_fd);
+    free(envp);
+
+    return pid;
+}
+
+int bench_wait_client(pid_t pid, int timeout_ms)
+{
+    uint64_t deadline_ns = get_monotonic_time_ns() + (uint64_t) timeout_ms * 1000000;
+    int status;
+    pid_t result;
+
+    while ((result = waitpid(pid, &status, WNOHANG)) == 0)
+    {
+        if (get_monotonic_time_ns() >= deadline_ns)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            return -1;
+        }
+
+        usleep(1000);
+    }
+
+    return result == pid && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Helpers shared by the benchmarks.
+
+// Resident memory of the process, zero for the calling one. Zero if it cannot be read.
+size_t bench_get_rss_bytes(pid_t pid);
+
+// Open fds of the process, zero for the calling one. -1 if they cannot be listed.
+int bench_get_fd_count(pid_t pid);
+
+// User and system time the process spent so far, in microseconds but counted in clock ticks of usually 10ms. Zero if it
+// cannot be read.
+uint64_t bench_get_cpu_time_us(pid_t pid);
+
+struct mock_compositor;
+
+// Bytes of `wl_shm` pool files the client process has mapped. Cursor themes use files of their own and are not included.
+size_t bench_get_shm_bytes(pid_t pid);
+
+// Starts the client at `path` as its own process, connected to the mock compositor through `WAYLAND_SOCKET`. Its
+// output is discarded. Returns its pid, -1 on failure.
+pid_t bench_spawn_client(struct mock_compositor *mock, const char *path, char *const *argv);
+
+// Waits for the client to exit and kills it after the timeout. Returns its exit status, -1 if it had to be killed.
+int bench_wait_client(pid_t pid, int timeout_ms);
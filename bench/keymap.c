@@ -0,0 +1,125 @@
+// Replays a synthetic keystroke stream through xkb and through the flat keysym arrays of the keymap table, and reports
+// events per second for both. Uses the default keymap of the system's xkeyboard-config, or the layout given as the
+// first argument.
+
+#include "keymap_cache.h"
+#include "utils.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_EVENTS 10000000
+
+// Evdev codes of the letter and digit rows plus space, offset by 8 to xkb keycodes.
+static const xkb_keycode_t typed_keycodes[] = {
+    2 + 8, 3 + 8, 4 + 8, 5 + 8, 6 + 8, 7 + 8, 8 + 8, 9 + 8, 10 + 8, 11 + 8, 16 + 8, 17 + 8, 18 + 8, 19 + 8, 20 + 8,
+    21 + 8, 22 + 8, 23 + 8, 24 + 8, 25 + 8, 30 + 8, 31 + 8, 32 + 8, 33 + 8, 34 + 8, 35 + 8, 36 + 8, 37 + 8, 38 + 8,
+    44 + 8, 45 + 8, 46 + 8, 47 + 8, 48 + 8, 49 + 8, 50 + 8, 57 + 8,
+};
+
+#define TYPED_KEYCODE_COUNT (sizeof(typed_keycodes) / sizeof(typed_keycodes[0]))
+
+struct keystroke
+{
+    xkb_keycode_t keycode;
+    // Whether Shift is held, toggled about every tenth key like in regular typing.
+    bool shift;
+};
+
+static struct keystroke *generate_keystrokes(size_t count)
+{
+    struct keystroke *keystrokes = malloc(count * sizeof(struct keystroke));
+    uint64_t random = 0x9e3779b97f4a7c15;
+    bool shift = false;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        // xorshift64
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+
+        if (random % 10 == 0)
+        {
+            shift = !shift;
+        }
+
+        keystrokes[i] = (struct keystroke) {typed_keycodes[(random >> 8) % TYPED_KEYCODE_COUNT], shift};
+    }
+
+    return keystrokes;
+}
+
+int main(int argc, char **argv)
+{
+    struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    struct xkb_rule_names names = {.layout = argc > 1 ? argv[1] : NULL};
+    struct xkb_keymap *keymap = xkb_keymap_new_from_names(context, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+
+    if (keymap == NULL)
+    {
+        fprintf(stderr, "error (bench): Failed to compile the keymap.\n");
+        return 1;
+    }
+
+    struct keymap_table table;
+
+    if (!keymap_table_build(&table, keymap))
+    {
+        fprintf(stderr, "error (bench): Failed to build the keymap table.\n");
+        return 1;
+    }
+
+    xkb_mod_mask_t shift_mask = 1u << xkb_keymap_mod_get_index(keymap, XKB_MOD_NAME_SHIFT);
+    struct xkb_state *state = xkb_state_new(keymap);
+    struct keystroke *keystrokes = generate_keystrokes(BENCH_EVENTS);
+    uint64_t checksum = 0;
+
+    // Both paths see the same modifier updates as a client would: one per Shift change.
+    uint64_t start_ns = get_monotonic_time_ns();
+    bool shift = false;
+
+    for (size_t i = 0; i < BENCH_EVENTS; ++i)
+    {
+        if (keystrokes[i].shift != shift)
+        {
+            shift = keystrokes[i].shift;
+            xkb_state_update_mask(state, shift ? shift_mask : 0, 0, 0, 0, 0, 0);
+        }
+
+        checksum += xkb_state_key_get_one_sym(state, keystrokes[i].keycode);
+    }
+
+    uint64_t xkb_ns = get_monotonic_time_ns() - start_ns;
+
+    start_ns = get_monotonic_time_ns();
+    shift = false;
+    const xkb_keysym_t *syms = keymap_table_get_syms(&table, 0, 0);
+
+    for (size_t i = 0; i < BENCH_EVENTS; ++i)
+    {
+        if (keystrokes[i].shift != shift)
+        {
+            shift = keystrokes[i].shift;
+            syms = keymap_table_get_syms(&table, shift ? shift_mask : 0, 0);
+        }
+
+        checksum -= syms[keystrokes[i].keycode - table.min_keycode];
+    }
+
+    uint64_t table_ns = get_monotonic_time_ns() - start_ns;
+
+    // Both paths must agree, so the checksum cancels out.
+    printf("info (bench): %d keystrokes, results %s.\n", BENCH_EVENTS, checksum == 0 ? "match" : "DIFFER");
+    printf("info (bench): xkb_state_key_get_one_sym: %.1f M events/s.\n", BENCH_EVENTS / (xkb_ns / 1e3));
+    printf("info (bench): keymap table: %.1f M events/s.\n", BENCH_EVENTS / (table_ns / 1e3));
+
+    free(keystrokes);
+    keymap_table_release(&table);
+    xkb_state_unref(state);
+    xkb_keymap_unref(keymap);
+    xkb_context_unref(context);
+
+    return checksum == 0 ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+// Runs the client as its own process against the mock compositor and reloads its keymap thousands of times, alternating
+// between two layouts with a key press after every reload. Once warm, neither the RSS nor the open fds of the client
+// may grow. The first argument is the path of the client, further arguments are passed on to it.
+
+#include "compositor.h"
+#include "harness.h"
+#include "utils.h"
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define BENCH_TIMEOUT_MS 10000
+#define BENCH_RELOADS 5000
+// Reloads before RSS and fds are sampled for the first time, so that caches are warm.
+#define BENCH_WARMUP 200
+#define BENCH_MAX_RSS_GROWTH ((size_t) 8 << 20)
+// Reloads are sent in bursts of this size, each followed by a sync, so the socket buffers never fill up.
+#define BENCH_BURST 100
+
+// Evdev code, see `linux/input-event-codes.h`.
+#define BENCH_KEY_A 30
+
+static bool bench_soak(struct mock_compositor *mock, pid_t pid)
+{
+    struct mock_surface *content = mock_toplevel_get_surface(mock_compositor_get_toplevel(mock, 0));
+
+    if (content == NULL)
+    {
+        fprintf(stderr, "error (bench): The window has no surface.\n");
+        return false;
+    }
+
+    uint64_t start_ns = get_monotonic_time_ns();
+    mock_keyboard_enter(mock, content);
+    size_t base_rss = 0;
+    int base_fds = 0;
+
+    for (int i = 0; i < BENCH_RELOADS; ++i)
+    {
+        mock_keyboard_keymap(mock, i % 2 == 0 ? "us" : "de");
+        mock_keyboard_key(mock, BENCH_KEY_A, true);
+        mock_keyboard_key(mock, BENCH_KEY_A, false);
+
+        if (i % BENCH_BURST == BENCH_BURST - 1 && !mock_compositor_sync(mock, BENCH_TIMEOUT_MS))
+        {
+            fprintf(stderr, "error (bench): The client did not answer a ping in time.\n");
+            return false;
+        }
+
+        if (i == BENCH_WARMUP - 1)
+        {
+            base_rss = bench_get_rss_bytes(pid);
+            base_fds = bench_get_fd_count(pid);
+        }
+    }
+
+    mock_keyboard_leave(mock);
+
+    if (!mock_compositor_sync(mock, BENCH_TIMEOUT_MS))
+    {
+        fprintf(stderr, "error (bench): The client did not answer a ping in time.\n");
+        return false;
+    }
+
+    double elapsed_ms = (get_monotonic_time_ns() - start_ns) / 1e6;
+    size_t rss = bench_get_rss_bytes(pid);
+    int fds = bench_get_fd_count(pid);
+    printf("info (bench): keymap soak: reloads=%d time=%.1fms per reload=%.2fus.\n", BENCH_RELOADS, elapsed_ms, elapsed_ms * 1000.0 / BENCH_RELOADS);
+    printf("info (bench): keymap soak: rss growth=%.1fKiB fd growth=%d.\n", ((double) rss - base_rss) / 1024.0, fds - base_fds);
+
+    if (fds > base_fds || (rss > base_rss && rss - base_rss > BENCH_MAX_RSS_GROWTH))
+    {
+        fprintf(stderr, "error (bench): Keymap reloads leak.\n");
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s client [argument...]\n", argv[0]);
+        return 1;
+    }
+
+    struct mock_compositor_options options = {
+        .frame_interval_ms = 16,
+        .layout = "us",
+    };
+
+    struct mock_compositor *mock = mock_compositor_create(&options);
+
+    if (mock == NULL)
+    {
+        fprintf(stderr, "error (bench): Failed to start the mock compositor.\n");
+        return 1;
+    }
+
+    // Both are compiled once up front. The client starts out with the last one.
+    if (!mock_keyboard_keymap(mock, "de") || !mock_keyboard_keymap(mock, "us"))
+    {
+        printf("info (bench): No keymaps to reload, skipping the keymap soak.\n");
+        mock_compositor_destroy(mock);
+        return 0;
+    }
+
+    char *client_argv[16] = {"wayland-window"};
+    int client_argc = 1;
+
+    for (int i = 2; i < argc && client_argc < 15; ++i)
+    {
+        client_argv[client_argc++] = argv[i];
+    }
+
+    pid_t pid = bench_spawn_client(mock, argv[1], client_argv);
+    bool ok = pid != -1 && mock_compositor_wait_toplevels(mock, 1, BENCH_TIMEOUT_MS);
+
+    if (!ok)
+    {
+        fprintf(stderr, "error (bench): The client did not map its window in time.\n");
+
+        if (pid != -1)
+        {
+            kill(pid, SIGTERM);
+        }
+    }
+    else
+    {
+        ok = bench_soak(mock, pid);
+        mock_toplevel_close(mock_compositor_get_toplevel(mock, 0));
+    }
+
+    // The client exits once its window is closed, tearing down all it created on the way.
+    if (pid != -1 && bench_wait_client(pid, BENCH_TIMEOUT_MS) != 0 && ok)
+    {
+        fprintf(stderr, "error (bench): The client did not exit cleanly.\n");
+        ok = false;
+    }
+
+    mock_compositor_destroy(mock);
+
+    return ok ? 0 : 1;
+}
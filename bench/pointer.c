@@ -0,0 +1,178 @@
+// Runs the client as its own process against the mock compositor and sends it pointer events at a high rate: motion over
+// the content, motion over the decor that crosses from one role to another with every event, and the pointer entering
+// the content and the decor in turn. Reports the time and the client's CPU time per event for each phase. The first
+// argument is the path of the client, further arguments are passed on to it.
+
+#include "compositor.h"
+#include "decor.h"
+#include "harness.h"
+#include "utils.h"
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define BENCH_TIMEOUT_MS 10000
+#define BENCH_EVENTS 50000
+// Events are sent in bursts of this size, each followed by a sync, so the socket buffers never fill up.
+#define BENCH_BURST 100
+#define BENCH_WIDTH 400
+#define BENCH_HEIGHT 300
+
+enum bench_phase
+{
+    BENCH_PHASE_CONTENT_MOTION,
+    BENCH_PHASE_DECOR_MOTION,
+    BENCH_PHASE_ENTER,
+    BENCH_PHASE_COUNT,
+};
+
+static const char *const bench_phase_names[BENCH_PHASE_COUNT] = {
+    [BENCH_PHASE_CONTENT_MOTION] = "content motion",
+    [BENCH_PHASE_DECOR_MOTION] = "decor motion",
+    [BENCH_PHASE_ENTER] = "enter",
+};
+
+static void bench_send(struct mock_compositor *mock, enum bench_phase phase, int i, struct mock_surface *content, struct mock_surface *decor)
+{
+    switch (phase)
+    {
+    case BENCH_PHASE_CONTENT_MOTION:
+        mock_pointer_motion(mock, 10 + i % (BENCH_WIDTH - 20), 10 + (i / 7) % (BENCH_HEIGHT - 20));
+        break;
+    case BENCH_PHASE_DECOR_MOTION:
+        // Alternates between the top border and the titlebar, which differ in cursor and action.
+        mock_pointer_motion(mock, BORDER_WIDTH + 10 + i % (BENCH_WIDTH - 20), i % 2 == 0 ? BORDER_WIDTH / 2.0 : BORDER_WIDTH + TITLEBAR_WIDTH / 2.0);
+        break;
+    case BENCH_PHASE_ENTER:
+        if (i % 2 == 0)
+        {
+            mock_pointer_enter(mock, content, 10 + i % (BENCH_WIDTH - 20), 10);
+        }
+        else
+        {
+            mock_pointer_enter(mock, decor, BORDER_WIDTH / 2.0, BORDER_WIDTH + 10 + i % (BENCH_HEIGHT - 20));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static bool bench_phase_run(struct mock_compositor *mock, pid_t pid, enum bench_phase phase, struct mock_surface *content, struct mock_surface *decor)
+{
+    if (phase == BENCH_PHASE_CONTENT_MOTION)
+    {
+        mock_pointer_enter(mock, content, 10, 10);
+    }
+    else if (phase == BENCH_PHASE_DECOR_MOTION)
+    {
+        mock_pointer_enter(mock, decor, BORDER_WIDTH + 10, BORDER_WIDTH / 2.0);
+    }
+
+    // The enter above is not part of the phase.
+    if (!mock_compositor_sync(mock, BENCH_TIMEOUT_MS))
+    {
+        fprintf(stderr, "error (bench): The client did not answer a ping in time.\n");
+        return false;
+    }
+
+    uint64_t start_ns = get_monotonic_time_ns();
+    uint64_t start_cpu_us = bench_get_cpu_time_us(pid);
+
+    for (int i = 0; i < BENCH_EVENTS; ++i)
+    {
+        bench_send(mock, phase, i, content, decor);
+
+        if (i % BENCH_BURST == BENCH_BURST - 1 && !mock_compositor_sync(mock, BENCH_TIMEOUT_MS))
+        {
+            fprintf(stderr, "error (bench): The client did not answer a ping in time.\n");
+            return false;
+        }
+    }
+
+    double elapsed_ms = (get_monotonic_time_ns() - start_ns) / 1e6;
+    double cpu_ms = (bench_get_cpu_time_us(pid) - start_cpu_us) / 1000.0;
+    printf("info (bench): %s: events=%d time=%.1fms per event=%.2fus events per second=%.0f client cpu=%.0fms per event=%.2fus.\n",
+           bench_phase_names[phase], BENCH_EVENTS, elapsed_ms, elapsed_ms * 1000.0 / BENCH_EVENTS, BENCH_EVENTS * 1000.0 / elapsed_ms, cpu_ms,
+           cpu_ms * 1000.0 / BENCH_EVENTS);
+
+    mock_pointer_leave(mock);
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s client [argument...]\n", argv[0]);
+        return 1;
+    }
+
+    struct mock_compositor_options options = {
+        .frame_interval_ms = 16,
+        .width = BENCH_WIDTH,
+        .height = BENCH_HEIGHT,
+    };
+
+    struct mock_compositor *mock = mock_compositor_create(&options);
+
+    if (mock == NULL)
+    {
+        fprintf(stderr, "error (bench): Failed to start the mock compositor.\n");
+        return 1;
+    }
+
+    char *client_argv[16] = {"wayland-window"};
+    int client_argc = 1;
+
+    for (int i = 2; i < argc && client_argc < 15; ++i)
+    {
+        client_argv[client_argc++] = argv[i];
+    }
+
+    pid_t pid = bench_spawn_client(mock, argv[1], client_argv);
+    bool ok = pid != -1 && mock_compositor_wait_toplevels(mock, 1, BENCH_TIMEOUT_MS);
+    struct mock_toplevel *toplevel = ok ? mock_compositor_get_toplevel(mock, 0) : NULL;
+    struct mock_surface *content = toplevel != NULL ? mock_toplevel_get_surface(toplevel) : NULL;
+    struct mock_surface *decor = content != NULL ? mock_surface_get_subsurface(content, 0) : NULL;
+
+    if (!ok)
+    {
+        fprintf(stderr, "error (bench): The client did not map its window in time.\n");
+
+        if (pid != -1)
+        {
+            kill(pid, SIGTERM);
+        }
+    }
+    else if (decor == NULL)
+    {
+        fprintf(stderr, "error (bench): The window has no decor.\n");
+        ok = false;
+    }
+    else
+    {
+        for (int phase = 0; phase < BENCH_PHASE_COUNT && ok; ++phase)
+        {
+            ok = bench_phase_run(mock, pid, phase, content, decor);
+        }
+    }
+
+    if (toplevel != NULL)
+    {
+        mock_toplevel_close(toplevel);
+    }
+
+    // The client exits once its window is closed.
+    if (pid != -1 && bench_wait_client(pid, BENCH_TIMEOUT_MS) != 0 && ok)
+    {
+        fprintf(stderr, "error (bench): The client did not exit cleanly.\n");
+        ok = false;
+    }
+
+    mock_compositor_destroy(mock);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+// Starts the client as its own process against the mock compositor again and again, and measures the time from starting
+// it until its window committed the first frame, and from closing the window until the process exited. The first
+// argument is the path of the client, further arguments are passed on to it.
+//
+// Every run gets a fresh compositor, so that no run starts with state left behind by an earlier one.
+
+#include "compositor.h"
+#include "harness.h"
+#include "stats.h"
+#include "utils.h"
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define BENCH_RUNS 50
+#define BENCH_TIMEOUT_MS 10000
+
+static bool bench_run(const char *client_path, char *const *client_argv, struct latency_histogram *first_frame, struct latency_histogram *close_to_exit)
+{
+    struct mock_compositor_options options = {
+        .frame_interval_ms = 16,
+        .layout = "us",
+    };
+
+    struct mock_compositor *mock = mock_compositor_create(&options);
+
+    if (mock == NULL)
+    {
+        fprintf(stderr, "error (bench): Failed to start the mock compositor.\n");
+        return false;
+    }
+
+    uint64_t start_ns = get_monotonic_time_ns();
+    pid_t pid = bench_spawn_client(mock, client_path, client_argv);
+    bool ok = pid != -1 && mock_compositor_wait_toplevels(mock, 1, BENCH_TIMEOUT_MS);
+
+    if (!ok)
+    {
+        fprintf(stderr, "error (bench): The client did not map its window in time.\n");
+
+        if (pid != -1)
+        {
+            kill(pid, SIGTERM);
+        }
+    }
+    else
+    {
+        latency_histogram_add(first_frame, (get_monotonic_time_ns() - start_ns) / 1000);
+        start_ns = get_monotonic_time_ns();
+        mock_toplevel_close(mock_compositor_get_toplevel(mock, 0));
+    }
+
+    // The client exits once its window is closed.
+    if (pid != -1 && bench_wait_client(pid, BENCH_TIMEOUT_MS) != 0 && ok)
+    {
+        fprintf(stderr, "error (bench): The client did not exit cleanly.\n");
+        ok = false;
+    }
+    else if (ok)
+    {
+        latency_histogram_add(close_to_exit, (get_monotonic_time_ns() - start_ns) / 1000);
+    }
+
+    mock_compositor_destroy(mock);
+
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s client [argument...]\n", argv[0]);
+        return 1;
+    }
+
+    char *client_argv[16] = {"wayland-window"};
+    int client_argc = 1;
+
+    for (int i = 2; i < argc && client_argc < 15; ++i)
+    {
+        client_argv[client_argc++] = argv[i];
+    }
+
+    struct latency_histogram first_frame = {0};
+    struct latency_histogram close_to_exit = {0};
+    int failed = 0;
+
+    for (int i = 0; i < BENCH_RUNS; ++i)
+    {
+        failed += !bench_run(argv[1], client_argv, &first_frame, &close_to_exit);
+    }
+
+    printf("info (bench): %d runs, %d failed.\n", BENCH_RUNS, failed);
+    latency_histogram_print(&first_frame, "start to first frame");
+    latency_histogram_print(&close_to_exit, "close to exit");
+
+    return failed == 0 ? 0 : 1;
+}
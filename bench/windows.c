@@ -0,0 +1,192 @@
+// Runs the client with `--windows N` against the headless mock compositor and resizes all of its windows through a
+// scripted sequence of sizes. Reports the client's memory (RSS and shm), open fds, protocol messages per second and the
+// latency from sending a configure to the commit that answers it. The first argument is the path of the client, window
+// counts can follow it, by default 1, 10, 100 and 1000.
+//
+// The client runs as its own process with a fresh connection per window count, so its memory and fds are measured
+// without those of the compositor or of earlier runs.
+
+#include "compositor.h"
+#include "harness.h"
+#include "stats.h"
+#include "utils.h"
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_STEPS 20
+// A step is abandoned if not all windows were configured within this time.
+#define BENCH_STEP_TIMEOUT_MS 10000
+// Mapping 1000 windows includes starting the client.
+#define BENCH_MAP_TIMEOUT_MS 60000
+
+static const int bench_default_counts[] = {1, 10, 100, 1000};
+
+// Logical sizes the windows cycle through, shifted per window so that neighbours differ. The first configure uses the
+// first one, so that the client does not start out at its much larger default size.
+static const int32_t bench_sizes[][2] = {{400, 300}, {480, 360}, {360, 420}, {320, 320}, {520, 300}};
+
+#define BENCH_SIZE_COUNT (sizeof(bench_sizes) / sizeof(bench_sizes[0]))
+
+// Measured in the run with the fewest windows, to derive the cost of each further window.
+struct bench_base
+{
+    int count;
+    size_t rss;
+    size_t shm;
+    int fds;
+};
+
+static void print_process(const char *when, int count, pid_t pid, struct bench_base *base)
+{
+    size_t rss = bench_get_rss_bytes(pid);
+    size_t shm = bench_get_shm_bytes(pid);
+    int fds = bench_get_fd_count(pid);
+
+    printf("info (bench): %d windows: %s: RSS %.1f MiB, shm %.1f MiB, %d fds.\n", count, when, rss / 1048576.0, shm / 1048576.0, fds);
+
+    if (base->count == 0)
+    {
+        *base = (struct bench_base){count, rss, shm, fds};
+    }
+    else if (count > base->count)
+    {
+        int windows = count - base->count;
+        printf("info (bench): %d windows: %s: per further window RSS %.1f KiB, shm %.1f KiB, %.2f fds.\n", count, when,
+               ((double) rss - base->rss) / 1024.0 / windows, ((double) shm - base->shm) / 1024.0 / windows, (double) (fds - base->fds) / windows);
+    }
+}
+
+static bool bench_run(const char *client_path, int count, struct bench_base *base)
+{
+    struct mock_compositor_options options = {
+        .frame_interval_ms = 16,
+        .width = bench_sizes[0][0],
+        .height = bench_sizes[0][1],
+    };
+
+    struct mock_compositor *mock = mock_compositor_create(&options);
+    struct mock_toplevel **toplevels = calloc(count, sizeof(struct mock_toplevel *));
+
+    if (mock == NULL || toplevels == NULL)
+    {
+        fprintf(stderr, "error (bench): Failed to start the mock compositor.\n");
+
+        if (mock != NULL)
+        {
+            mock_compositor_destroy(mock);
+        }
+
+        free(toplevels);
+        return false;
+    }
+
+    char windows[16];
+    snprintf(windows, sizeof(windows), "%d", count);
+    char *client_argv[] = {"wayland-window", "--windows", windows, NULL};
+    uint64_t start_ns = get_monotonic_time_ns();
+    pid_t pid = bench_spawn_client(mock, client_path, client_argv);
+    bool ok = pid != -1 && mock_compositor_wait_toplevels(mock, count, BENCH_MAP_TIMEOUT_MS);
+
+    if (!ok)
+    {
+        fprintf(stderr, "error (bench): %d windows: The client did not map its windows in time.\n", count);
+
+        // Windows that are not mapped cannot be closed.
+        if (pid != -1)
+        {
+            kill(pid, SIGTERM);
+        }
+    }
+    else
+    {
+        printf("info (bench): %d windows: started and mapped in %.1fms.\n", count, (get_monotonic_time_ns() - start_ns) / 1e6);
+        print_process("mapped", count, pid, base);
+
+        for (int i = 0; i < count; ++i)
+        {
+            toplevels[i] = mock_compositor_get_toplevel(mock, i);
+        }
+
+        // Only the resizes are measured from here on.
+        mock_compositor_reset_stats(mock);
+        size_t timed_out = 0;
+        start_ns = get_monotonic_time_ns();
+
+        for (int step = 1; step <= BENCH_STEPS; ++step)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                const int32_t *size = bench_sizes[(step + i) % BENCH_SIZE_COUNT];
+
+                if (toplevels[i] != NULL)
+                {
+                    mock_toplevel_configure(toplevels[i], size[0], size[1]);
+                }
+            }
+
+            timed_out += mock_compositor_wait_configured(mock, BENCH_STEP_TIMEOUT_MS);
+        }
+
+        double seconds = (get_monotonic_time_ns() - start_ns) / 1e9;
+        struct mock_compositor_stats stats;
+        mock_compositor_get_stats(mock, &stats);
+
+        printf("info (bench): %d windows: %d resizes in %.2fs, %.0f messages per second (%" PRIu64 " requests, %" PRIu64 " events), %zu configures timed out.\n",
+               count, BENCH_STEPS, seconds, (stats.requests + stats.events) / seconds, stats.requests, stats.events, timed_out);
+        print_process("resized", count, pid, base);
+
+        char name[64];
+        snprintf(name, sizeof(name), "%d windows: configure to commit", count);
+        latency_histogram_print(&stats.configure_to_commit, name);
+
+        ok = timed_out == 0;
+    }
+
+    // The client exits once its last window is closed.
+    for (int i = 0; i < count; ++i)
+    {
+        if (toplevels[i] != NULL)
+        {
+            mock_toplevel_close(toplevels[i]);
+        }
+    }
+
+    if (pid != -1 && bench_wait_client(pid, BENCH_STEP_TIMEOUT_MS) != 0 && ok)
+    {
+        fprintf(stderr, "error (bench): %d windows: The client did not exit cleanly.\n", count);
+        ok = false;
+    }
+
+    mock_compositor_destroy(mock);
+    free(toplevels);
+
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s client [count...]\n", argv[0]);
+        return 1;
+    }
+
+    struct bench_base base = {0};
+    bool ok = true;
+
+    for (int i = 0; i < (argc > 2 ? argc - 2 : (int) (sizeof(bench_default_counts) / sizeof(bench_default_counts[0]))); ++i)
+    {
+        int count = argc > 2 ? atoi(argv[i + 2]) : bench_default_counts[i];
+
+        if (count > 0)
+        {
+            ok = bench_run(argv[1], count, &base) && ok;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
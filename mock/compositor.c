@@ -0,0 +1,1773 @@
+#define _GNU_SOURCE
+#include "compositor.h"
+#include "utils.h"
+#include "xdg-shell-server-protocol.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <wayland-server.h>
+#include <xkbcommon/xkbcommon.h>
+
+// Open addressing, keyed by the message description. Enough for every request and event of the implemented protocols.
+#define MOCK_MESSAGE_SLOTS 512
+#define MOCK_MAX_KEYMAPS 8
+
+struct mock_message_count
+{
+    const struct wl_message *message;
+    const char *interface;
+    uint64_t count;
+};
+
+struct mock_keymap
+{
+    char *layout;
+    char *string;
+    size_t size;
+};
+
+struct mock_compositor
+{
+    struct mock_compositor_options options;
+    struct wl_display *display;
+    struct wl_event_loop *loop;
+    struct wl_event_source *frame_timer;
+    // The timer only runs while frame callbacks are pending, so that an idle client is not woken by the compositor.
+    bool frame_timer_armed;
+    pthread_t thread;
+    // Held by the thread while it dispatches, and by every call made from outside.
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int wake_fd;
+    bool running;
+    struct wl_list surfaces;
+    struct wl_list toplevels;
+    // Resources of the bound globals and seat devices.
+    struct wl_list wm_bases;
+    struct wl_list pointers;
+    struct wl_list keyboards;
+    struct wl_list touches;
+    struct mock_surface *pointer_focus;
+    struct mock_surface *keyboard_focus;
+    struct mock_surface *touch_focus;
+    // Pongs missing for the current sync.
+    uint32_t ping_serial;
+    int pending_pongs;
+    struct xkb_context *xkb_context;
+    struct mock_keymap keymaps[MOCK_MAX_KEYMAPS];
+    int keymap_count;
+    // The keymap sent to keyboards, -1 if there is none.
+    int keymap;
+    struct mock_message_count messages[MOCK_MESSAGE_SLOTS];
+    // Slots in the order their message was first seen.
+    uint16_t message_order[MOCK_MESSAGE_SLOTS];
+    int message_count;
+    struct mock_compositor_stats stats;
+};
+
+struct mock_surface
+{
+    struct mock_compositor *mock;
+    struct wl_resource *resource;
+    struct wl_list link;
+    struct wl_resource *pending_buffer;
+    struct wl_listener pending_buffer_destroy;
+    bool pending_attach;
+    // Callbacks of the pending state, and of committed states waiting for the next frame.
+    struct wl_list pending_frames;
+    struct wl_list frames;
+    bool has_buffer;
+    int32_t buffer_width;
+    int32_t buffer_height;
+    struct mock_surface *parent;
+    struct wl_resource *subsurface;
+    struct wl_list children;
+    struct wl_list child_link;
+    struct wl_resource *xdg_surface;
+    struct mock_toplevel *toplevel;
+};
+
+struct mock_toplevel
+{
+    struct mock_compositor *mock;
+    struct mock_surface *surface;
+    struct wl_resource *resource;
+    struct wl_list link;
+    int32_t min_width;
+    int32_t min_height;
+    int32_t max_width;
+    int32_t max_height;
+    // Size of the last configure.
+    int32_t width;
+    int32_t height;
+    bool configured;
+    // Committed a buffer after the first configure.
+    bool mapped;
+    uint32_t configure_serial;
+    uint64_t configure_ns;
+    // The last configure was acked, but not committed yet.
+    bool acked;
+    // Committed after acking the last configure.
+    bool answered;
+};
+
+static uint32_t get_time_ms(void)
+{
+    return get_monotonic_time_ns() / 1000000;
+}
+
+static void wake(struct mock_compositor *mock)
+{
+    uint64_t value = 1;
+    write(mock->wake_fd, &value, sizeof(value));
+}
+
+static void unlink_resource(struct wl_resource *resource)
+{
+    wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void destroy_resource(struct wl_client *client, struct wl_resource *resource)
+{
+    wl_resource_destroy(resource);
+}
+
+// Returns false if the thread did not signal in time.
+static bool wait_until(struct mock_compositor *mock, const struct timespec *deadline)
+{
+    return pthread_cond_timedwait(&mock->cond, &mock->mutex, deadline) != ETIMEDOUT;
+}
+
+static struct timespec get_deadline(int timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000l;
+
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    return deadline;
+}
+
+// ####################################################################################################################
+// Recording
+
+static void protocol_logger(void *data, enum wl_protocol_logger_type type, const struct wl_protocol_logger_message *message)
+{
+    struct mock_compositor *mock = data;
+
+    if (type == WL_PROTOCOL_LOGGER_EVENT)
+    {
+        mock->stats.events += 1;
+        return;
+    }
+
+    mock->stats.requests += 1;
+
+    size_t slot = ((uintptr_t) message->message >> 4) % MOCK_MESSAGE_SLOTS;
+
+    while (mock->messages[slot].message != NULL && mock->messages[slot].message != message->message)
+    {
+        slot = (slot + 1) % MOCK_MESSAGE_SLOTS;
+    }
+
+    if (mock->messages[slot].message == NULL)
+    {
+        // Full, which the implemented protocols cannot reach. The request is still counted in the total.
+        if (mock->message_count == MOCK_MESSAGE_SLOTS - 1)
+        {
+            return;
+        }
+
+        mock->messages[slot].message = message->message;
+        mock->messages[slot].interface = wl_resource_get_class(message->resource);
+        mock->message_order[mock->message_count] = slot;
+        mock->message_count += 1;
+    }
+
+    mock->messages[slot].count += 1;
+}
+
+void mock_compositor_get_stats(struct mock_compositor *mock, struct mock_compositor_stats *stats)
+{
+    pthread_mutex_lock(&mock->mutex);
+    *stats = mock->stats;
+    pthread_mutex_unlock(&mock->mutex);
+}
+
+void mock_compositor_reset_stats(struct mock_compositor *mock)
+{
+    pthread_mutex_lock(&mock->mutex);
+    mock->stats = (struct mock_compositor_stats){0};
+    pthread_mutex_unlock(&mock->mutex);
+}
+
+void mock_compositor_print_stats(struct mock_compositor *mock)
+{
+    struct mock_compositor_stats stats;
+    mock_compositor_get_stats(mock, &stats);
+    printf("info (mock): requests=%" PRIu64 " events=%" PRIu64 " commits=%" PRIu64 " buffers=%" PRIu64 " configures=%" PRIu64
+           " frame_callbacks=%" PRIu64 ".\n",
+           stats.requests, stats.events, stats.commits, stats.attached_buffers, stats.configures, stats.frame_callbacks);
+    latency_histogram_print(&stats.configure_to_commit, "mock configure to commit");
+}
+
+void mock_compositor_print_requests(struct mock_compositor *mock)
+{
+    pthread_mutex_lock(&mock->mutex);
+
+    for (int i = 0; i < mock->message_count; ++i)
+    {
+        const struct mock_message_count *count = &mock->messages[mock->message_order[i]];
+        printf("info (mock): %s.%s=%" PRIu64 ".\n", count->interface, count->message->name, count->count);
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+}
+
+// ####################################################################################################################
+// Surface
+
+static void toplevel_send_configure(struct mock_toplevel *toplevel, int32_t width, int32_t height)
+{
+    struct mock_compositor *mock = toplevel->mock;
+    struct wl_array states;
+    wl_array_init(&states);
+    xdg_toplevel_send_configure(toplevel->resource, width, height, &states);
+    wl_array_release(&states);
+
+    toplevel->configure_serial = wl_display_next_serial(mock->display);
+    toplevel->configure_ns = get_monotonic_time_ns();
+    toplevel->acked = false;
+    toplevel->answered = false;
+    toplevel->configured = true;
+    toplevel->width = width;
+    toplevel->height = height;
+    xdg_surface_send_configure(toplevel->surface->xdg_surface, toplevel->configure_serial);
+    mock->stats.configures += 1;
+}
+
+static void surface_complete_frames(struct mock_surface *surface, uint32_t time)
+{
+    struct wl_resource *callback;
+    struct wl_resource *tmp;
+
+    wl_resource_for_each_safe(callback, tmp, &surface->frames)
+    {
+        wl_callback_send_done(callback, time);
+        wl_resource_destroy(callback);
+        surface->mock->stats.frame_callbacks += 1;
+    }
+}
+
+static int frame_timer_fire(void *data)
+{
+    struct mock_compositor *mock = data;
+    struct mock_surface *surface;
+    uint32_t time = get_time_ms();
+
+    wl_list_for_each(surface, &mock->surfaces, link)
+    {
+        surface_complete_frames(surface, time);
+    }
+
+    mock->frame_timer_armed = false;
+
+    return 0;
+}
+
+static void pending_buffer_destroyed(struct wl_listener *listener, void *data)
+{
+    struct mock_surface *surface = wl_container_of(listener, surface, pending_buffer_destroy);
+    wl_list_remove(&listener->link);
+    surface->pending_buffer = NULL;
+}
+
+static void surface_attach(struct wl_client *client, struct wl_resource *resource, struct wl_resource *buffer, int32_t x, int32_t y)
+{
+    struct mock_surface *surface = wl_resource_get_user_data(resource);
+
+    if (surface->pending_buffer != NULL)
+    {
+        wl_list_remove(&surface->pending_buffer_destroy.link);
+    }
+
+    surface->pending_buffer = buffer;
+    surface->pending_attach = true;
+
+    if (buffer != NULL)
+    {
+        surface->pending_buffer_destroy.notify = pending_buffer_destroyed;
+        wl_resource_add_destroy_listener(buffer, &surface->pending_buffer_destroy);
+    }
+}
+
+static void surface_damage(struct wl_client *client, struct wl_resource *resource, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+}
+
+static void surface_frame(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct mock_surface *surface = wl_resource_get_user_data(resource);
+    struct wl_resource *callback = wl_resource_create(client, &wl_callback_interface, 1, id);
+
+    if (callback == NULL)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(callback, NULL, NULL, unlink_resource);
+    wl_list_insert(surface->pending_frames.prev, wl_resource_get_link(callback));
+}
+
+static void surface_set_opaque_region(struct wl_client *client, struct wl_resource *resource, struct wl_resource *region)
+{
+}
+
+static void surface_set_input_region(struct wl_client *client, struct wl_resource *resource, struct wl_resource *region)
+{
+}
+
+static void toplevel_commit(struct mock_toplevel *toplevel)
+{
+    struct mock_compositor *mock = toplevel->mock;
+
+    // The initial commit of a toplevel carries no buffer and asks for the first configure.
+    if (!toplevel->configured)
+    {
+        toplevel_send_configure(toplevel, mock->options.width, mock->options.height);
+        return;
+    }
+
+    if (toplevel->acked)
+    {
+        latency_histogram_add(&mock->stats.configure_to_commit, (get_monotonic_time_ns() - toplevel->configure_ns) / 1000);
+        toplevel->acked = false;
+        toplevel->answered = true;
+        pthread_cond_broadcast(&mock->cond);
+    }
+
+    if (!toplevel->mapped && toplevel->surface->has_buffer)
+    {
+        toplevel->mapped = true;
+        pthread_cond_broadcast(&mock->cond);
+    }
+
+    bool fixed_size = toplevel->min_width > 0 && toplevel->min_width == toplevel->max_width && toplevel->min_height > 0 &&
+                      toplevel->min_height == toplevel->max_height;
+
+    if (mock->options.follow_size_hints && fixed_size && (toplevel->width != toplevel->min_width || toplevel->height != toplevel->min_height))
+    {
+        toplevel_send_configure(toplevel, toplevel->min_width, toplevel->min_height);
+    }
+}
+
+static void surface_commit(struct wl_client *client, struct wl_resource *resource)
+{
+    struct mock_surface *surface = wl_resource_get_user_data(resource);
+    struct mock_compositor *mock = surface->mock;
+    mock->stats.commits += 1;
+
+    // Nothing is drawn, so the buffer can be released right away.
+    if (surface->pending_attach)
+    {
+        struct wl_resource *buffer = surface->pending_buffer;
+        surface->has_buffer = buffer != NULL;
+
+        if (buffer != NULL)
+        {
+            struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer);
+
+            if (shm_buffer != NULL)
+            {
+                surface->buffer_width = wl_shm_buffer_get_width(shm_buffer);
+                surface->buffer_height = wl_shm_buffer_get_height(shm_buffer);
+            }
+
+            wl_list_remove(&surface->pending_buffer_destroy.link);
+            wl_buffer_send_release(buffer);
+            mock->stats.attached_buffers += 1;
+        }
+
+        surface->pending_buffer = NULL;
+        surface->pending_attach = false;
+    }
+
+    wl_list_insert_list(surface->frames.prev, &surface->pending_frames);
+    wl_list_init(&surface->pending_frames);
+
+    if (mock->options.frame_interval_ms == 0)
+    {
+        surface_complete_frames(surface, get_time_ms());
+    }
+    else if (!mock->frame_timer_armed && !wl_list_empty(&surface->frames))
+    {
+        wl_event_source_timer_update(mock->frame_timer, mock->options.frame_interval_ms);
+        mock->frame_timer_armed = true;
+    }
+
+    if (surface->toplevel != NULL && surface->xdg_surface != NULL)
+    {
+        toplevel_commit(surface->toplevel);
+    }
+}
+
+static void surface_set_buffer_transform(struct wl_client *client, struct wl_resource *resource, int32_t transform)
+{
+}
+
+static void surface_set_buffer_scale(struct wl_client *client, struct wl_resource *resource, int32_t scale)
+{
+}
+
+static void surface_damage_buffer(struct wl_client *client, struct wl_resource *resource, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+}
+
+static void surface_offset(struct wl_client *client, struct wl_resource *resource, int32_t x, int32_t y)
+{
+}
+
+static const struct wl_surface_interface surface_implementation = {
+    .destroy = destroy_resource,
+    .attach = surface_attach,
+    .damage = surface_damage,
+    .frame = surface_frame,
+    .set_opaque_region = surface_set_opaque_region,
+    .set_input_region = surface_set_input_region,
+    .commit = surface_commit,
+    .set_buffer_transform = surface_set_buffer_transform,
+    .set_buffer_scale = surface_set_buffer_scale,
+    .damage_buffer = surface_damage_buffer,
+    .offset = surface_offset,
+};
+
+static void surface_unlink_child(struct mock_surface *child)
+{
+    wl_list_remove(&child->child_link);
+    wl_list_init(&child->child_link);
+    child->parent = NULL;
+}
+
+static void surface_destroy(struct wl_resource *resource)
+{
+    struct mock_surface *surface = wl_resource_get_user_data(resource);
+    struct mock_compositor *mock = surface->mock;
+    struct wl_resource *callback;
+    struct wl_resource *tmp;
+
+    if (surface->pending_buffer != NULL)
+    {
+        wl_list_remove(&surface->pending_buffer_destroy.link);
+    }
+
+    wl_resource_for_each_safe(callback, tmp, &surface->pending_frames)
+    {
+        wl_resource_destroy(callback);
+    }
+
+    wl_resource_for_each_safe(callback, tmp, &surface->frames)
+    {
+        wl_resource_destroy(callback);
+    }
+
+    struct mock_surface *child;
+    struct mock_surface *child_tmp;
+
+    wl_list_for_each_safe(child, child_tmp, &surface->children, child_link)
+    {
+        surface_unlink_child(child);
+    }
+
+    surface_unlink_child(surface);
+
+    // Role objects outlive the surface only in broken clients, their requests are ignored from here on.
+    if (surface->subsurface != NULL)
+    {
+        wl_resource_set_user_data(surface->subsurface, NULL);
+    }
+
+    if (surface->xdg_surface != NULL)
+    {
+        wl_resource_set_user_data(surface->xdg_surface, NULL);
+    }
+
+    if (surface->toplevel != NULL)
+    {
+        surface->toplevel->surface = NULL;
+    }
+
+    mock->pointer_focus = mock->pointer_focus == surface ? NULL : mock->pointer_focus;
+    mock->keyboard_focus = mock->keyboard_focus == surface ? NULL : mock->keyboard_focus;
+    mock->touch_focus = mock->touch_focus == surface ? NULL : mock->touch_focus;
+
+    wl_list_remove(&surface->link);
+    free(surface);
+}
+
+// ####################################################################################################################
+// Compositor
+
+static void region_add(struct wl_client *client, struct wl_resource *resource, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+}
+
+static void region_subtract(struct wl_client *client, struct wl_resource *resource, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+}
+
+static const struct wl_region_interface region_implementation = {
+    .destroy = destroy_resource,
+    .add = region_add,
+    .subtract = region_subtract,
+};
+
+static void compositor_create_surface(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct mock_compositor *mock = wl_resource_get_user_data(resource);
+    struct mock_surface *surface = calloc(1, sizeof(struct mock_surface));
+    struct wl_resource *surface_resource = wl_resource_create(client, &wl_surface_interface, wl_resource_get_version(resource), id);
+
+    if (surface == NULL || surface_resource == NULL)
+    {
+        free(surface);
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    surface->mock = mock;
+    surface->resource = surface_resource;
+    wl_list_init(&surface->pending_frames);
+    wl_list_init(&surface->frames);
+    wl_list_init(&surface->children);
+    wl_list_init(&surface->child_link);
+    wl_list_insert(mock->surfaces.prev, &surface->link);
+    wl_resource_set_implementation(surface_resource, &surface_implementation, surface, surface_destroy);
+}
+
+static void compositor_create_region(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct wl_resource *region = wl_resource_create(client, &wl_region_interface, 1, id);
+
+    if (region == NULL)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(region, &region_implementation, NULL, NULL);
+}
+
+static const struct wl_compositor_interface compositor_implementation = {
+    .create_surface = compositor_create_surface,
+    .create_region = compositor_create_region,
+};
+
+static void compositor_bind(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+    struct wl_resource *resource = wl_resource_create(client, &wl_compositor_interface, version, id);
+
+    if (resource == NULL)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(resource, &compositor_implementation, data, NULL);
+}
+
+// ####################################################################################################################
+// Subcompositor
+
+static void subsurface_set_position(struct wl_client *client, struct wl_resource *resource, int32_t x, int32_t y)
+{
+}
+
+static void subsurface_place_above(struct wl_client *client, struct wl_resource *resource, struct wl_resource *sibling)
+{
+}
+
+static void subsurface_place_below(struct wl_client *client, struct wl_resource *resource, struct wl_resource *sibling)
+{
+}
+
+static void subsurface_set_sync(struct wl_client *client, struct wl_resource *resource)
+{
+}
+
+static void subsurface_set_desync(struct wl_client *client, struct wl_resource *resource)
+{
+}
+
+static const struct wl_subsurface_interface subsurface_implementation = {
+    .destroy = destroy_resource,
+    .set_position = subsurface_set_position,
+    .place_above = subsurface_place_above,
+    .place_below = subsurface_place_below,
+    .set_sync = subsurface_set_sync,
+    .set_desync = subsurface_set_desync,
+};
+
+static void subsurface_destroy(struct wl_resource *resource)
+{
+    struct mock_surface *surface = wl_resource_get_user_data(resource);
+
+    if (surface != NULL)
+    {
+        surface_unlink_child(surface);
+        surface->subsurface = NULL;
+    }
+}
+
+static void subcompositor_get_subsurface(struct wl_client *client, struct wl_resource *resource, uint32_t id, struct wl_resource *surface_resource,
+                                         struct wl_resource *parent_resource)
+{
+    struct mock_surface *surface = wl_resource_get_user_data(surface_resource);
+    struct mock_surface *parent = wl_resource_get_user_data(parent_resource);
+
+    if (surface->subsurface != NULL || surface == parent)
+    {
+        wl_resource_post_error(resource, WL_SUBCOMPOSITOR_ERROR_BAD_SURFACE, "surface already has a role or is its own parent");
+        return;
+    }
+
+    struct wl_resource *subsurface = wl_resource_create(client, &wl_subsurface_interface, 1, id);
+
+    if (subsurface == NULL)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(subsurface, &subsurface_implementation, surface, subsurface_destroy);
+    surface->subsurface = subsurface;
+    surface->parent = parent;
+    wl_list_insert(parent->children.prev, &surface->child_link);
+}
+
+static const struct wl_subcompositor_interface subcompositor_implementation = {
+    .destroy = destroy_resource,
+    .get_subsurface = subcompositor_get_subsurface,
+};
+
+static void subcompositor_bind(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+    struct wl_resource *resource = wl_resource_create(client, &wl_subcompositor_interface, version, id);
+
+    if (resource == NULL)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(resource, &subcompositor_implementation, data, NULL);
+}
+
+// ####################################################################################################################
+// XDG Shell
+
+static void toplevel_set_parent(struct wl_client *client, struct wl_resource *resource, struct wl_resource *parent)
+{
+}
+
+static void toplevel_set_title(struct wl_client *client, struct wl_resource *resource, const char *title)
+{
+}
+
+static void toplevel_set_app_id(struct wl_client *client, struct wl_resource *resource, const char *app_id)
+{
+}
+
+static void toplevel_show_window_menu(struct wl_client *client, struct wl_resource *resource, struct wl_resource *seat, uint32_t serial, int32_t x, int32_t y)
+{
+}
+
+static void toplevel_move(struct wl_client *client, struct wl_resource *resource, struct wl_resource *seat, uint32_t serial)
+{
+}
+
+static void toplevel_resize(struct wl_client *client, struct wl_resource *resource, struct wl_resource *seat, uint32_t serial, uint32_t edges)
+{
+}
+
+static void toplevel_set_max_size(struct wl_client *client, struct wl_resource *resource, int32_t width, int32_t height)
+{
+    struct mock_toplevel *toplevel = wl_resource_get_user_data(resource);
+    toplevel->max_width = width;
+    toplevel->max_height = height;
+}
+
+static void toplevel_set_min_size(struct wl_client *client, struct wl_resource *resource, int32_t width, int32_t height)
+{
+    struct mock_toplevel *toplevel = wl_resource_get_user_data(resource);
+    toplevel->min_width = width;
+    toplevel->min_height = height;
+}
+
+static void toplevel_set_maximized(struct wl_client *client, struct wl_resource *resource)
+{
+}
+
+static void toplevel_unset_maximized(struct wl_client *client, struct wl_resource *resource)
+{
+}
+
+static void toplevel_set_fullscreen(struct wl_client *client, struct wl_resource *resource, struct wl_resource *output)
+{
+}
+
+static void toplevel_unset_fullscreen(struct wl_client *client, struct wl_resource *resource)
+{
+}
+
+static void toplevel_set_minimized(struct wl_client *client, struct wl_resource *resource)
+{
+}
+
+static const struct xdg_toplevel_interface toplevel_implementation = {
+    .destroy = destroy_resource,
+    .set_parent = toplevel_set_parent,
+    .set_title = toplevel_set_title,
+    .set_app_id = toplevel_set_app_id,
+    .show_window_menu = toplevel_show_window_menu,
+    .move = toplevel_move,
+    .resize = toplevel_resize,
+    .set_max_size = toplevel_set_max_size,
+    .set_min_size = toplevel_set_min_size,
+    .set_maximized = toplevel_set_maximized,
+    .unset_maximized = toplevel_unset_maximized,
+    .set_fullscreen = toplevel_set_fullscreen,
+    .unset_fullscreen = toplevel_unset_fullscreen,
+    .set_minimized = toplevel_set_minimized,
+};
+
+static void toplevel_destroy(struct wl_resource *resource)
+{
+    struct mock_toplevel *toplevel = wl_resource_get_user_data(resource);
+
+    if (toplevel->surface != NULL)
+    {
+        toplevel->surface->toplevel = NULL;
+    }
+
+    wl_list_remove(&toplevel->link);
+    free(toplevel);
+}
+
+static void xdg_surface_get_toplevel(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct mock_surface *surface = wl_resource_get_user_data(resource);
+
+    if (surface == NULL || surface->toplevel != NULL)
+    {
+        wl_resource_post_error(resource, XDG_SURFACE_ERROR_ALREADY_CONSTRUCTED, "surface is gone or already has a toplevel");
+        return;
+    }
+
+    struct mock_toplevel *toplevel = calloc(1, sizeof(struct mock_toplevel));
+    struct wl_resource *toplevel_resource = wl_resource_create(client, &xdg_toplevel_interface, wl_resource_get_version(resource), id);
+
+    if (toplevel == NULL || toplevel_resource == NULL)
+    {
+        free(toplevel);
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    toplevel->mock = surface->mock;
+    toplevel->surface = surface;
+    toplevel->resource = toplevel_resource;
+    surface->toplevel = toplevel;
+    wl_list_insert(surface->mock->toplevels.prev, &toplevel->link);
+    wl_resource_set_implementation(toplevel_resource, &toplevel_implementation, toplevel, toplevel_destroy);
+}
+
+static void xdg_surface_get_popup(struct wl_client *client, struct wl_resource *resource, uint32_t id, struct wl_resource *parent,
+                                  struct wl_resource *positioner)
+{
+    wl_resource_post_error(resource, WL_DISPLAY_ERROR_IMPLEMENTATION, "popups are not supported");
+}
+
+static void xdg_surface_set_window_geometry(struct wl_client *client, struct wl_resource *resource, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+}
+
+static void xdg_surface_ack_configure(struct wl_client *client, struct wl_resource *resource, uint32_t serial)
+{
+    struct mock_surface *surface = wl_resource_get_user_data(resource);
+
+    if (surface != NULL && surface->toplevel != NULL && surface->toplevel->configure_serial == serial)
+    {
+        surface->toplevel->acked = true;
+    }
+}
+
+static const struct xdg_surface_interface xdg_surface_implementation = {
+    .destroy = destroy_resource,
+    .get_toplevel = xdg_surface_get_toplevel,
+    .get_popup = xdg_surface_get_popup,
+    .set_window_geometry = xdg_surface_set_window_geometry,
+    .ack_configure = xdg_surface_ack_configure,
+};
+
+static void xdg_surface_destroy(struct wl_resource *resource)
+{
+    struct mock_surface *surface = wl_resource_get_user_data(resource);
+
+    if (surface != NULL)
+    {
+        surface->xdg_surface = NULL;
+    }
+}
+
+static void wm_base_create_positioner(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    wl_resource_post_error(resource, WL_DISPLAY_ERROR_IMPLEMENTATION, "popups are not supported");
+}
+
+static void wm_base_get_xdg_surface(struct wl_client *client, struct wl_resource *resource, uint32_t id, struct wl_resource *surface_resource)
+{
+    struct mock_surface *surface = wl_resource_get_user_data(surface_resource);
+
+    if (surface->xdg_surface != NULL || surface->subsurface != NULL)
+    {
+        wl_resource_post_error(resource, XDG_WM_BASE_ERROR_ROLE, "surface already has a role");
+        return;
+    }
+
+    struct wl_resource *xdg_surface = wl_resource_create(client, &xdg_surface_interface, wl_resource_get_version(resource), id);
+
+    if (xdg_surface == NULL)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(xdg_surface, &xdg_surface_implementation, surface, xdg_surface_destroy);
+    surface->xdg_surface = xdg_surface;
+}
+
+static void wm_base_pong(struct wl_client *client, struct wl_resource *resource, uint32_t serial)
+{
+    struct mock_compositor *mock = wl_resource_get_user_data(resource);
+
+    if (serial == mock->ping_serial && mock->pending_pongs > 0)
+    {
+        mock->pending_pongs -= 1;
+        pthread_cond_broadcast(&mock->cond);
+    }
+}
+
+static const struct xdg_wm_base_interface wm_base_implementation = {
+    .destroy = destroy_resource,
+    .create_positioner = wm_base_create_positioner,
+    .get_xdg_surface = wm_base_get_xdg_surface,
+    .pong = wm_base_pong,
+};
+
+static void wm_base_bind(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+    struct mock_compositor *mock = data;
+    struct wl_resource *resource = wl_resource_create(client, &xdg_wm_base_interface, version, id);
+
+    if (resource == NULL)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(resource, &wm_base_implementation, mock, unlink_resource);
+    wl_list_insert(&mock->wm_bases, wl_resource_get_link(resource));
+}
+
+// ####################################################################################################################
+// Seat
+
+static const char *keymap_compile(struct mock_compositor *mock, const char *layout, int *index)
+{
+    for (int i = 0; i < mock->keymap_count; ++i)
+    {
+        const char *cached = mock->keymaps[i].layout;
+
+        if ((cached == NULL && layout == NULL) || (cached != NULL && layout != NULL && strcmp(cached, layout) == 0))
+        {
+            *index = i;
+            return mock->keymaps[i].string;
+        }
+    }
+
+    if (mock->keymap_count == MOCK_MAX_KEYMAPS || mock->xkb_context == NULL)
+    {
+        return NULL;
+    }
+
+    struct xkb_rule_names names = {.layout = layout};
+    struct xkb_keymap *keymap = xkb_keymap_new_from_names(mock->xkb_context, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+
+    if (keymap == NULL)
+    {
+        return NULL;
+    }
+
+    struct mock_keymap *entry = &mock->keymaps[mock->keymap_count];
+    entry->string = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    xkb_keymap_unref(keymap);
+
+    if (entry->string == NULL)
+    {
+        return NULL;
+    }
+
+    entry->layout = layout != NULL ? strdup(layout) : NULL;
+    entry->size = strlen(entry->string) + 1;
+    *index = mock->keymap_count;
+    mock->keymap_count += 1;
+
+    return entry->string;
+}
+
+// Every keyboard gets a file of its own, the client maps it privately.
+static void keyboard_send_keymap(struct mock_compositor *mock, struct wl_resource *keyboard)
+{
+    const struct mock_keymap *keymap = &mock->keymaps[mock->keymap];
+    int fd = memfd_create("mock-keymap", MFD_CLOEXEC);
+
+    if (fd == -1)
+    {
+        return;
+    }
+
+    if (write(fd, keymap->string, keymap->size) == (ssize_t) keymap->size)
+    {
+        wl_keyboard_send_keymap(keyboard, WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1, fd, keymap->size);
+    }
+
+    close(fd);
+}
+
+static void pointer_set_cursor(struct wl_client *client, struct wl_resource *resource, uint32_t serial, struct wl_resource *surface, int32_t hotspot_x,
+                               int32_t hotspot_y)
+{
+}
+
+static const struct wl_pointer_interface pointer_implementation = {
+    .set_cursor = pointer_set_cursor,
+    .release = destroy_resource,
+};
+
+static const struct wl_keyboard_interface keyboard_implementation = {
+    .release = destroy_resource,
+};
+
+static const struct wl_touch_interface touch_implementation = {
+    .release = destroy_resource,
+};
+
+static void seat_get_pointer(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct mock_compositor *mock = wl_resource_get_user_data(resource);
+    struct wl_resource *pointer = wl_resource_create(client, &wl_pointer_interface, wl_resource_get_version(resource), id);
+
+    if (pointer == NULL)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(pointer, &pointer_implementation, mock, unlink_resource);
+    wl_list_insert(&mock->pointers, wl_resource_get_link(pointer));
+}
+
+static void seat_get_keyboard(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct mock_compositor *mock = wl_resource_get_user_data(resource);
+    struct wl_resource *keyboard = wl_resource_create(client, &wl_keyboard_interface, wl_resource_get_version(resource), id);
+
+    if (keyboard == NULL)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(keyboard, &keyboard_implementation, mock, unlink_resource);
+    wl_list_insert(&mock->keyboards, wl_resource_get_link(keyboard));
+
+    if (mock->keymap != -1)
+    {
+        keyboard_send_keymap(mock, keyboard);
+    }
+
+    if (wl_resource_get_version(keyboard) >= WL_KEYBOARD_REPEAT_INFO_SINCE_VERSION)
+    {
+        wl_keyboard_send_repeat_info(keyboard, 25, 600);
+    }
+}
+
+static void seat_get_touch(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct mock_compositor *mock = wl_resource_get_user_data(resource);
+    struct wl_resource *touch = wl_resource_create(client, &wl_touch_interface, wl_resource_get_version(resource), id);
+
+    if (touch == NULL)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(touch, &touch_implementation, mock, unlink_resource);
+    wl_list_insert(&mock->touches, wl_resource_get_link(touch));
+}
+
+static const struct wl_seat_interface seat_implementation = {
+    .get_pointer = seat_get_pointer,
+    .get_keyboard = seat_get_keyboard,
+    .get_touch = seat_get_touch,
+    .release = destroy_resource,
+};
+
+static void seat_bind(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+    struct mock_compositor *mock = data;
+    struct wl_resource *resource = wl_resource_create(client, &wl_seat_interface, version, id);
+
+    if (resource == NULL)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(resource, &seat_implementation, mock, NULL);
+
+    uint32_t capabilities = WL_SEAT_CAPABILITY_POINTER | WL_SEAT_CAPABILITY_TOUCH;
+
+    if (mock->keymap != -1)
+    {
+        capabilities |= WL_SEAT_CAPABILITY_KEYBOARD;
+    }
+
+    wl_seat_send_capabilities(resource, capabilities);
+
+    if (version >= WL_SEAT_NAME_SINCE_VERSION)
+    {
+        wl_seat_send_name(resource, "mock");
+    }
+}
+
+// ####################################################################################################################
+// Input
+
+static bool surface_alive(struct mock_compositor *mock, struct mock_surface *surface)
+{
+    struct mock_surface *candidate;
+
+    wl_list_for_each(candidate, &mock->surfaces, link)
+    {
+        if (candidate == surface)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Iterates over the devices in `list` that belong to the client of `surface`.
+#define for_each_device(device, list, surface)                                                                                                       \
+    wl_resource_for_each(device, list) if (wl_resource_get_client(device) == wl_resource_get_client((surface)->resource))
+
+static void pointer_send_frame(struct mock_compositor *mock)
+{
+    struct wl_resource *pointer;
+
+    for_each_device(pointer, &mock->pointers, mock->pointer_focus)
+    {
+        if (wl_resource_get_version(pointer) >= WL_POINTER_FRAME_SINCE_VERSION)
+        {
+            wl_pointer_send_frame(pointer);
+        }
+    }
+}
+
+static void pointer_send_leave(struct mock_compositor *mock)
+{
+    struct wl_resource *pointer;
+
+    if (mock->pointer_focus == NULL)
+    {
+        return;
+    }
+
+    uint32_t serial = wl_display_next_serial(mock->display);
+
+    for_each_device(pointer, &mock->pointers, mock->pointer_focus)
+    {
+        wl_pointer_send_leave(pointer, serial, mock->pointer_focus->resource);
+    }
+
+    pointer_send_frame(mock);
+    mock->pointer_focus = NULL;
+}
+
+void mock_pointer_enter(struct mock_compositor *mock, struct mock_surface *surface, double x_position, double y_position)
+{
+    struct wl_resource *pointer;
+    pthread_mutex_lock(&mock->mutex);
+
+    if (surface_alive(mock, surface))
+    {
+        pointer_send_leave(mock);
+        mock->pointer_focus = surface;
+        uint32_t serial = wl_display_next_serial(mock->display);
+
+        for_each_device(pointer, &mock->pointers, surface)
+        {
+            wl_pointer_send_enter(pointer, serial, surface->resource, wl_fixed_from_double(x_position), wl_fixed_from_double(y_position));
+        }
+
+        pointer_send_frame(mock);
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+}
+
+void mock_pointer_leave(struct mock_compositor *mock)
+{
+    pthread_mutex_lock(&mock->mutex);
+    pointer_send_leave(mock);
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+}
+
+void mock_pointer_motion(struct mock_compositor *mock, double x_position, double y_position)
+{
+    struct wl_resource *pointer;
+    pthread_mutex_lock(&mock->mutex);
+
+    if (mock->pointer_focus != NULL)
+    {
+        uint32_t time = get_time_ms();
+
+        for_each_device(pointer, &mock->pointers, mock->pointer_focus)
+        {
+            wl_pointer_send_motion(pointer, time, wl_fixed_from_double(x_position), wl_fixed_from_double(y_position));
+        }
+
+        pointer_send_frame(mock);
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+}
+
+void mock_pointer_button(struct mock_compositor *mock, uint32_t button, bool pressed)
+{
+    struct wl_resource *pointer;
+    pthread_mutex_lock(&mock->mutex);
+
+    if (mock->pointer_focus != NULL)
+    {
+        uint32_t serial = wl_display_next_serial(mock->display);
+        uint32_t time = get_time_ms();
+        uint32_t state = pressed ? WL_POINTER_BUTTON_STATE_PRESSED : WL_POINTER_BUTTON_STATE_RELEASED;
+
+        for_each_device(pointer, &mock->pointers, mock->pointer_focus)
+        {
+            wl_pointer_send_button(pointer, serial, time, button, state);
+        }
+
+        pointer_send_frame(mock);
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+}
+
+void mock_pointer_axis(struct mock_compositor *mock, uint32_t axis, double value, int32_t discrete)
+{
+    struct wl_resource *pointer;
+    pthread_mutex_lock(&mock->mutex);
+
+    if (mock->pointer_focus != NULL)
+    {
+        uint32_t time = get_time_ms();
+
+        for_each_device(pointer, &mock->pointers, mock->pointer_focus)
+        {
+            if (wl_resource_get_version(pointer) >= WL_POINTER_AXIS_SOURCE_SINCE_VERSION)
+            {
+                wl_pointer_send_axis_source(pointer, discrete != 0 ? WL_POINTER_AXIS_SOURCE_WHEEL : WL_POINTER_AXIS_SOURCE_FINGER);
+
+                if (discrete != 0)
+                {
+                    wl_pointer_send_axis_discrete(pointer, axis, discrete);
+                }
+                else if (value == 0)
+                {
+                    wl_pointer_send_axis_stop(pointer, time, axis);
+                    continue;
+                }
+            }
+
+            wl_pointer_send_axis(pointer, time, axis, wl_fixed_from_double(value));
+        }
+
+        pointer_send_frame(mock);
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+}
+
+static void keyboard_send_leave(struct mock_compositor *mock)
+{
+    struct wl_resource *keyboard;
+
+    if (mock->keyboard_focus == NULL)
+    {
+        return;
+    }
+
+    uint32_t serial = wl_display_next_serial(mock->display);
+
+    for_each_device(keyboard, &mock->keyboards, mock->keyboard_focus)
+    {
+        wl_keyboard_send_leave(keyboard, serial, mock->keyboard_focus->resource);
+    }
+
+    mock->keyboard_focus = NULL;
+}
+
+void mock_keyboard_enter(struct mock_compositor *mock, struct mock_surface *surface)
+{
+    struct wl_resource *keyboard;
+    pthread_mutex_lock(&mock->mutex);
+
+    if (surface_alive(mock, surface))
+    {
+        keyboard_send_leave(mock);
+        mock->keyboard_focus = surface;
+        uint32_t serial = wl_display_next_serial(mock->display);
+        struct wl_array keys;
+        wl_array_init(&keys);
+
+        for_each_device(keyboard, &mock->keyboards, surface)
+        {
+            wl_keyboard_send_enter(keyboard, serial, surface->resource, &keys);
+            wl_keyboard_send_modifiers(keyboard, serial, 0, 0, 0, 0);
+        }
+
+        wl_array_release(&keys);
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+}
+
+void mock_keyboard_leave(struct mock_compositor *mock)
+{
+    pthread_mutex_lock(&mock->mutex);
+    keyboard_send_leave(mock);
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+}
+
+void mock_keyboard_key(struct mock_compositor *mock, uint32_t key, bool pressed)
+{
+    struct wl_resource *keyboard;
+    pthread_mutex_lock(&mock->mutex);
+
+    if (mock->keyboard_focus != NULL)
+    {
+        uint32_t serial = wl_display_next_serial(mock->display);
+        uint32_t time = get_time_ms();
+        uint32_t state = pressed ? WL_KEYBOARD_KEY_STATE_PRESSED : WL_KEYBOARD_KEY_STATE_RELEASED;
+
+        for_each_device(keyboard, &mock->keyboards, mock->keyboard_focus)
+        {
+            wl_keyboard_send_key(keyboard, serial, time, key, state);
+        }
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+}
+
+bool mock_keyboard_keymap(struct mock_compositor *mock, const char *layout)
+{
+    struct wl_resource *keyboard;
+    int index;
+    pthread_mutex_lock(&mock->mutex);
+    bool compiled = keymap_compile(mock, layout, &index) != NULL;
+
+    // Keyboards only exist if there was a keymap from the start.
+    if (compiled && mock->keymap != -1)
+    {
+        mock->keymap = index;
+
+        wl_resource_for_each(keyboard, &mock->keyboards)
+        {
+            keyboard_send_keymap(mock, keyboard);
+        }
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+
+    return compiled;
+}
+
+void mock_touch_down(struct mock_compositor *mock, struct mock_surface *surface, int32_t id, double x_position, double y_position)
+{
+    struct wl_resource *touch;
+    pthread_mutex_lock(&mock->mutex);
+
+    if (surface_alive(mock, surface))
+    {
+        mock->touch_focus = surface;
+        uint32_t serial = wl_display_next_serial(mock->display);
+        uint32_t time = get_time_ms();
+
+        for_each_device(touch, &mock->touches, surface)
+        {
+            wl_touch_send_down(touch, serial, time, surface->resource, id, wl_fixed_from_double(x_position), wl_fixed_from_double(y_position));
+            wl_touch_send_frame(touch);
+        }
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+}
+
+void mock_touch_motion(struct mock_compositor *mock, int32_t id, double x_position, double y_position)
+{
+    struct wl_resource *touch;
+    pthread_mutex_lock(&mock->mutex);
+
+    if (mock->touch_focus != NULL)
+    {
+        uint32_t time = get_time_ms();
+
+        for_each_device(touch, &mock->touches, mock->touch_focus)
+        {
+            wl_touch_send_motion(touch, time, id, wl_fixed_from_double(x_position), wl_fixed_from_double(y_position));
+            wl_touch_send_frame(touch);
+        }
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+}
+
+void mock_touch_up(struct mock_compositor *mock, int32_t id)
+{
+    struct wl_resource *touch;
+    pthread_mutex_lock(&mock->mutex);
+
+    if (mock->touch_focus != NULL)
+    {
+        uint32_t serial = wl_display_next_serial(mock->display);
+        uint32_t time = get_time_ms();
+
+        for_each_device(touch, &mock->touches, mock->touch_focus)
+        {
+            wl_touch_send_up(touch, serial, time, id);
+            wl_touch_send_frame(touch);
+        }
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+}
+
+// ####################################################################################################################
+// Toplevels
+
+static bool toplevel_alive(struct mock_compositor *mock, struct mock_toplevel *toplevel)
+{
+    struct mock_toplevel *candidate;
+
+    wl_list_for_each(candidate, &mock->toplevels, link)
+    {
+        if (candidate == toplevel)
+        {
+            return toplevel->surface != NULL && toplevel->surface->xdg_surface != NULL;
+        }
+    }
+
+    return false;
+}
+
+struct mock_toplevel *mock_compositor_get_toplevel(struct mock_compositor *mock, size_t index)
+{
+    struct mock_toplevel *toplevel;
+    struct mock_toplevel *result = NULL;
+    pthread_mutex_lock(&mock->mutex);
+
+    wl_list_for_each(toplevel, &mock->toplevels, link)
+    {
+        if (toplevel->mapped && index-- == 0)
+        {
+            result = toplevel;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+
+    return result;
+}
+
+struct mock_surface *mock_toplevel_get_surface(struct mock_toplevel *toplevel)
+{
+    struct mock_compositor *mock = toplevel->mock;
+    pthread_mutex_lock(&mock->mutex);
+    struct mock_surface *surface = toplevel_alive(mock, toplevel) ? toplevel->surface : NULL;
+    pthread_mutex_unlock(&mock->mutex);
+
+    return surface;
+}
+
+struct mock_surface *mock_surface_get_subsurface(struct mock_surface *surface, size_t index)
+{
+    struct mock_compositor *mock = surface->mock;
+    struct mock_surface *child;
+    struct mock_surface *result = NULL;
+    pthread_mutex_lock(&mock->mutex);
+
+    if (surface_alive(mock, surface))
+    {
+        wl_list_for_each(child, &surface->children, child_link)
+        {
+            if (index-- == 0)
+            {
+                result = child;
+                break;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+
+    return result;
+}
+
+void mock_surface_get_buffer_size(struct mock_surface *surface, int32_t *width, int32_t *height)
+{
+    struct mock_compositor *mock = surface->mock;
+    pthread_mutex_lock(&mock->mutex);
+    bool alive = surface_alive(mock, surface);
+    *width = alive ? surface->buffer_width : 0;
+    *height = alive ? surface->buffer_height : 0;
+    pthread_mutex_unlock(&mock->mutex);
+}
+
+void mock_toplevel_configure(struct mock_toplevel *toplevel, int32_t width, int32_t height)
+{
+    struct mock_compositor *mock = toplevel->mock;
+    pthread_mutex_lock(&mock->mutex);
+
+    if (toplevel_alive(mock, toplevel))
+    {
+        toplevel_send_configure(toplevel, width, height);
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+}
+
+void mock_toplevel_close(struct mock_toplevel *toplevel)
+{
+    struct mock_compositor *mock = toplevel->mock;
+    pthread_mutex_lock(&mock->mutex);
+
+    if (toplevel_alive(mock, toplevel))
+    {
+        xdg_toplevel_send_close(toplevel->resource);
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+}
+
+bool mock_compositor_wait_toplevels(struct mock_compositor *mock, size_t count, int timeout_ms)
+{
+    struct timespec deadline = get_deadline(timeout_ms);
+    bool done = false;
+    pthread_mutex_lock(&mock->mutex);
+
+    while (true)
+    {
+        size_t mapped = 0;
+        struct mock_toplevel *toplevel;
+
+        wl_list_for_each(toplevel, &mock->toplevels, link)
+        {
+            mapped += toplevel->mapped;
+        }
+
+        if (mapped >= count)
+        {
+            done = true;
+            break;
+        }
+
+        if (!wait_until(mock, &deadline))
+        {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+
+    return done;
+}
+
+size_t mock_compositor_wait_configured(struct mock_compositor *mock, int timeout_ms)
+{
+    struct timespec deadline = get_deadline(timeout_ms);
+    size_t pending;
+    pthread_mutex_lock(&mock->mutex);
+
+    while (true)
+    {
+        struct mock_toplevel *toplevel;
+        pending = 0;
+
+        wl_list_for_each(toplevel, &mock->toplevels, link)
+        {
+            pending += toplevel->mapped && !toplevel->answered;
+        }
+
+        if (pending == 0 || !wait_until(mock, &deadline))
+        {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+
+    return pending;
+}
+
+bool mock_compositor_sync(struct mock_compositor *mock, int timeout_ms)
+{
+    struct timespec deadline = get_deadline(timeout_ms);
+    struct wl_resource *wm_base;
+    pthread_mutex_lock(&mock->mutex);
+
+    mock->ping_serial = wl_display_next_serial(mock->display);
+    mock->pending_pongs = 0;
+
+    wl_resource_for_each(wm_base, &mock->wm_bases)
+    {
+        xdg_wm_base_send_ping(wm_base, mock->ping_serial);
+        mock->pending_pongs += 1;
+    }
+
+    wake(mock);
+
+    while (mock->pending_pongs > 0 && wait_until(mock, &deadline))
+    {
+    }
+
+    bool done = mock->pending_pongs == 0;
+    pthread_mutex_unlock(&mock->mutex);
+
+    return done;
+}
+
+// ####################################################################################################################
+// Lifetime
+
+static void *compositor_thread(void *data)
+{
+    struct mock_compositor *mock = data;
+    struct pollfd fds[2] = {
+        {.fd = wl_event_loop_get_fd(mock->loop), .events = POLLIN},
+        {.fd = mock->wake_fd, .events = POLLIN},
+    };
+
+    pthread_mutex_lock(&mock->mutex);
+
+    while (mock->running)
+    {
+        wl_display_flush_clients(mock->display);
+        pthread_mutex_unlock(&mock->mutex);
+        poll(fds, 2, -1);
+        pthread_mutex_lock(&mock->mutex);
+
+        if (fds[1].revents & POLLIN)
+        {
+            uint64_t value;
+            read(mock->wake_fd, &value, sizeof(value));
+        }
+
+        wl_event_loop_dispatch(mock->loop, 0);
+    }
+
+    pthread_mutex_unlock(&mock->mutex);
+
+    return NULL;
+}
+
+// Everything but the thread, which must not be running.
+static void mock_compositor_free(struct mock_compositor *mock)
+{
+    wl_display_destroy_clients(mock->display);
+    wl_display_destroy(mock->display);
+
+    for (int i = 0; i < mock->keymap_count; ++i)
+    {
+        free(mock->keymaps[i].layout);
+        free(mock->keymaps[i].string);
+    }
+
+    if (mock->xkb_context != NULL)
+    {
+        xkb_context_unref(mock->xkb_context);
+    }
+
+    close(mock->wake_fd);
+    pthread_cond_destroy(&mock->cond);
+    pthread_mutex_destroy(&mock->mutex);
+    free(mock);
+}
+
+struct mock_compositor *mock_compositor_create(const struct mock_compositor_options *options)
+{
+    struct mock_compositor *mock = calloc(1, sizeof(struct mock_compositor));
+
+    if (mock == NULL)
+    {
+        return NULL;
+    }
+
+    mock->options = *options;
+    mock->keymap = -1;
+    wl_list_init(&mock->surfaces);
+    wl_list_init(&mock->toplevels);
+    wl_list_init(&mock->wm_bases);
+    wl_list_init(&mock->pointers);
+    wl_list_init(&mock->keyboards);
+    wl_list_init(&mock->touches);
+
+    mock->display = wl_display_create();
+    mock->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (mock->display == NULL || mock->wake_fd == -1)
+    {
+        if (mock->display != NULL)
+        {
+            wl_display_destroy(mock->display);
+        }
+
+        if (mock->wake_fd != -1)
+        {
+            close(mock->wake_fd);
+        }
+
+        free(mock);
+        return NULL;
+    }
+
+    mock->loop = wl_display_get_event_loop(mock->display);
+    wl_display_init_shm(mock->display);
+    wl_display_add_protocol_logger(mock->display, protocol_logger, mock);
+    wl_global_create(mock->display, &wl_compositor_interface, 5, mock, compositor_bind);
+    wl_global_create(mock->display, &wl_subcompositor_interface, 1, mock, subcompositor_bind);
+    wl_global_create(mock->display, &xdg_wm_base_interface, 4, mock, wm_base_bind);
+    wl_global_create(mock->display, &wl_seat_interface, 5, mock, seat_bind);
+
+    if (options->frame_interval_ms > 0)
+    {
+        mock->frame_timer = wl_event_loop_add_timer(mock->loop, frame_timer_fire, mock);
+    }
+
+    // Without xkeyboard-config there is no keymap, and the seat has no keyboard then.
+    int index;
+    mock->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+
+    if (keymap_compile(mock, options->layout, &index) != NULL)
+    {
+        mock->keymap = index;
+    }
+
+    pthread_condattr_t condattr;
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mock->cond, &condattr);
+    pthread_condattr_destroy(&condattr);
+    pthread_mutex_init(&mock->mutex, NULL);
+
+    mock->running = true;
+
+    if (pthread_create(&mock->thread, NULL, compositor_thread, mock) != 0)
+    {
+        mock_compositor_free(mock);
+        return NULL;
+    }
+
+    return mock;
+}
+
+int mock_compositor_connect(struct mock_compositor *mock)
+{
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&mock->mutex);
+    struct wl_client *client = wl_client_create(mock->display, fds[0]);
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+
+    if (client == NULL)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    return fds[1];
+}
+
+const char *mock_compositor_add_socket(struct mock_compositor *mock)
+{
+    pthread_mutex_lock(&mock->mutex);
+    const char *name = wl_display_add_socket_auto(mock->display);
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+
+    return name;
+}
+
+void mock_compositor_destroy(struct mock_compositor *mock)
+{
+    pthread_mutex_lock(&mock->mutex);
+    mock->running = false;
+    pthread_mutex_unlock(&mock->mutex);
+    wake(mock);
+    pthread_join(mock->thread, NULL);
+    mock_compositor_free(mock);
+}
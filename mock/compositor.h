@@ -0,0 +1,111 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stats.h"
+
+// Headless compositor for tests and benchmarks. It runs on its own thread inside the process under test and implements
+// wl_compositor, wl_subcompositor, wl_shm, xdg_wm_base and wl_seat, enough to map windows with decor and feed them input.
+// Nothing is drawn: buffers are released right after the commit that attached them.
+//
+// The calls below may be made from any thread. Surfaces and toplevels handed out stay valid until the client destroys
+// them; calls with objects that are gone are ignored.
+
+struct mock_compositor;
+struct mock_surface;
+struct mock_toplevel;
+
+struct mock_compositor_options
+{
+    // Frame callbacks are completed at this interval, the timer only runs while any are pending. Zero completes them
+    // right after the commit.
+    uint32_t frame_interval_ms;
+    // Size of the first configure. Zero lets the client choose.
+    int32_t width;
+    int32_t height;
+    // Configures toplevels to their size when the minimum and maximum size hints are equal, like floating window
+    // managers do.
+    bool follow_size_hints;
+    // Layout of the keymap sent to keyboards, NULL for the default of the system's xkeyboard-config. Without a keymap
+    // the seat has no keyboard.
+    const char *layout;
+};
+
+// Recorded requests and the effects of the scripted events.
+struct mock_compositor_stats
+{
+    uint64_t requests;
+    uint64_t events;
+    uint64_t commits;
+    uint64_t attached_buffers;
+    uint64_t configures;
+    uint64_t frame_callbacks;
+    // From sending a configure to the commit that follows its ack.
+    struct latency_histogram configure_to_commit;
+};
+
+struct mock_compositor *mock_compositor_create(const struct mock_compositor_options *options);
+
+// Disconnects all clients and stops the thread.
+void mock_compositor_destroy(struct mock_compositor *mock);
+
+// Returns the client end of a new connection, for `wl_display_connect_to_fd` or `WAYLAND_SOCKET`. -1 on failure.
+int mock_compositor_connect(struct mock_compositor *mock);
+
+// Listens on a socket in `XDG_RUNTIME_DIR` and returns its name, NULL on failure.
+const char *mock_compositor_add_socket(struct mock_compositor *mock);
+
+// Blocks until every client handled all events sent before, by pinging through xdg_wm_base. Returns false on timeout.
+bool mock_compositor_sync(struct mock_compositor *mock, int timeout_ms);
+
+// Blocks until at least `count` toplevels committed a buffer. Returns false on timeout.
+bool mock_compositor_wait_toplevels(struct mock_compositor *mock, size_t count, int timeout_ms);
+
+// Blocks until every mapped toplevel committed after acking its last configure. Returns how many did not in time.
+size_t mock_compositor_wait_configured(struct mock_compositor *mock, int timeout_ms);
+
+void mock_compositor_get_stats(struct mock_compositor *mock, struct mock_compositor_stats *stats);
+
+// Starts recording from scratch, so that a phase is measured on its own.
+void mock_compositor_reset_stats(struct mock_compositor *mock);
+
+void mock_compositor_print_stats(struct mock_compositor *mock);
+
+// Prints how often each request was received, in the order they were first seen.
+void mock_compositor_print_requests(struct mock_compositor *mock);
+
+// Mapped toplevels in the order they were created. NULL if there are fewer.
+struct mock_toplevel *mock_compositor_get_toplevel(struct mock_compositor *mock, size_t index);
+
+struct mock_surface *mock_toplevel_get_surface(struct mock_toplevel *toplevel);
+
+// Subsurfaces of the surface in the order they were created. NULL if there are fewer.
+struct mock_surface *mock_surface_get_subsurface(struct mock_surface *surface, size_t index);
+
+// Size of the last buffer committed to the surface, in buffer pixels.
+void mock_surface_get_buffer_size(struct mock_surface *surface, int32_t *width, int32_t *height);
+
+void mock_toplevel_configure(struct mock_toplevel *toplevel, int32_t width, int32_t height);
+
+void mock_toplevel_close(struct mock_toplevel *toplevel);
+
+// Input. Positions are surface local. Each call ends with a frame event where the protocol has one, and timestamps
+// are taken from CLOCK_MONOTONIC like in real compositors.
+void mock_pointer_enter(struct mock_compositor *mock, struct mock_surface *surface, double x_position, double y_position);
+void mock_pointer_leave(struct mock_compositor *mock);
+void mock_pointer_motion(struct mock_compositor *mock, double x_position, double y_position);
+void mock_pointer_button(struct mock_compositor *mock, uint32_t button, bool pressed);
+// A wheel notch with `discrete` steps if non-zero, finger scrolling otherwise. Zero finger scrolling ends the gesture.
+void mock_pointer_axis(struct mock_compositor *mock, uint32_t axis, double value, int32_t discrete);
+
+void mock_keyboard_enter(struct mock_compositor *mock, struct mock_surface *surface);
+void mock_keyboard_leave(struct mock_compositor *mock);
+// `key` is an evdev code.
+void mock_keyboard_key(struct mock_compositor *mock, uint32_t key, bool pressed);
+// Compiles the keymap of `layout` and sends it to all keyboards. Keymaps are compiled once per layout.
+bool mock_keyboard_keymap(struct mock_compositor *mock, const char *layout);
+
+void mock_touch_down(struct mock_compositor *mock, struct mock_surface *surface, int32_t id, double x_position, double y_position);
+void mock_touch_motion(struct mock_compositor *mock, int32_t id, double x_position, double y_position);
+void mock_touch_up(struct mock_compositor *mock, int32_t id);
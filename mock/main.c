@@ -0,0 +1,68 @@
+// Runs the mock compositor on its own, listening on a socket in `XDG_RUNTIME_DIR`. Clients are started against it with
+// `WAYLAND_DISPLAY` set to the printed name. Prints the recorded requests when interrupted.
+
+#include "compositor.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char **argv)
+{
+    struct mock_compositor_options options = {
+        .frame_interval_ms = 16,
+        .follow_size_hints = true,
+    };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--frame-interval") == 0 && i + 1 < argc)
+        {
+            options.frame_interval_ms = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--layout") == 0 && i + 1 < argc)
+        {
+            options.layout = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--frame-interval ms] [--layout layout]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Blocked before the compositor thread starts, so that it inherits the mask and only `sigwait` sees the signals.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    struct mock_compositor *mock = mock_compositor_create(&options);
+
+    if (mock == NULL)
+    {
+        fprintf(stderr, "error (mock): Failed to create the compositor.\n");
+        return 1;
+    }
+
+    const char *name = mock_compositor_add_socket(mock);
+
+    if (name == NULL)
+    {
+        fprintf(stderr, "error (mock): Failed to add a socket.\n");
+        mock_compositor_destroy(mock);
+        return 1;
+    }
+
+    printf("info (mock): Listening on %s.\n", name);
+    fflush(stdout);
+
+    int signal;
+    sigwait(&signals, &signal);
+
+    mock_compositor_print_stats(mock);
+    mock_compositor_print_requests(mock);
+    mock_compositor_destroy(mock);
+}
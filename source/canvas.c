@@ -0,0 +1,85 @@
+#include "canvas.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int64_t floor_divide(int64_t value, int64_t divisor)
+{
+    int64_t quotient = value / divisor;
+    return quotient * divisor > value ? quotient - 1 : quotient;
+}
+
+void canvas_draw(uint32_t *pixels, int32_t stride, int32_t x, int32_t y, int32_t width, int32_t height, int64_t x_position, int64_t y_position, int32_t tile_size)
+{
+    if (width <= 0)
+    {
+        return;
+    }
+
+    // Flooring keeps the tiles aligned across zero.
+    int64_t first_tile_x = floor_divide(x_position + x, tile_size);
+    int32_t first_inner_x = x_position + x - first_tile_x * tile_size;
+
+    for (int32_t row = y; row < y + height; ++row)
+    {
+        uint32_t *line = pixels + (size_t) row * stride;
+        int64_t tile_y = floor_divide(y_position + row, tile_size);
+        bool grid_row = y_position + row == tile_y * tile_size;
+        int64_t tile_x = first_tile_x;
+        int32_t inner_x = first_inner_x;
+
+        for (int32_t column = x; column < x + width; ++column)
+        {
+            if (grid_row || inner_x == 0)
+            {
+                line[column] = 0xff505050;
+            }
+            else
+            {
+                line[column] = ((tile_x + tile_y) & 1) ? 0xff444444 : 0xff3c3c3c;
+            }
+
+            if (++inner_x == tile_size)
+            {
+                inner_x = 0;
+                tile_x += 1;
+            }
+        }
+    }
+}
+
+uint64_t canvas_scroll(uint32_t *destination, const uint32_t *source, int32_t width, int32_t height, int64_t source_x_position, int64_t source_y_position, int64_t x_position, int64_t y_position, int32_t tile_size)
+{
+    int64_t x_delta = x_position - source_x_position;
+    int64_t y_delta = y_position - source_y_position;
+
+    if (llabs(x_delta) >= width || llabs(y_delta) >= height)
+    {
+        canvas_draw(destination, width, 0, 0, width, height, x_position, y_position, tile_size);
+        return (uint64_t) width * height;
+    }
+
+    int32_t dx = x_delta;
+    int32_t dy = y_delta;
+
+    // Rows and columns of the destination whose pixels exist in the source.
+    int32_t first_row = dy < 0 ? -dy : 0;
+    int32_t last_row = dy > 0 ? height - dy : height;
+    int32_t first_column = dx < 0 ? -dx : 0;
+    int32_t columns = width - abs(dx);
+
+    // When shifting in place, rows must be copied in the direction that does not overwrite unread ones.
+    for (int32_t i = 0; i < last_row - first_row; ++i)
+    {
+        int32_t row = dy > 0 ? first_row + i : last_row - 1 - i;
+        memmove(destination + (size_t) row * width + first_column, source + (size_t) (row + dy) * width + first_column + dx, (size_t) columns * 4);
+    }
+
+    // Horizontal strip exposed at the top or bottom, then the vertical strip beside the shifted rows.
+    canvas_draw(destination, width, 0, 0, width, first_row, x_position, y_position, tile_size);
+    canvas_draw(destination, width, 0, last_row, width, height - last_row, x_position, y_position, tile_size);
+    canvas_draw(destination, width, dx < 0 ? 0 : columns, first_row, abs(dx), last_row - first_row, x_position, y_position, tile_size);
+
+    return (uint64_t) width * (height - (last_row - first_row)) + (uint64_t) abs(dx) * (last_row - first_row);
+}
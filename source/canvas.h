@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+
+// An endless procedural canvas that the content area scrolls over. Positions are in buffer pixels, so the tiles are
+// `tile_size` pixels wide to keep their logical size at any buffer scale.
+
+// Logical size of a tile.
+#define CANVAS_TILE_SIZE 64
+
+// Paints the rectangle at (`x`, `y`) of a `stride` pixels wide buffer whose top left pixel shows the canvas at
+// (`x_position`, `y_position`).
+void canvas_draw(uint32_t *pixels, int32_t stride, int32_t x, int32_t y, int32_t width, int32_t height, int64_t x_position, int64_t y_position, int32_t tile_size);
+
+// Derives a frame at (`x_position`, `y_position`) from `source`, a frame of the same size at
+// (`source_x_position`, `source_y_position`). Pixels still visible are shifted and only the newly exposed strips are
+// painted. `source` may equal `destination`. Returns the number of painted pixels.
+uint64_t canvas_scroll(uint32_t *destination, const uint32_t *source, int32_t width, int32_t height, int64_t source_x_position, int64_t source_y_position, int64_t x_position, int64_t y_position, int32_t tile_size);
@@ -0,0 +1,626 @@
+#include "compose_cache.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <xkbcommon/xkbcommon-compose.h>
+
+// Bumped whenever the file layout or the node struct changes.
+#define COMPOSE_CACHE_VERSION 1
+
+// The nodes follow the header directly, the string pool follows the nodes. Everything is used in place once mapped.
+struct compose_cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;
+    uint64_t hash;
+    uint32_t node_count;
+    uint32_t strings_size;
+};
+
+static const char compose_cache_magic[8] = "wwcompos";
+
+const char *compose_locale(void)
+{
+    const char *names[] = {"LC_ALL", "LC_CTYPE", "LANG"};
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+        const char *locale = getenv(names[i]);
+
+        if (locale != NULL && locale[0] != '\0')
+        {
+            return locale;
+        }
+    }
+
+    return "C";
+}
+
+// Finds the system Compose file registered for `locale` in `compose.dir`. Aliases are not resolved, so the lookup fails
+// for locales that are only known by another name. Only the directory file is part of the key then.
+static bool compose_system_path(char *buffer, size_t size, const char *locale_dir, const char *locale)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/compose.dir", locale_dir);
+
+    FILE *file = fopen(path, "re");
+
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    char line[512];
+    bool found = false;
+
+    while (!found && fgets(line, sizeof(line), file) != NULL)
+    {
+        char name[256];
+        char line_locale[256];
+
+        // Lines map a Compose file relative to the directory to a locale, like `en_US.UTF-8/Compose: en_US.UTF-8`.
+        if (line[0] != '#' && sscanf(line, "%255[^:]: %255s", name, line_locale) == 2 && strcmp(line_locale, locale) == 0)
+        {
+            snprintf(buffer, size, "%s/%s", locale_dir, name);
+            found = true;
+        }
+    }
+
+    fclose(file);
+
+    return found;
+}
+
+static void compose_key_append_file(char *key, size_t size, const char *path)
+{
+    struct stat info;
+    size_t length = strlen(key);
+
+    // Missing files are part of the key too, so creating one invalidates the cache.
+    if (stat(path, &info) == -1)
+    {
+        snprintf(key + length, size - length, "%s -\n", path);
+        return;
+    }
+
+    snprintf(key + length, size - length, "%s %lld.%09ld %lld\n", path, (long long) info.st_mtim.tv_sec, info.st_mtim.tv_nsec,
+             (long long) info.st_size);
+}
+
+// Hashes the locale together with the modification time of every file xkb may read the sequences from, in the order
+// `xkb_compose_table_new_from_locale` looks for them.
+static uint64_t compose_cache_key(const char *locale)
+{
+    char key[4 * PATH_MAX];
+    char path[PATH_MAX];
+    snprintf(key, sizeof(key), "%s\n", locale);
+
+    const char *compose_file = getenv("XCOMPOSEFILE");
+    const char *config_home = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+
+    if (compose_file != NULL)
+    {
+        compose_key_append_file(key, sizeof(key), compose_file);
+    }
+
+    if (config_home != NULL && config_home[0] == '/')
+    {
+        snprintf(path, sizeof(path), "%s/XCompose", config_home);
+        compose_key_append_file(key, sizeof(key), path);
+    }
+    else if (home != NULL)
+    {
+        snprintf(path, sizeof(path), "%s/.config/XCompose", home);
+        compose_key_append_file(key, sizeof(key), path);
+    }
+
+    if (home != NULL)
+    {
+        snprintf(path, sizeof(path), "%s/.XCompose", home);
+        compose_key_append_file(key, sizeof(key), path);
+    }
+
+    const char *locale_dir = getenv("XLOCALEDIR");
+
+    if (locale_dir == NULL)
+    {
+        locale_dir = "/usr/share/X11/locale";
+    }
+
+    snprintf(path, sizeof(path), "%s/compose.dir", locale_dir);
+    compose_key_append_file(key, sizeof(key), path);
+
+    if (compose_system_path(path, sizeof(path), locale_dir, locale))
+    {
+        compose_key_append_file(key, sizeof(key), path);
+    }
+
+    return hash_fnv1a(key, strlen(key));
+}
+
+static int compose_cache_path(char *buffer, size_t size, uint64_t hash)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "compose-%016" PRIx64 ".bin", hash);
+    return get_cache_path(buffer, size, name);
+}
+
+// Points the table at a buffer in the cache file layout. Everything is checked, so a damaged file can never make the
+// trie walk leave the buffer.
+static bool compose_table_init(struct compose_table *table, void *data, size_t size, uint64_t hash)
+{
+    const struct compose_cache_header *header = data;
+
+    if (size < sizeof(struct compose_cache_header) || memcmp(header->magic, compose_cache_magic, sizeof(header->magic)) != 0 ||
+        header->version != COMPOSE_CACHE_VERSION || header->node_size != sizeof(struct compose_node) || header->hash != hash ||
+        header->node_count == 0 || header->strings_size == 0 ||
+        size != sizeof(struct compose_cache_header) + (size_t) header->node_count * sizeof(struct compose_node) + header->strings_size)
+    {
+        return false;
+    }
+
+    const struct compose_node *nodes = (const struct compose_node *) (header + 1);
+    const char *strings = (const char *) (nodes + header->node_count);
+
+    if (strings[header->strings_size - 1] != '\0')
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header->node_count; ++i)
+    {
+        if (nodes[i].first_child > header->node_count || nodes[i].child_count > header->node_count - nodes[i].first_child ||
+            nodes[i].utf8_offset >= header->strings_size)
+        {
+            return false;
+        }
+    }
+
+    table->nodes = nodes;
+    table->node_count = header->node_count;
+    table->strings = strings;
+    table->strings_size = header->strings_size;
+    table->data = data;
+    table->size = size;
+
+    return true;
+}
+
+static bool compose_cache_load(struct compose_table *table, uint64_t hash)
+{
+    char path[PATH_MAX];
+
+    if (compose_cache_path(path, sizeof(path), hash) == -1)
+    {
+        return false;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    struct stat info;
+    void *data = MAP_FAILED;
+
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    if (!compose_table_init(table, data, info.st_size, hash))
+    {
+        munmap(data, info.st_size);
+        return false;
+    }
+
+    table->mapped = true;
+
+    return true;
+}
+
+static void compose_cache_store(const struct compose_table *table, uint64_t hash)
+{
+    char path[PATH_MAX];
+    char temporary_path[PATH_MAX + 16];
+
+    if (compose_cache_path(path, sizeof(path), hash) == -1)
+    {
+        return;
+    }
+
+    // Written under a unique name and renamed, so concurrent instances never map a partial file.
+    snprintf(temporary_path, sizeof(temporary_path), "%s.%d", path, (int) getpid());
+    int fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+    if (fd == -1)
+    {
+        return;
+    }
+
+    bool written = write(fd, table->data, table->size) == (ssize_t) table->size;
+    close(fd);
+
+    if (!written || rename(temporary_path, path) == -1)
+    {
+        unlink(temporary_path);
+    }
+}
+
+struct compose_entry
+{
+    xkb_keysym_t sequence[COMPOSE_MAX_SEQUENCE];
+    uint32_t length;
+    xkb_keysym_t result;
+    uint32_t utf8_offset;
+};
+
+struct compose_builder
+{
+    struct compose_entry *entries;
+    uint32_t entry_count;
+    struct compose_node *nodes;
+    uint32_t node_count;
+    char *strings;
+    uint32_t strings_size;
+    uint32_t strings_capacity;
+};
+
+static int compose_entry_compare(const void *a, const void *b)
+{
+    const struct compose_entry *entry_a = a;
+    const struct compose_entry *entry_b = b;
+
+    for (uint32_t i = 0; i < entry_a->length && i < entry_b->length; ++i)
+    {
+        if (entry_a->sequence[i] != entry_b->sequence[i])
+        {
+            return entry_a->sequence[i] < entry_b->sequence[i] ? -1 : 1;
+        }
+    }
+
+    return (int) entry_a->length - (int) entry_b->length;
+}
+
+static bool compose_builder_add_string(struct compose_builder *builder, const char *string, uint32_t *offset)
+{
+    size_t length = strlen(string);
+
+    if (length == 0)
+    {
+        *offset = 0;
+        return true;
+    }
+
+    if (builder->strings_size + length + 1 > builder->strings_capacity)
+    {
+        uint32_t capacity = (builder->strings_capacity + length + 1) * 2;
+        char *strings = realloc(builder->strings, capacity);
+
+        if (strings == NULL)
+        {
+            return false;
+        }
+
+        builder->strings = strings;
+        builder->strings_capacity = capacity;
+    }
+
+    *offset = builder->strings_size;
+    memcpy(builder->strings + builder->strings_size, string, length + 1);
+    builder->strings_size += length + 1;
+
+    return true;
+}
+
+// Creates the children of `parent` for the sorted entries in `[begin, end)`, which share their first `depth` keysyms.
+// The children are allocated as one block before descending, so siblings end up next to each other.
+static void compose_builder_add_children(struct compose_builder *builder, uint32_t parent, uint32_t begin, uint32_t end, uint32_t depth)
+{
+    const struct compose_entry *entries = builder->entries;
+    uint32_t first_child = builder->node_count;
+    uint32_t child_count = 0;
+
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        if (i == begin || entries[i].sequence[depth] != entries[i - 1].sequence[depth])
+        {
+            child_count += 1;
+        }
+    }
+
+    builder->nodes[parent].first_child = first_child;
+    builder->nodes[parent].child_count = child_count;
+    builder->node_count += child_count;
+
+    uint32_t child = first_child;
+    uint32_t group_begin = begin;
+
+    while (group_begin < end)
+    {
+        uint32_t group_end = group_begin + 1;
+
+        while (group_end < end && entries[group_end].sequence[depth] == entries[group_begin].sequence[depth])
+        {
+            group_end += 1;
+        }
+
+        struct compose_node *node = &builder->nodes[child];
+        memset(node, 0, sizeof(struct compose_node));
+        node->keysym = entries[group_begin].sequence[depth];
+        node->first_child = builder->node_count;
+
+        // Sorting puts the shortest sequence first. A sequence that completes here wins over longer ones sharing it as
+        // a prefix, which xkb does not produce anyway.
+        if (entries[group_begin].length == depth + 1)
+        {
+            node->result = entries[group_begin].result;
+            node->utf8_offset = entries[group_begin].utf8_offset;
+        }
+        else
+        {
+            compose_builder_add_children(builder, child, group_begin, group_end, depth + 1);
+        }
+
+        child += 1;
+        group_begin = group_end;
+    }
+}
+
+// Parses the Compose files of `locale` through xkb and lays the sequences out in the cache file format.
+static bool compose_table_build(struct compose_table *table, const char *locale, uint64_t hash)
+{
+    struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+
+    if (context == NULL)
+    {
+        return false;
+    }
+
+    struct xkb_compose_table *compose_table = xkb_compose_table_new_from_locale(context, locale, XKB_COMPOSE_COMPILE_NO_FLAGS);
+    xkb_context_unref(context);
+
+    if (compose_table == NULL)
+    {
+        return false;
+    }
+
+    struct compose_builder builder = {0};
+    uint32_t entry_capacity = 0;
+    // The root, plus at most one node per keysym of every sequence.
+    uint32_t max_nodes = 1;
+    builder.strings = malloc(4096);
+    bool built = builder.strings != NULL;
+
+    if (built)
+    {
+        builder.strings[0] = '\0';
+        builder.strings_size = 1;
+        builder.strings_capacity = 4096;
+    }
+
+    struct xkb_compose_table_iterator *iterator = xkb_compose_table_iterator_new(compose_table);
+    struct xkb_compose_table_entry *compose_entry;
+
+    while (built && iterator != NULL && (compose_entry = xkb_compose_table_iterator_next(iterator)) != NULL)
+    {
+        size_t length;
+        const xkb_keysym_t *sequence = xkb_compose_table_entry_sequence(compose_entry, &length);
+
+        if (length == 0 || length > COMPOSE_MAX_SEQUENCE)
+        {
+            continue;
+        }
+
+        if (builder.entry_count == entry_capacity)
+        {
+            entry_capacity = entry_capacity == 0 ? 1024 : entry_capacity * 2;
+            struct compose_entry *entries = realloc(builder.entries, entry_capacity * sizeof(struct compose_entry));
+
+            if (entries == NULL)
+            {
+                built = false;
+                break;
+            }
+
+            builder.entries = entries;
+        }
+
+        struct compose_entry *entry = &builder.entries[builder.entry_count];
+        memcpy(entry->sequence, sequence, length * sizeof(xkb_keysym_t));
+        entry->length = length;
+        entry->result = xkb_compose_table_entry_keysym(compose_entry);
+        built = compose_builder_add_string(&builder, xkb_compose_table_entry_utf8(compose_entry), &entry->utf8_offset);
+        builder.entry_count += 1;
+        max_nodes += length;
+    }
+
+    if (iterator != NULL)
+    {
+        xkb_compose_table_iterator_free(iterator);
+    }
+
+    xkb_compose_table_unref(compose_table);
+
+    size_t size = 0;
+    char *data = NULL;
+
+    if (built && iterator != NULL)
+    {
+        size = sizeof(struct compose_cache_header) + (size_t) max_nodes * sizeof(struct compose_node) + builder.strings_size;
+        data = calloc(1, size);
+    }
+
+    if (data != NULL)
+    {
+        qsort(builder.entries, builder.entry_count, sizeof(struct compose_entry), compose_entry_compare);
+
+        // Nodes are written straight into their place in the file and the strings moved up behind them afterwards.
+        builder.nodes = (struct compose_node *) (data + sizeof(struct compose_cache_header));
+        builder.node_count = 1;
+
+        if (builder.entry_count > 0)
+        {
+            compose_builder_add_children(&builder, 0, 0, builder.entry_count, 0);
+        }
+
+        memcpy(builder.nodes + builder.node_count, builder.strings, builder.strings_size);
+        size = sizeof(struct compose_cache_header) + (size_t) builder.node_count * sizeof(struct compose_node) + builder.strings_size;
+
+        struct compose_cache_header *header = (struct compose_cache_header *) data;
+        memcpy(header->magic, compose_cache_magic, sizeof(header->magic));
+        header->version = COMPOSE_CACHE_VERSION;
+        header->node_size = sizeof(struct compose_node);
+        header->hash = hash;
+        header->node_count = builder.node_count;
+        header->strings_size = builder.strings_size;
+    }
+
+    free(builder.entries);
+    free(builder.strings);
+
+    if (data == NULL || !compose_table_init(table, data, size, hash))
+    {
+        free(data);
+        return false;
+    }
+
+    table->mapped = false;
+
+    return true;
+}
+
+bool compose_table_load(struct compose_table *table, const char *locale, bool *cached)
+{
+    memset(table, 0, sizeof(struct compose_table));
+    uint64_t hash = compose_cache_key(locale);
+
+    *cached = compose_cache_load(table, hash);
+
+    if (*cached)
+    {
+        return true;
+    }
+
+    if (!compose_table_build(table, locale, hash))
+    {
+        return false;
+    }
+
+    compose_cache_store(table, hash);
+
+    return true;
+}
+
+void compose_table_release(struct compose_table *table)
+{
+    if (table->mapped)
+    {
+        munmap(table->data, table->size);
+    }
+    else
+    {
+        free(table->data);
+    }
+
+    memset(table, 0, sizeof(struct compose_table));
+}
+
+void compose_state_init(struct compose_state *state, const struct compose_table *table)
+{
+    state->table = table;
+    compose_state_reset(state);
+}
+
+void compose_state_reset(struct compose_state *state)
+{
+    state->status = COMPOSE_STATUS_NOTHING;
+    state->node = 0;
+}
+
+static bool keysym_is_modifier(xkb_keysym_t keysym)
+{
+    return (keysym >= XKB_KEY_Shift_L && keysym <= XKB_KEY_Hyper_R) || (keysym >= XKB_KEY_ISO_Lock && keysym <= XKB_KEY_ISO_Level5_Lock) ||
+           keysym == XKB_KEY_Mode_switch || keysym == XKB_KEY_Num_Lock;
+}
+
+enum compose_status compose_state_feed(struct compose_state *state, xkb_keysym_t keysym)
+{
+    const struct compose_table *table = state->table;
+
+    if (table == NULL || table->nodes == NULL || keysym_is_modifier(keysym))
+    {
+        return state->status;
+    }
+
+    uint32_t parent = state->status == COMPOSE_STATUS_COMPOSING ? state->node : 0;
+    const struct compose_node *nodes = table->nodes;
+    uint32_t low = nodes[parent].first_child;
+    uint32_t high = low + nodes[parent].child_count;
+
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+
+        if (nodes[middle].keysym < keysym)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if (low == nodes[parent].first_child + nodes[parent].child_count || nodes[low].keysym != keysym)
+    {
+        state->status = parent == 0 ? COMPOSE_STATUS_NOTHING : COMPOSE_STATUS_CANCELLED;
+        state->node = 0;
+        return state->status;
+    }
+
+    state->node = low;
+    state->status = nodes[low].child_count == 0 ? COMPOSE_STATUS_COMPOSED : COMPOSE_STATUS_COMPOSING;
+
+    return state->status;
+}
+
+xkb_keysym_t compose_state_get_sym(const struct compose_state *state)
+{
+    if (state->status != COMPOSE_STATUS_COMPOSED)
+    {
+        return XKB_KEY_NoSymbol;
+    }
+
+    return state->table->nodes[state->node].result;
+}
+
+const char *compose_state_get_utf8(const struct compose_state *state)
+{
+    if (state->status != COMPOSE_STATUS_COMPOSED)
+    {
+        return "";
+    }
+
+    return state->table->strings + state->table->nodes[state->node].utf8_offset;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <xkbcommon/xkbcommon.h>
+
+// Longest sequence that is kept, longer ones are dropped when the table is built.
+#define COMPOSE_MAX_SEQUENCE 10
+
+// Node of the compose trie. The children of a node are stored next to each other, sorted by keysym, so they can be
+// searched in place.
+struct compose_node
+{
+    xkb_keysym_t keysym;
+    uint32_t first_child;
+    // Zero for nodes that complete a sequence.
+    uint32_t child_count;
+    xkb_keysym_t result;
+    // Offset of the null terminated UTF-8 result in the string pool. The pool starts with an empty string.
+    uint32_t utf8_offset;
+};
+
+// Compose sequences of a locale as a flat trie, rooted at the first node. The arrays point into the cache file, which
+// is mapped read-only, or into memory owned by the table if the cache could not be used.
+struct compose_table
+{
+    const struct compose_node *nodes;
+    uint32_t node_count;
+    const char *strings;
+    uint32_t strings_size;
+    void *data;
+    size_t size;
+    bool mapped;
+};
+
+enum compose_status
+{
+    COMPOSE_STATUS_NOTHING,
+    COMPOSE_STATUS_COMPOSING,
+    COMPOSE_STATUS_COMPOSED,
+    COMPOSE_STATUS_CANCELLED,
+};
+
+struct compose_state
+{
+    const struct compose_table *table;
+    enum compose_status status;
+    // Node reached by the keysyms fed so far, the root if no sequence is in progress.
+    uint32_t node;
+};
+
+// Returns the locale the compose sequences are looked up for, following `LC_ALL`, `LC_CTYPE` and `LANG`.
+const char *compose_locale(void);
+
+// Maps the table cached for `locale`. On a miss the Compose files are parsed through xkb and the result is cached.
+// Returns false if the locale has no compose table. `cached` tells whether the cache was hit.
+bool compose_table_load(struct compose_table *table, const char *locale, bool *cached);
+
+void compose_table_release(struct compose_table *table);
+
+void compose_state_init(struct compose_state *state, const struct compose_table *table);
+
+void compose_state_reset(struct compose_state *state);
+
+// Advances the sequence like `xkb_compose_state_feed` and returns the new status. Modifier keysyms are ignored.
+enum compose_status compose_state_feed(struct compose_state *state, xkb_keysym_t keysym);
+
+// The result of the completed sequence, only valid while the status is `COMPOSE_STATUS_COMPOSED`.
+xkb_keysym_t compose_state_get_sym(const struct compose_state *state);
+
+const char *compose_state_get_utf8(const struct compose_state *state);
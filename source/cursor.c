@@ -0,0 +1,162 @@
+#include "cursor.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+const struct cursor_variant_descriptor cursor_variants[CURSOR_VARIANT_COUNT] = {
+    [CURSOR_VARIANT_LEFT_PTR] = {"left_ptr", WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_DEFAULT},
+    [CURSOR_VARIANT_POINTER] = {"pointer", WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_POINTER},
+    [CURSOR_VARIANT_N_RESIZE] = {"n-resize", WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_N_RESIZE},
+    [CURSOR_VARIANT_S_RESIZE] = {"s-resize", WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_S_RESIZE},
+    [CURSOR_VARIANT_W_RESIZE] = {"w-resize", WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_W_RESIZE},
+    [CURSOR_VARIANT_E_RESIZE] = {"e-resize", WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_E_RESIZE},
+    [CURSOR_VARIANT_NW_RESIZE] = {"nw-resize", WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_NW_RESIZE},
+    [CURSOR_VARIANT_NE_RESIZE] = {"ne-resize", WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_NE_RESIZE},
+    [CURSOR_VARIANT_SW_RESIZE] = {"sw-resize", WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_SW_RESIZE},
+    [CURSOR_VARIANT_SE_RESIZE] = {"se-resize", WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_SE_RESIZE},
+};
+
+static void cursor_cache_resolve(struct cursor_cache *cache, enum cursor_variant variant)
+{
+    cache->resolved[variant] = true;
+    struct wl_cursor *cursor = wl_cursor_theme_get_cursor(cache->theme, cursor_variants[variant].name);
+
+    if (cursor == NULL || cursor->image_count == 0)
+    {
+        return;
+    }
+
+    struct wl_buffer **buffers = calloc(cursor->image_count, sizeof(struct wl_buffer *));
+
+    if (buffers == NULL)
+    {
+        return;
+    }
+
+    size_t bytes = 0;
+
+    for (unsigned int i = 0; i < cursor->image_count; ++i)
+    {
+        buffers[i] = wl_cursor_image_get_buffer(cursor->images[i]);
+
+        if (buffers[i] == NULL)
+        {
+            free(buffers);
+            return;
+        }
+
+        bytes += (size_t) cursor->images[i]->width * cursor->images[i]->height * 4;
+    }
+
+    cache->cursors[variant] = cursor;
+    cache->buffers[variant] = buffers;
+    cache->buffer_bytes += bytes;
+}
+
+struct wl_cursor *cursor_cache_get(struct cursor_cache *cache, enum cursor_variant variant, struct wl_buffer ***buffers)
+{
+    if (cache->theme == NULL)
+    {
+        return NULL;
+    }
+
+    if (!cache->resolved[variant])
+    {
+        cursor_cache_resolve(cache, variant);
+    }
+
+    if (cache->cursors[variant] == NULL)
+    {
+        if (variant == CURSOR_VARIANT_LEFT_PTR)
+        {
+            return NULL;
+        }
+
+        return cursor_cache_get(cache, CURSOR_VARIANT_LEFT_PTR, buffers);
+    }
+
+    *buffers = cache->buffers[variant];
+
+    return cache->cursors[variant];
+}
+
+void cursor_cache_release(struct cursor_cache *cache)
+{
+    for (int i = 0; i < CURSOR_VARIANT_COUNT; ++i)
+    {
+        free(cache->buffers[i]);
+    }
+
+    // Also destroys the buffers.
+    if (cache->theme != NULL)
+    {
+        wl_cursor_theme_destroy(cache->theme);
+    }
+
+    *cache = (struct cursor_cache) {0};
+}
+
+struct cursor_loader
+{
+    pthread_t thread;
+    struct wl_shm *shm;
+    int size;
+    int notify_fd;
+    struct cursor_loader_result result;
+};
+
+// libwayland requests are thread safe, so the shm pool and buffers of the theme can be created here. They end up on
+// the queue of `shm`, which the main thread dispatches.
+static void *cursor_loader_run(void *data)
+{
+    struct cursor_loader *loader = data;
+    uint64_t start_time_ns = get_monotonic_time_ns();
+
+    loader->result.theme = wl_cursor_theme_load(NULL, loader->size, loader->shm);
+    loader->result.duration_ns = get_monotonic_time_ns() - start_time_ns;
+
+    uint64_t value = 1;
+    write(loader->notify_fd, &value, sizeof(value));
+
+    return NULL;
+}
+
+struct cursor_loader *cursor_loader_start(struct wl_shm *shm, int size, int notify_fd)
+{
+    struct cursor_loader *loader = calloc(1, sizeof(struct cursor_loader));
+
+    if (loader == NULL)
+    {
+        return NULL;
+    }
+
+    loader->shm = shm;
+    loader->size = size;
+    loader->notify_fd = notify_fd;
+
+    // Signals are handled by the event loop of the main thread.
+    sigset_t mask;
+    sigset_t old_mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, &old_mask);
+    int result = pthread_create(&loader->thread, NULL, cursor_loader_run, loader);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    if (result != 0)
+    {
+        free(loader);
+        return NULL;
+    }
+
+    return loader;
+}
+
+void cursor_loader_finish(struct cursor_loader *loader, struct cursor_loader_result *result)
+{
+    pthread_join(loader->thread, NULL);
+    *result = loader->result;
+    free(loader);
+}
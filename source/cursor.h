@@ -0,0 +1,67 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <wayland-client.h>
+#include <wayland-cursor.h>
+
+#include "cursor-shape-v1-client-protocol.h"
+
+enum cursor_variant
+{
+    CURSOR_VARIANT_LEFT_PTR,
+    CURSOR_VARIANT_POINTER,
+    CURSOR_VARIANT_N_RESIZE,
+    CURSOR_VARIANT_S_RESIZE,
+    CURSOR_VARIANT_W_RESIZE,
+    CURSOR_VARIANT_E_RESIZE,
+    CURSOR_VARIANT_NW_RESIZE,
+    CURSOR_VARIANT_NE_RESIZE,
+    CURSOR_VARIANT_SW_RESIZE,
+    CURSOR_VARIANT_SE_RESIZE,
+    CURSOR_VARIANT_COUNT,
+};
+
+struct cursor_variant_descriptor
+{
+    // Name in cursor themes.
+    const char *name;
+    // Shape for `wp_cursor_shape_device_v1.set_shape`.
+    enum wp_cursor_shape_device_v1_shape shape;
+};
+
+// Indexed by `enum cursor_variant`.
+extern const struct cursor_variant_descriptor cursor_variants[CURSOR_VARIANT_COUNT];
+
+// Variants are looked up in the theme the first time they are used. The buffers of all frames of an animated cursor
+// are created at that point and reused afterwards.
+struct cursor_cache
+{
+    struct wl_cursor_theme *theme;
+    struct wl_cursor *cursors[CURSOR_VARIANT_COUNT];
+    struct wl_buffer **buffers[CURSOR_VARIANT_COUNT];
+    bool resolved[CURSOR_VARIANT_COUNT];
+    // Size of all buffers created so far.
+    size_t buffer_bytes;
+};
+
+// Returns the cursor of the variant, or the default cursor if the theme lacks it. Returns NULL if neither exists.
+// `buffers` is set to the buffers of the cursor's frames.
+struct wl_cursor *cursor_cache_get(struct cursor_cache *cache, enum cursor_variant variant, struct wl_buffer ***buffers);
+
+void cursor_cache_release(struct cursor_cache *cache);
+
+struct cursor_loader_result
+{
+    struct wl_cursor_theme *theme;
+    uint64_t duration_ns;
+};
+
+struct cursor_loader;
+
+// Parses the cursor theme on a worker thread. The eventfd `notify_fd` is signalled once the result is ready.
+struct cursor_loader *cursor_loader_start(struct wl_shm *shm, int size, int notify_fd);
+
+// Joins the worker thread and frees the loader.
+void cursor_loader_finish(struct cursor_loader *loader, struct cursor_loader_result *result);
@@ -0,0 +1,138 @@
+#include "decor.h"
+#include "utils.h"
+
+#include <stdbool.h>
+
+const uint32_t BORDER_WIDTH = 5;
+const uint32_t TITLEBAR_WIDTH = 30;
+const uint32_t CLOSE_BUTTON_SIZE = 20;
+
+static const uint32_t BORDER_COLOR = 0xffaaaaaa;
+static const uint32_t TITLEBAR_COLOR = 0xff666666;
+static const uint32_t CLOSE_BUTTON_COLOR = 0xffdd6666;
+
+const struct decor_role_descriptor decor_roles[DECOR_ROLE_COUNT] = {
+    [DECOR_ROLE_TITLEBAR] = {DECOR_ROLE_TITLEBAR, CURSOR_VARIANT_LEFT_PTR, DECOR_ACTION_MOVE, XDG_TOPLEVEL_RESIZE_EDGE_NONE},
+    [DECOR_ROLE_CLOSE_BUTTON] = {DECOR_ROLE_CLOSE_BUTTON, CURSOR_VARIANT_POINTER, DECOR_ACTION_CLOSE, XDG_TOPLEVEL_RESIZE_EDGE_NONE},
+    [DECOR_ROLE_BORDER_TOP] = {DECOR_ROLE_BORDER_TOP, CURSOR_VARIANT_N_RESIZE, DECOR_ACTION_RESIZE, XDG_TOPLEVEL_RESIZE_EDGE_TOP},
+    [DECOR_ROLE_BORDER_BOTTOM] = {DECOR_ROLE_BORDER_BOTTOM, CURSOR_VARIANT_S_RESIZE, DECOR_ACTION_RESIZE, XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM},
+    [DECOR_ROLE_BORDER_LEFT] = {DECOR_ROLE_BORDER_LEFT, CURSOR_VARIANT_W_RESIZE, DECOR_ACTION_RESIZE, XDG_TOPLEVEL_RESIZE_EDGE_LEFT},
+    [DECOR_ROLE_BORDER_RIGHT] = {DECOR_ROLE_BORDER_RIGHT, CURSOR_VARIANT_E_RESIZE, DECOR_ACTION_RESIZE, XDG_TOPLEVEL_RESIZE_EDGE_RIGHT},
+    [DECOR_ROLE_CORNER_TOP_LEFT] = {DECOR_ROLE_CORNER_TOP_LEFT, CURSOR_VARIANT_NW_RESIZE, DECOR_ACTION_RESIZE, XDG_TOPLEVEL_RESIZE_EDGE_TOP_LEFT},
+    [DECOR_ROLE_CORNER_TOP_RIGHT] = {DECOR_ROLE_CORNER_TOP_RIGHT, CURSOR_VARIANT_NE_RESIZE, DECOR_ACTION_RESIZE, XDG_TOPLEVEL_RESIZE_EDGE_TOP_RIGHT},
+    [DECOR_ROLE_CORNER_BOTTOM_LEFT] = {DECOR_ROLE_CORNER_BOTTOM_LEFT, CURSOR_VARIANT_SW_RESIZE, DECOR_ACTION_RESIZE, XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM_LEFT},
+    [DECOR_ROLE_CORNER_BOTTOM_RIGHT] = {DECOR_ROLE_CORNER_BOTTOM_RIGHT, CURSOR_VARIANT_SE_RESIZE, DECOR_ACTION_RESIZE, XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM_RIGHT},
+    [DECOR_ROLE_CONTENT] = {DECOR_ROLE_CONTENT, CURSOR_VARIANT_LEFT_PTR, DECOR_ACTION_NONE, XDG_TOPLEVEL_RESIZE_EDGE_NONE},
+};
+
+int32_t decor_content_width(int32_t width)
+{
+    return width - 2 * (int32_t) BORDER_WIDTH;
+}
+
+int32_t decor_content_height(int32_t height)
+{
+    return height - 2 * (int32_t) BORDER_WIDTH - (int32_t) TITLEBAR_WIDTH;
+}
+
+// The close button is centered vertically in the titlebar, with the same margin to the right border.
+static void close_button_position(int32_t width, int32_t *x_position, int32_t *y_position)
+{
+    int32_t margin = ((int32_t) TITLEBAR_WIDTH - (int32_t) CLOSE_BUTTON_SIZE) / 2;
+    *x_position = width - (int32_t) BORDER_WIDTH - margin - (int32_t) CLOSE_BUTTON_SIZE;
+    *y_position = (int32_t) BORDER_WIDTH + margin;
+}
+
+enum decor_role decor_hit_test(int32_t width, int32_t height, double x_position, double y_position)
+{
+    const double border = BORDER_WIDTH;
+    bool top = y_position < border;
+    bool bottom = y_position >= height - border;
+    bool left = x_position < border;
+    bool right = x_position >= width - border;
+
+    if (top)
+    {
+        return left ? DECOR_ROLE_CORNER_TOP_LEFT : right ? DECOR_ROLE_CORNER_TOP_RIGHT : DECOR_ROLE_BORDER_TOP;
+    }
+
+    if (bottom)
+    {
+        return left ? DECOR_ROLE_CORNER_BOTTOM_LEFT : right ? DECOR_ROLE_CORNER_BOTTOM_RIGHT : DECOR_ROLE_BORDER_BOTTOM;
+    }
+
+    if (left)
+    {
+        return DECOR_ROLE_BORDER_LEFT;
+    }
+
+    if (right)
+    {
+        return DECOR_ROLE_BORDER_RIGHT;
+    }
+
+    if (y_position >= border + TITLEBAR_WIDTH)
+    {
+        return DECOR_ROLE_CONTENT;
+    }
+
+    int32_t close_x_position;
+    int32_t close_y_position;
+    close_button_position(width, &close_x_position, &close_y_position);
+
+    if (x_position >= close_x_position && x_position < close_x_position + (int32_t) CLOSE_BUTTON_SIZE && y_position >= close_y_position && y_position < close_y_position + (int32_t) CLOSE_BUTTON_SIZE)
+    {
+        return DECOR_ROLE_CLOSE_BUTTON;
+    }
+
+    return DECOR_ROLE_TITLEBAR;
+}
+
+// Takes the rectangle in logical coordinates and fills the pixels it covers at `scale`. Edges are rounded, so
+// rectangles that touch logically also touch in the buffer.
+static void fill_rectangle(uint32_t *pixels, int32_t stride, int32_t scale, int32_t x_position, int32_t y_position, int32_t width, int32_t height, uint32_t color)
+{
+    int32_t x_end = scale_length(x_position + width, scale);
+    int32_t y_end = scale_length(y_position + height, scale);
+
+    for (int32_t y = scale_length(y_position, scale); y < y_end; ++y)
+    {
+        for (int32_t x = scale_length(x_position, scale); x < x_end; ++x)
+        {
+            pixels[y * stride + x] = color;
+        }
+    }
+}
+
+void decor_buffer_size(int32_t width, int32_t height, int32_t scale, int32_t *buffer_width, int32_t *buffer_height)
+{
+    *buffer_width = scale_length(width, scale);
+    *buffer_height = scale_length(height, scale);
+}
+
+void decor_content_buffer_size(int32_t width, int32_t height, int32_t scale, int32_t *buffer_width, int32_t *buffer_height)
+{
+    const int32_t left = BORDER_WIDTH;
+    const int32_t top = BORDER_WIDTH + TITLEBAR_WIDTH;
+    *buffer_width = scale_length(left + decor_content_width(width), scale) - scale_length(left, scale);
+    *buffer_height = scale_length(top + decor_content_height(height), scale) - scale_length(top, scale);
+}
+
+void decor_draw(uint32_t *pixels, int32_t width, int32_t height, int32_t scale)
+{
+    const int32_t border = BORDER_WIDTH;
+    const int32_t titlebar = TITLEBAR_WIDTH;
+    const int32_t stride = scale_length(width, scale);
+
+    fill_rectangle(pixels, stride, scale, 0, 0, width, border, BORDER_COLOR);
+    fill_rectangle(pixels, stride, scale, 0, height - border, width, border, BORDER_COLOR);
+    fill_rectangle(pixels, stride, scale, 0, border, border, height - 2 * border, BORDER_COLOR);
+    fill_rectangle(pixels, stride, scale, width - border, border, border, height - 2 * border, BORDER_COLOR);
+    fill_rectangle(pixels, stride, scale, border, border, width - 2 * border, titlebar, TITLEBAR_COLOR);
+    fill_rectangle(pixels, stride, scale, border, border + titlebar, decor_content_width(width), decor_content_height(height), 0);
+
+    int32_t close_x_position;
+    int32_t close_y_position;
+    close_button_position(width, &close_x_position, &close_y_position);
+    fill_rectangle(pixels, stride, scale, close_x_position, close_y_position, CLOSE_BUTTON_SIZE, CLOSE_BUTTON_SIZE, CLOSE_BUTTON_COLOR);
+}
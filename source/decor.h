@@ -0,0 +1,61 @@
+#pragma once
+#include "cursor.h"
+#include "extensions/xdg-shell-client-protocol.h"
+
+#include <stdint.h>
+
+extern const uint32_t BORDER_WIDTH;
+extern const uint32_t TITLEBAR_WIDTH;
+extern const uint32_t CLOSE_BUTTON_SIZE;
+
+enum decor_role
+{
+    DECOR_ROLE_TITLEBAR,
+    DECOR_ROLE_CLOSE_BUTTON,
+    DECOR_ROLE_BORDER_TOP,
+    DECOR_ROLE_BORDER_BOTTOM,
+    DECOR_ROLE_BORDER_LEFT,
+    DECOR_ROLE_BORDER_RIGHT,
+    DECOR_ROLE_CORNER_TOP_LEFT,
+    DECOR_ROLE_CORNER_TOP_RIGHT,
+    DECOR_ROLE_CORNER_BOTTOM_LEFT,
+    DECOR_ROLE_CORNER_BOTTOM_RIGHT,
+    DECOR_ROLE_CONTENT,
+    DECOR_ROLE_COUNT,
+};
+
+enum decor_action
+{
+    DECOR_ACTION_NONE,
+    DECOR_ACTION_MOVE,
+    DECOR_ACTION_CLOSE,
+    DECOR_ACTION_RESIZE,
+};
+
+struct decor_role_descriptor
+{
+    enum decor_role role;
+    enum cursor_variant cursor_variant;
+    enum decor_action action;
+    enum xdg_toplevel_resize_edge resize_edge;
+};
+
+extern const struct decor_role_descriptor decor_roles[DECOR_ROLE_COUNT];
+
+// The decor is a single surface of the full window size. The content surface covers the hole in its middle, which
+// starts at (`BORDER_WIDTH`, `BORDER_WIDTH + TITLEBAR_WIDTH`).
+int32_t decor_content_width(int32_t width);
+int32_t decor_content_height(int32_t height);
+
+// Returns the part of a decor of `width` x `height` at surface local coordinates. The content hole maps to
+// `DECOR_ROLE_CONTENT`.
+enum decor_role decor_hit_test(int32_t width, int32_t height, double x_position, double y_position);
+
+// Buffer sizes for a window of logical size `width` x `height` at `scale`, see `SCALE_DENOMINATOR`. The content buffer
+// exactly fills the hole in the decor buffer, even where rounding makes it differ from the scaled content size.
+void decor_buffer_size(int32_t width, int32_t height, int32_t scale, int32_t *buffer_width, int32_t *buffer_height);
+void decor_content_buffer_size(int32_t width, int32_t height, int32_t scale, int32_t *buffer_width, int32_t *buffer_height);
+
+// Paints the whole decor of logical size `width` x `height` into ARGB8888 `pixels` of `decor_buffer_size`, without
+// padding. The content hole is left transparent.
+void decor_draw(uint32_t *pixels, int32_t width, int32_t height, int32_t scale);
@@ -0,0 +1,470 @@
+#include "event_loop.h"
+#include "stats.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+
+#define EVENT_LOOP_MAX_EVENTS 32
+#define EVENT_LOOP_MAX_QUEUES 4
+
+enum event_source_type
+{
+    EVENT_SOURCE_TYPE_FD,
+    EVENT_SOURCE_TYPE_TIMER,
+    EVENT_SOURCE_TYPE_SIGNAL,
+};
+
+struct event_source
+{
+    struct event_loop *loop;
+    struct wl_list link;
+    enum event_source_type type;
+    int fd;
+    void *data;
+    event_loop_fd_func_t fd_func;
+    event_loop_timer_func_t timer_func;
+    event_loop_signal_func_t signal_func;
+    bool removed;
+};
+
+struct event_loop
+{
+    int epoll_fd;
+    struct wl_display *display;
+    struct wl_event_queue *queues[EVENT_LOOP_MAX_QUEUES];
+    struct queue_stats *queue_stats[EVENT_LOOP_MAX_QUEUES];
+    int queue_count;
+    uint64_t read_time_ns;
+    struct request_stats *request_stats;
+    // Set while the socket is full and the display fd is polled for `EPOLLOUT`.
+    bool flush_blocked;
+    struct wl_list sources;
+    // Sources removed while epoll results may still point at them. Freed at the end of each iteration.
+    struct wl_list removed_sources;
+};
+
+struct event_loop *event_loop_create(struct wl_display *display)
+{
+    struct event_loop *loop = calloc(1, sizeof(struct event_loop));
+
+    if (loop == NULL)
+    {
+        return NULL;
+    }
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (loop->epoll_fd == -1)
+    {
+        free(loop);
+        return NULL;
+    }
+
+    wl_list_init(&loop->sources);
+    wl_list_init(&loop->removed_sources);
+    loop->display = display;
+
+    if (display != NULL)
+    {
+        // The display is marked with a NULL pointer instead of a source.
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, wl_display_get_fd(display), &event) == -1)
+        {
+            close(loop->epoll_fd);
+            free(loop);
+            return NULL;
+        }
+    }
+
+    return loop;
+}
+
+int event_loop_add_queue(struct event_loop *loop, struct wl_event_queue *queue, struct queue_stats *stats)
+{
+    if (loop->queue_count == EVENT_LOOP_MAX_QUEUES)
+    {
+        return -1;
+    }
+
+    loop->queues[loop->queue_count] = queue;
+    loop->queue_stats[loop->queue_count] = stats;
+    loop->queue_count += 1;
+
+    return 0;
+}
+
+void event_loop_set_request_stats(struct event_loop *loop, struct request_stats *stats)
+{
+    loop->request_stats = stats;
+}
+
+static void set_display_events(struct event_loop *loop, uint32_t events)
+{
+    struct epoll_event event = {.events = events, .data.ptr = NULL};
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, wl_display_get_fd(loop->display), &event);
+}
+
+int event_loop_flush(struct event_loop *loop)
+{
+    // Writing again before the socket drained would only fail again.
+    if (loop->flush_blocked)
+    {
+        return 0;
+    }
+
+    int result = wl_display_flush(loop->display);
+    struct request_stats *stats = loop->request_stats;
+
+    if (result > 0 && stats != NULL)
+    {
+        stats->flushes += 1;
+        stats->bytes += result;
+    }
+
+    if (result == -1)
+    {
+        if (errno != EAGAIN)
+        {
+            return -1;
+        }
+
+        if (stats != NULL)
+        {
+            stats->flushes += 1;
+            stats->blocked_flushes += 1;
+        }
+
+        loop->flush_blocked = true;
+        set_display_events(loop, EPOLLIN | EPOLLOUT);
+
+        return 0;
+    }
+
+    return result;
+}
+
+static void free_removed_sources(struct event_loop *loop)
+{
+    struct event_source *source;
+    struct event_source *tmp;
+
+    wl_list_for_each_safe(source, tmp, &loop->removed_sources, link)
+    {
+        wl_list_remove(&source->link);
+        free(source);
+    }
+}
+
+void event_loop_destroy(struct event_loop *loop)
+{
+    struct event_source *source;
+    struct event_source *tmp;
+
+    wl_list_for_each_safe(source, tmp, &loop->sources, link)
+    {
+        event_source_remove(source);
+    }
+
+    free_removed_sources(loop);
+    close(loop->epoll_fd);
+    free(loop);
+}
+
+static struct event_source *add_source(struct event_loop *loop, enum event_source_type type, int fd, uint32_t events, void *data)
+{
+    struct event_source *source = calloc(1, sizeof(struct event_source));
+
+    if (source == NULL)
+    {
+        return NULL;
+    }
+
+    source->loop = loop;
+    source->type = type;
+    source->fd = fd;
+    source->data = data;
+
+    struct epoll_event event = {.events = events, .data.ptr = source};
+
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        free(source);
+        return NULL;
+    }
+
+    wl_list_insert(loop->sources.prev, &source->link);
+
+    return source;
+}
+
+struct event_source *event_loop_add_fd(struct event_loop *loop, int fd, uint32_t events, event_loop_fd_func_t func, void *data)
+{
+    struct event_source *source = add_source(loop, EVENT_SOURCE_TYPE_FD, fd, events, data);
+
+    if (source != NULL)
+    {
+        source->fd_func = func;
+    }
+
+    return source;
+}
+
+int event_source_fd_update(struct event_source *source, uint32_t events)
+{
+    struct epoll_event event = {.events = events, .data.ptr = source};
+    return epoll_ctl(source->loop->epoll_fd, EPOLL_CTL_MOD, source->fd, &event);
+}
+
+struct event_source *event_loop_add_timer(struct event_loop *loop, event_loop_timer_func_t func, void *data)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    struct event_source *source = add_source(loop, EVENT_SOURCE_TYPE_TIMER, fd, EPOLLIN, data);
+
+    if (source == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    source->timer_func = func;
+
+    return source;
+}
+
+int event_source_timer_update(struct event_source *source, uint32_t delay_ms, uint32_t interval_ms)
+{
+    struct itimerspec spec = {
+        .it_value = {.tv_sec = delay_ms / 1000, .tv_nsec = (delay_ms % 1000) * 1000000l},
+        .it_interval = {.tv_sec = interval_ms / 1000, .tv_nsec = (interval_ms % 1000) * 1000000l},
+    };
+
+    return timerfd_settime(source->fd, 0, &spec, NULL);
+}
+
+int event_source_timer_set_absolute(struct event_source *source, uint64_t time_ns)
+{
+    // Zero would disarm the timer, one nanosecond after boot has passed long ago.
+    time_ns = time_ns > 0 ? time_ns : 1;
+    struct itimerspec spec = {
+        .it_value = {.tv_sec = time_ns / 1000000000, .tv_nsec = time_ns % 1000000000},
+    };
+
+    return timerfd_settime(source->fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+struct event_source *event_loop_add_signal(struct event_loop *loop, int signal_number, event_loop_signal_func_t func, void *data)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, signal_number);
+
+    int fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    struct event_source *source = add_source(loop, EVENT_SOURCE_TYPE_SIGNAL, fd, EPOLLIN, data);
+
+    if (source == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    // Only block the signal once it can actually be received through the fd.
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    source->signal_func = func;
+
+    return source;
+}
+
+void event_source_remove(struct event_source *source)
+{
+    if (source->removed)
+    {
+        return;
+    }
+
+    epoll_ctl(source->loop->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+
+    if (source->type != EVENT_SOURCE_TYPE_FD)
+    {
+        close(source->fd);
+    }
+
+    source->removed = true;
+    wl_list_remove(&source->link);
+    wl_list_insert(&source->loop->removed_sources, &source->link);
+}
+
+static void dispatch_source(struct event_source *source, uint32_t events)
+{
+    switch (source->type)
+    {
+    case EVENT_SOURCE_TYPE_FD:
+        source->fd_func(source->data, source->fd, events);
+        break;
+    case EVENT_SOURCE_TYPE_TIMER:
+    {
+        uint64_t expirations = 0;
+
+        // Fails with `EAGAIN` if the timer was rearmed after the event was queued.
+        if (read(source->fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+        {
+            source->timer_func(source->data, expirations);
+        }
+
+        break;
+    }
+    case EVENT_SOURCE_TYPE_SIGNAL:
+    {
+        struct signalfd_siginfo info;
+
+        while (!source->removed && read(source->fd, &info, sizeof(info)) == sizeof(info))
+        {
+            source->signal_func(source->data, info.ssi_signo);
+        }
+
+        break;
+    }
+    }
+}
+
+// Drains the queues in priority order. Only this thread reads into them, so they stay empty until the next read.
+static int dispatch_queues(struct event_loop *loop)
+{
+    for (int i = 0; i < loop->queue_count; ++i)
+    {
+        uint64_t start_time_ns = get_monotonic_time_ns();
+        int count = wl_display_dispatch_queue_pending(loop->display, loop->queues[i]);
+
+        if (count == -1)
+        {
+            return -1;
+        }
+
+        if (count > 0 && loop->queue_stats[i] != NULL)
+        {
+            queue_stats_add(loop->queue_stats[i], count, (start_time_ns - loop->read_time_ns) / 1000);
+        }
+    }
+
+    return wl_display_dispatch_pending(loop->display);
+}
+
+int event_loop_dispatch(struct event_loop *loop, int timeout)
+{
+    struct wl_display *display = loop->display;
+
+    if (display != NULL)
+    {
+        while (wl_display_prepare_read(display) != 0)
+        {
+            if (dispatch_queues(loop) == -1)
+            {
+                return -1;
+            }
+        }
+
+        if (event_loop_flush(loop) == -1)
+        {
+            wl_display_cancel_read(display);
+            return -1;
+        }
+    }
+
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+    int count = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS, timeout);
+
+    if (count == -1)
+    {
+        if (errno != EINTR)
+        {
+            if (display != NULL)
+            {
+                wl_display_cancel_read(display);
+            }
+
+            return -1;
+        }
+
+        count = 0;
+    }
+
+    if (display != NULL)
+    {
+        bool display_readable = false;
+        bool display_writable = false;
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (events[i].data.ptr == NULL)
+            {
+                display_readable = events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP);
+                display_writable = events[i].events & EPOLLOUT;
+            }
+        }
+
+        if (display_writable && loop->flush_blocked)
+        {
+            loop->flush_blocked = false;
+            set_display_events(loop, EPOLLIN);
+
+            if (event_loop_flush(loop) == -1)
+            {
+                wl_display_cancel_read(display);
+                return -1;
+            }
+        }
+
+        if (display_readable)
+        {
+            if (wl_display_read_events(display) == -1)
+            {
+                return -1;
+            }
+
+            loop->read_time_ns = get_monotonic_time_ns();
+        }
+        else
+        {
+            wl_display_cancel_read(display);
+        }
+
+        if (dispatch_queues(loop) == -1)
+        {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        struct event_source *source = events[i].data.ptr;
+
+        if (source != NULL && !source->removed)
+        {
+            dispatch_source(source, events[i].events);
+        }
+    }
+
+    free_removed_sources(loop);
+
+    return 0;
+}
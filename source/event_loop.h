@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <sys/epoll.h>
+
+struct wl_display;
+struct wl_event_queue;
+struct queue_stats;
+struct request_stats;
+struct event_loop;
+struct event_source;
+
+typedef void (*event_loop_fd_func_t)(void *data, int fd, uint32_t events);
+typedef void (*event_loop_timer_func_t)(void *data, uint64_t expirations);
+typedef void (*event_loop_signal_func_t)(void *data, int signal_number);
+
+// Creates an epoll based loop. If `display` is not NULL, the Wayland connection is read, dispatched and flushed as part
+// of every iteration.
+struct event_loop *event_loop_create(struct wl_display *display);
+
+void event_loop_destroy(struct event_loop *loop);
+
+// Registers an additional event queue. Queues are dispatched in the order they were added, all of them before the
+// default queue. `stats` may be NULL.
+int event_loop_add_queue(struct event_loop *loop, struct wl_event_queue *queue, struct queue_stats *stats);
+
+// Flush syscalls and written bytes are added to `stats`, which may be NULL.
+void event_loop_set_request_stats(struct event_loop *loop, struct request_stats *stats);
+
+// Sends all queued requests. If the socket is full, the rest is sent as soon as it becomes writable again. Every
+// iteration flushes before waiting, so this is only needed to mark the end of a batch explicitly.
+int event_loop_flush(struct event_loop *loop);
+
+// Watches an fd owned by the caller. `events` is a mask of `EPOLLIN`, `EPOLLOUT`, ...
+struct event_source *event_loop_add_fd(struct event_loop *loop, int fd, uint32_t events, event_loop_fd_func_t func, void *data);
+
+int event_source_fd_update(struct event_source *source, uint32_t events);
+
+// Adds a disarmed timer backed by a timerfd.
+struct event_source *event_loop_add_timer(struct event_loop *loop, event_loop_timer_func_t func, void *data);
+
+// Arms the timer to fire after `delay_ms` and then every `interval_ms`. A delay of zero disarms it.
+int event_source_timer_update(struct event_source *source, uint32_t delay_ms, uint32_t interval_ms);
+
+// Arms the timer to fire once at `time_ns` on `CLOCK_MONOTONIC`, right away if that has passed. Unlike a delay, this
+// does not drift when the caller was late.
+int event_source_timer_set_absolute(struct event_source *source, uint64_t time_ns);
+
+// Blocks `signal_number` for the calling thread and delivers it through a signalfd instead.
+struct event_source *event_loop_add_signal(struct event_loop *loop, int signal_number, event_loop_signal_func_t func, void *data);
+
+// Safe to call from within any callback, including the source's own.
+void event_source_remove(struct event_source *source);
+
+// Runs a single iteration. Returns -1 if the Wayland connection failed, otherwise 0. A `timeout` of -1 blocks.
+int event_loop_dispatch(struct event_loop *loop, int timeout);
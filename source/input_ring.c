@@ -0,0 +1,68 @@
+#include "input_ring.h"
+
+void pointer_frame_merge(struct pointer_frame *frame, const struct pointer_frame *next)
+{
+    if (next->mask & POINTER_FRAME_MOTION)
+    {
+        frame->x_position = next->x_position;
+        frame->y_position = next->y_position;
+    }
+
+    if (next->mask & POINTER_FRAME_AXIS)
+    {
+        for (int axis = 0; axis < 2; ++axis)
+        {
+            frame->axis_value[axis] += next->axis_value[axis];
+            frame->axis_discrete[axis] += next->axis_discrete[axis];
+
+            // Scrolling after a stop means the axis is moving again.
+            if (next->axis_value[axis] != 0)
+            {
+                frame->axis_stop &= ~(1u << axis);
+            }
+        }
+
+        frame->axis_source = next->axis_source;
+    }
+
+    frame->axis_stop |= next->axis_stop;
+    frame->mask |= next->mask;
+}
+
+void input_ring_init(struct input_ring *ring)
+{
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+bool input_ring_push(struct input_ring *ring, const struct input_event *event)
+{
+    uint_fast32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint_fast32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail == INPUT_RING_CAPACITY)
+    {
+        return false;
+    }
+
+    ring->events[head & (INPUT_RING_CAPACITY - 1)] = *event;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return true;
+}
+
+bool input_ring_pop(struct input_ring *ring, struct input_event *event)
+{
+    uint_fast32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint_fast32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (tail == head)
+    {
+        return false;
+    }
+
+    *event = ring->events[tail & (INPUT_RING_CAPACITY - 1)];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    return true;
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <wayland-client.h>
+#include <xkbcommon/xkbcommon.h>
+
+// Must be a power of two.
+#define INPUT_RING_CAPACITY 256
+
+enum input_event_type
+{
+    INPUT_EVENT_TYPE_POINTER_FRAME,
+    INPUT_EVENT_TYPE_TOUCH_FRAME,
+    INPUT_EVENT_TYPE_KEYBOARD_ENTER,
+    INPUT_EVENT_TYPE_KEYBOARD_LEAVE,
+    INPUT_EVENT_TYPE_KEYBOARD_KEY,
+    // The modifiers or keymap changed while a key was held. Carries that key with its new keysym.
+    INPUT_EVENT_TYPE_KEYBOARD_MODIFIERS,
+    INPUT_EVENT_TYPE_KEYBOARD_REPEAT_INFO,
+};
+
+enum pointer_frame_mask
+{
+    POINTER_FRAME_LEAVE = 1u << 0,
+    POINTER_FRAME_ENTER = 1u << 1,
+    POINTER_FRAME_MOTION = 1u << 2,
+    POINTER_FRAME_BUTTON = 1u << 3,
+    POINTER_FRAME_AXIS = 1u << 4,
+    POINTER_FRAME_AXIS_STOP = 1u << 5,
+};
+
+// Everything that happened within one `wl_pointer.frame`. Handlers apply the parts in the order of the mask bits.
+struct pointer_frame
+{
+    uint32_t mask;
+    // The entered surface.
+    struct wl_surface *surface;
+    uint32_t enter_serial;
+    wl_fixed_t x_position;
+    wl_fixed_t y_position;
+    uint32_t button_serial;
+    uint32_t button;
+    uint32_t button_state;
+    // Indexed by `enum wl_pointer_axis`.
+    wl_fixed_t axis_value[2];
+    int32_t axis_discrete[2];
+    uint32_t axis_source;
+    // Bit per axis that stopped scrolling.
+    uint32_t axis_stop;
+};
+
+// Folds a later frame of only motion and axis data into `frame`.
+void pointer_frame_merge(struct pointer_frame *frame, const struct pointer_frame *next);
+
+// Touch points a single frame can carry. Frames with more changed points are split.
+#define TOUCH_FRAME_CAPACITY 10
+
+enum touch_point_mask
+{
+    TOUCH_POINT_DOWN = 1u << 0,
+    TOUCH_POINT_MOTION = 1u << 1,
+    TOUCH_POINT_UP = 1u << 2,
+};
+
+// Everything that happened to one touch point within a `wl_touch.frame`, applied as down, motion, then up.
+struct touch_frame_point
+{
+    int32_t id;
+    uint32_t mask;
+    // Only set with `TOUCH_POINT_DOWN`.
+    uint32_t serial;
+    struct wl_surface *surface;
+    // Latest position.
+    wl_fixed_t x_position;
+    wl_fixed_t y_position;
+};
+
+struct touch_frame
+{
+    // The compositor took over all touch points. Sent on its own.
+    bool cancel;
+    uint32_t count;
+    struct touch_frame_point points[TOUCH_FRAME_CAPACITY];
+};
+
+// Decoded input event. Everything the handler needs is copied in, so it can be consumed on another thread.
+struct input_event
+{
+    enum input_event_type type;
+    uint32_t serial;
+    // Compositor timestamp in milliseconds, zero for events that do not carry one.
+    uint32_t time;
+    uint64_t decode_time_ns;
+    union
+    {
+        struct pointer_frame pointer_frame;
+        struct touch_frame touch_frame;
+        struct
+        {
+            // The surface that got keyboard focus.
+            struct wl_surface *surface;
+        } focus;
+        struct
+        {
+            uint32_t key;
+            uint32_t state;
+            xkb_keysym_t keysym;
+            bool repeats;
+        } key;
+        struct
+        {
+            int32_t rate;
+            int32_t delay;
+        } repeat_info;
+    };
+};
+
+// Lock-free single-producer/single-consumer queue.
+struct input_ring
+{
+    alignas(64) atomic_uint_fast32_t head;
+    alignas(64) atomic_uint_fast32_t tail;
+    struct input_event events[INPUT_RING_CAPACITY];
+};
+
+void input_ring_init(struct input_ring *ring);
+
+// Producer side. Returns false if the ring is full.
+bool input_ring_push(struct input_ring *ring, const struct input_event *event);
+
+// Consumer side. Returns false if the ring is empty.
+bool input_ring_pop(struct input_ring *ring, struct input_event *event);
@@ -0,0 +1,404 @@
+#include "keymap_cache.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bumped whenever the file layout or the table structs change.
+#define KEYMAP_CACHE_VERSION 2
+// Far above the evdev keycode range. Only bounds what a corrupt file can make the loader allocate.
+#define KEYMAP_CACHE_MAX_KEYS 0x1000
+
+struct keymap_cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t key_size;
+    uint64_t hash;
+    uint32_t text_size;
+    xkb_keycode_t min_keycode;
+    xkb_keycode_t max_keycode;
+    xkb_mod_mask_t caps_lock_mask;
+};
+
+static const char keymap_cache_magic[8] = "wwkeymap";
+
+static bool keymap_table_build_layout(struct keymap_table_layout *layout, struct xkb_keymap *keymap, xkb_keycode_t keycode, xkb_layout_index_t index)
+{
+    xkb_level_index_t level_count = xkb_keymap_num_levels_for_key(keymap, keycode, index);
+
+    if (level_count > KEYMAP_TABLE_MAX_LEVELS)
+    {
+        return false;
+    }
+
+    layout->level_count = level_count;
+
+    for (xkb_level_index_t level = 0; level < level_count; ++level)
+    {
+        const xkb_keysym_t *syms;
+        int count = xkb_keymap_key_get_syms_by_level(keymap, keycode, index, level, &syms);
+        layout->syms[level] = count == 1 ? syms[0] : XKB_KEY_NoSymbol;
+
+        xkb_mod_mask_t masks[KEYMAP_TABLE_MAX_ENTRIES];
+        size_t mask_count = xkb_keymap_key_get_mods_for_level(keymap, keycode, index, level, masks, KEYMAP_TABLE_MAX_ENTRIES);
+
+        for (size_t i = 0; i < mask_count; ++i)
+        {
+            if (layout->entry_count == KEYMAP_TABLE_MAX_ENTRIES)
+            {
+                return false;
+            }
+
+            // The type's modifier mask is not exposed. The union of its entries misses modifiers the type only masks
+            // out without mapping them, and which modifiers it preserves is not known either. Keys where that makes a
+            // difference are found by `keymap_table_verify`.
+            layout->type_mask |= masks[i];
+            layout->entries[layout->entry_count] = (struct keymap_table_entry) {masks[i], level};
+            layout->entry_count += 1;
+        }
+    }
+
+    return true;
+}
+
+static void keymap_table_init_relevant_mods(struct keymap_table *table)
+{
+    table->relevant_mods = table->caps_lock_mask;
+
+    for (xkb_keycode_t keycode = table->min_keycode; keycode <= table->max_keycode; ++keycode)
+    {
+        const struct keymap_table_key *key = &table->keys[keycode - table->min_keycode];
+
+        for (uint32_t layout = 0; layout < key->layout_count; ++layout)
+        {
+            table->relevant_mods |= key->layouts[layout].type_mask;
+        }
+    }
+}
+
+// Compares every key in every layout against xkb for all combinations of the real modifiers, which are what
+// compositors send. Keys that differ, because of modifiers missing from `type_mask`, preserved modifiers or layouts that
+// are clamped or redirected instead of wrapped, become fallback keys.
+static bool keymap_table_verify(struct keymap_table *table, struct xkb_keymap *keymap)
+{
+    struct xkb_state *state = xkb_state_new(keymap);
+
+    if (state == NULL)
+    {
+        return false;
+    }
+
+    xkb_mod_index_t mod_count = xkb_keymap_num_mods(keymap);
+    xkb_mod_mask_t real_mods = mod_count >= 8 ? 0xff : (1u << mod_count) - 1;
+    xkb_layout_index_t layout_count = xkb_keymap_num_layouts(keymap);
+
+    for (xkb_layout_index_t layout = 0; layout < layout_count; ++layout)
+    {
+        xkb_mod_mask_t mods = 0;
+
+        // Visits every subset of `real_mods`, starting and ending with none.
+        do
+        {
+            xkb_state_update_mask(state, mods, 0, 0, 0, 0, layout);
+
+            for (xkb_keycode_t keycode = table->min_keycode; keycode <= table->max_keycode; ++keycode)
+            {
+                struct keymap_table_key *key = &table->keys[keycode - table->min_keycode];
+
+                if (!key->fallback && keymap_table_key_get_sym(table, key, mods, layout) != xkb_state_key_get_one_sym(state, keycode))
+                {
+                    key->fallback = true;
+                    key->layout_count = 0;
+                    table->incomplete = true;
+                }
+            }
+
+            mods = (mods - real_mods) & real_mods;
+        } while (mods != 0);
+    }
+
+    xkb_state_unref(state);
+
+    return true;
+}
+
+bool keymap_table_build(struct keymap_table *table, struct xkb_keymap *keymap)
+{
+    xkb_keycode_t min_keycode = xkb_keymap_min_keycode(keymap);
+    xkb_keycode_t max_keycode = xkb_keymap_max_keycode(keymap);
+    struct keymap_table_key *keys = calloc(max_keycode - min_keycode + 1, sizeof(struct keymap_table_key));
+
+    if (keys == NULL)
+    {
+        return false;
+    }
+
+    memset(table, 0, sizeof(struct keymap_table));
+    table->min_keycode = min_keycode;
+    table->max_keycode = max_keycode;
+    table->keys = keys;
+
+    xkb_mod_index_t caps_lock = xkb_keymap_mod_get_index(keymap, XKB_MOD_NAME_CAPS);
+    table->caps_lock_mask = caps_lock != XKB_MOD_INVALID ? 1u << caps_lock : 0;
+
+    for (xkb_keycode_t keycode = min_keycode; keycode <= max_keycode; ++keycode)
+    {
+        struct keymap_table_key *key = &keys[keycode - min_keycode];
+        xkb_layout_index_t layout_count = xkb_keymap_num_layouts_for_key(keymap, keycode);
+        key->repeats = xkb_keymap_key_repeats(keymap, keycode);
+        key->fallback = layout_count > KEYMAP_TABLE_MAX_LAYOUTS;
+
+        for (xkb_layout_index_t layout = 0; layout < layout_count && !key->fallback; ++layout)
+        {
+            key->fallback = !keymap_table_build_layout(&key->layouts[layout], keymap, keycode, layout);
+        }
+
+        key->layout_count = key->fallback ? 0 : layout_count;
+        table->incomplete |= key->fallback;
+    }
+
+    if (!keymap_table_verify(table, keymap))
+    {
+        keymap_table_release(table);
+        return false;
+    }
+
+    keymap_table_init_relevant_mods(table);
+
+    return true;
+}
+
+void keymap_table_release(struct keymap_table *table)
+{
+    for (int i = 0; i < KEYMAP_TABLE_SYMS_SLOTS; ++i)
+    {
+        free(table->syms[i].syms);
+    }
+
+    free(table->keys);
+    memset(table, 0, sizeof(struct keymap_table));
+}
+
+const struct keymap_table_key *keymap_table_get_key(const struct keymap_table *table, xkb_keycode_t keycode)
+{
+    if (table->keys == NULL || keycode < table->min_keycode || keycode > table->max_keycode)
+    {
+        return NULL;
+    }
+
+    return &table->keys[keycode - table->min_keycode];
+}
+
+xkb_keysym_t keymap_table_key_get_sym(const struct keymap_table *table, const struct keymap_table_key *key, xkb_mod_mask_t mods, xkb_layout_index_t layout)
+{
+    if (key->layout_count == 0)
+    {
+        return XKB_KEY_NoSymbol;
+    }
+
+    // Out of range layouts wrap around, which is the xkb default. Keys that clamp or redirect them instead are fallback
+    // keys, see `keymap_table_verify`.
+    const struct keymap_table_layout *key_layout = &key->layouts[layout % key->layout_count];
+    xkb_mod_mask_t relevant = mods & key_layout->type_mask;
+    xkb_level_index_t level = 0;
+
+    for (uint32_t i = 0; i < key_layout->entry_count; ++i)
+    {
+        if (key_layout->entries[i].mods == relevant)
+        {
+            level = key_layout->entries[i].level;
+            break;
+        }
+    }
+
+    if (level >= key_layout->level_count)
+    {
+        return XKB_KEY_NoSymbol;
+    }
+
+    xkb_keysym_t sym = key_layout->syms[level];
+
+    // Caps Lock capitalizes keys whose type does not consume it.
+    if ((mods & table->caps_lock_mask) && !(key_layout->type_mask & table->caps_lock_mask))
+    {
+        sym = xkb_keysym_to_upper(sym);
+    }
+
+    return sym;
+}
+
+const xkb_keysym_t *keymap_table_get_syms(struct keymap_table *table, xkb_mod_mask_t mods, xkb_layout_index_t layout)
+{
+    mods &= table->relevant_mods;
+
+    for (int i = 0; i < KEYMAP_TABLE_SYMS_SLOTS; ++i)
+    {
+        if (table->syms[i].syms != NULL && table->syms[i].mods == mods && table->syms[i].layout == layout)
+        {
+            return table->syms[i].syms;
+        }
+    }
+
+    // Slots are reused round robin. Only a handful of combinations are common, like none, Shift and Caps Lock.
+    struct keymap_table_syms *slot = &table->syms[table->next_syms_slot];
+    table->next_syms_slot = (table->next_syms_slot + 1) % KEYMAP_TABLE_SYMS_SLOTS;
+
+    size_t count = table->max_keycode - table->min_keycode + 1;
+
+    if (slot->syms == NULL)
+    {
+        slot->syms = malloc(count * sizeof(xkb_keysym_t));
+
+        if (slot->syms == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    slot->mods = mods;
+    slot->layout = layout;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const struct keymap_table_key *key = &table->keys[i];
+        slot->syms[i] = key->fallback ? KEYMAP_TABLE_SYM_FALLBACK : keymap_table_key_get_sym(table, key, mods, layout);
+    }
+
+    return slot->syms;
+}
+
+// Lookups index the layouts, levels and entries by these counts, so a corrupt file must not exceed the arrays.
+static bool keymap_cache_keys_valid(const struct keymap_table_key *keys, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        // A cached table must stand on its own, see `keymap_table.incomplete`.
+        if (keys[i].fallback || keys[i].layout_count > KEYMAP_TABLE_MAX_LAYOUTS)
+        {
+            return false;
+        }
+
+        for (uint32_t layout = 0; layout < keys[i].layout_count; ++layout)
+        {
+            if (keys[i].layouts[layout].level_count > KEYMAP_TABLE_MAX_LEVELS || keys[i].layouts[layout].entry_count > KEYMAP_TABLE_MAX_ENTRIES)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static int keymap_cache_path(char *buffer, size_t size, uint64_t hash)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "keymap-%016" PRIx64 ".bin", hash);
+    return get_cache_path(buffer, size, name);
+}
+
+bool keymap_cache_load(struct keymap_table *table, uint64_t hash, uint32_t text_size)
+{
+    char path[PATH_MAX];
+
+    if (keymap_cache_path(path, sizeof(path), hash) == -1)
+    {
+        return false;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    struct keymap_cache_header header;
+    struct keymap_table_key *keys = NULL;
+    struct stat file_stat;
+    bool loaded = false;
+
+    // Anything that does not match exactly makes the caller compile the keymap instead.
+    if (fstat(fd, &file_stat) == 0 && read(fd, &header, sizeof(header)) == sizeof(header) &&
+        memcmp(header.magic, keymap_cache_magic, sizeof(header.magic)) == 0 && header.version == KEYMAP_CACHE_VERSION &&
+        header.key_size == sizeof(struct keymap_table_key) && header.hash == hash && header.text_size == text_size &&
+        header.min_keycode <= header.max_keycode && (size_t) header.max_keycode - header.min_keycode < KEYMAP_CACHE_MAX_KEYS)
+    {
+        size_t count = (size_t) header.max_keycode - header.min_keycode + 1;
+        size_t keys_size = count * sizeof(struct keymap_table_key);
+
+        if ((uint64_t) file_stat.st_size == sizeof(header) + keys_size)
+        {
+            keys = malloc(keys_size);
+            loaded = keys != NULL && read(fd, keys, keys_size) == (ssize_t) keys_size && keymap_cache_keys_valid(keys, count);
+        }
+    }
+
+    close(fd);
+
+    if (!loaded)
+    {
+        free(keys);
+        return false;
+    }
+
+    memset(table, 0, sizeof(struct keymap_table));
+    table->min_keycode = header.min_keycode;
+    table->max_keycode = header.max_keycode;
+    table->caps_lock_mask = header.caps_lock_mask;
+    table->keys = keys;
+    keymap_table_init_relevant_mods(table);
+
+    return true;
+}
+
+bool keymap_cache_store(const struct keymap_table *table, uint64_t hash, uint32_t text_size)
+{
+    char path[PATH_MAX];
+    char temporary_path[PATH_MAX + 16];
+
+    // Tables the loader would reject are not written in the first place.
+    if (table->incomplete || (size_t) table->max_keycode - table->min_keycode >= KEYMAP_CACHE_MAX_KEYS || keymap_cache_path(path, sizeof(path), hash) == -1)
+    {
+        return false;
+    }
+
+    // Written under a unique name and renamed, so concurrent instances never see a partial file.
+    snprintf(temporary_path, sizeof(temporary_path), "%s.%d", path, (int) getpid());
+    int fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    struct keymap_cache_header header = {
+        .version = KEYMAP_CACHE_VERSION,
+        .key_size = sizeof(struct keymap_table_key),
+        .hash = hash,
+        .text_size = text_size,
+        .min_keycode = table->min_keycode,
+        .max_keycode = table->max_keycode,
+        .caps_lock_mask = table->caps_lock_mask,
+    };
+    memcpy(header.magic, keymap_cache_magic, sizeof(header.magic));
+
+    size_t keys_size = ((size_t) table->max_keycode - table->min_keycode + 1) * sizeof(struct keymap_table_key);
+    bool written = write(fd, &header, sizeof(header)) == sizeof(header) && write(fd, table->keys, keys_size) == (ssize_t) keys_size;
+    close(fd);
+
+    if (!written || rename(temporary_path, path) == -1)
+    {
+        unlink(temporary_path);
+        return false;
+    }
+
+    return true;
+}
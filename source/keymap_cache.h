@@ -0,0 +1,86 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <xkbcommon/xkbcommon.h>
+
+#define KEYMAP_TABLE_MAX_LAYOUTS 4
+#define KEYMAP_TABLE_MAX_LEVELS 8
+#define KEYMAP_TABLE_MAX_ENTRIES 8
+// Number of modifier and layout combinations whose flat keysym arrays are kept around.
+#define KEYMAP_TABLE_SYMS_SLOTS 4
+
+// Marks keys in flat keysym arrays that have to be looked up through xkb. Not a valid keysym.
+#define KEYMAP_TABLE_SYM_FALLBACK 0xffffffffu
+
+// Modifier combination of the key type that selects a level.
+struct keymap_table_entry
+{
+    xkb_mod_mask_t mods;
+    xkb_level_index_t level;
+};
+
+struct keymap_table_layout
+{
+    // Modifiers of the key type's entries. Keys whose type looks at others as well are fallback keys.
+    xkb_mod_mask_t type_mask;
+    uint32_t level_count;
+    uint32_t entry_count;
+    // `XKB_KEY_NoSymbol` for levels with zero or several keysyms, like `xkb_state_key_get_one_sym`.
+    xkb_keysym_t syms[KEYMAP_TABLE_MAX_LEVELS];
+    struct keymap_table_entry entries[KEYMAP_TABLE_MAX_ENTRIES];
+};
+
+struct keymap_table_key
+{
+    uint32_t layout_count;
+    uint32_t repeats;
+    // Set if the key does not fit into the table and has to be looked up through xkb.
+    uint32_t fallback;
+    struct keymap_table_layout layouts[KEYMAP_TABLE_MAX_LAYOUTS];
+};
+
+// Keysym of every key for one combination of modifiers and layout, indexed by `keycode - min_keycode`.
+struct keymap_table_syms
+{
+    xkb_mod_mask_t mods;
+    xkb_layout_index_t layout;
+    xkb_keysym_t *syms;
+};
+
+// Everything needed to translate keycodes without a compiled keymap.
+struct keymap_table
+{
+    xkb_keycode_t min_keycode;
+    xkb_keycode_t max_keycode;
+    xkb_mod_mask_t caps_lock_mask;
+    // Modifiers that affect any key. Others are masked out before looking up flat arrays.
+    xkb_mod_mask_t relevant_mods;
+    // Set if any key needs the fallback. Such tables are not cached, since a cached table must stand on its own.
+    bool incomplete;
+    struct keymap_table_key *keys;
+    struct keymap_table_syms syms[KEYMAP_TABLE_SYMS_SLOTS];
+    uint32_t next_syms_slot;
+};
+
+bool keymap_table_build(struct keymap_table *table, struct xkb_keymap *keymap);
+
+void keymap_table_release(struct keymap_table *table);
+
+// Returns NULL for keys outside the keymap.
+const struct keymap_table_key *keymap_table_get_key(const struct keymap_table *table, xkb_keycode_t keycode);
+
+// Resolves the keysym the way `xkb_state_key_get_one_sym` does, given effective modifiers and layout. Not valid for
+// fallback keys.
+xkb_keysym_t keymap_table_key_get_sym(const struct keymap_table *table, const struct keymap_table_key *key, xkb_mod_mask_t mods, xkb_layout_index_t layout);
+
+// Returns the flat keysym array for the given effective modifiers and layout, building it if it is not one of the
+// recently used ones. Call it when the modifiers change, so translating a key is a single array index. NULL if out of
+// memory.
+const xkb_keysym_t *keymap_table_get_syms(struct keymap_table *table, xkb_mod_mask_t mods, xkb_layout_index_t layout);
+
+// Loads the table cached for the keymap text with the given hash and size. Returns false on a miss.
+bool keymap_cache_load(struct keymap_table *table, uint64_t hash, uint32_t text_size);
+
+bool keymap_cache_store(const struct keymap_table *table, uint64_t hash, uint32_t text_size);
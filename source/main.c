@@ -1,14 +1,33 @@
 #include "utils.h"
+#include "canvas.h"
+#include "compose_cache.h"
+#include "cursor.h"
+#include "decor.h"
+#include "event_loop.h"
+#include "input_ring.h"
+#include "keymap_cache.h"
+#include "reader_thread.h"
+#include "request_counter.h"
+#include "shm_pool.h"
+#include "stats.h"
+#include "swapchain.h"
 #include "extensions/xdg-shell-client-protocol.h"
+#include "fractional-scale-v1-client-protocol.h"
+#include "presentation-time-client-protocol.h"
+#include "viewporter-client-protocol.h"
 
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <math.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <time.h>
 #include <unistd.h>
@@ -17,36 +36,96 @@
 #include <wayland-cursor.h>
 #include <xkbcommon/xkbcommon.h>
 
-const uint32_t BORDER_WIDTH = 5;
-const uint32_t TITLEBAR_WIDTH = 30;
-
-enum cursor_decor_position
-{
-    CURSOR_DECOR_POSITION_TOP_BORDER = 1u << 0,
-    CURSOR_DECOR_POSITION_BOTTOM_BORDER = 1u << 1,
-    CURSOR_DECOR_POSITION_LEFT_BORDER = 1u << 2,
-    CURSOR_DECOR_POSITION_RIGHT_BORDER = 1u << 3,
-    CURSOR_DECOR_POSITION_TOP_LEFT_CORNER = 1u << 4,
-    CURSOR_DECOR_POSITION_TOP_RIGHT_CORNER = 1u << 5,
-    CURSOR_DECOR_POSITION_BOTTOM_LEFT_CORNER = 1u << 6,
-    CURSOR_DECOR_POSITION_BOTTOM_RIGHT_CORNER = 1u << 7,
-    CURSOR_DECOR_POSITION_TITLEBAR = 1u << 8,
-    CURSOR_DECOR_POSITION_CLOSE_BUTTON = 1u << 9,
+// Identifies the input behind a frame, see `input_latency_stats`.
+struct input_tag
+{
+    // Compositor timestamp in milliseconds.
+    uint32_t time;
+    uint64_t arrival_ns;
+    uint64_t handled_ns;
+};
+
+// A bound `wl_output`, tracked for its scale.
+struct output
+{
+    struct wayland_client *client;
+    struct wl_output *wl_output;
+    uint32_t name;
+    int32_t scale;
+    // Applied on `done`, so the scale only changes once per batch of output events.
+    int32_t pending_scale;
+    struct wl_list link;
 };
 
-enum cursor_variant
-{
-    CURSOR_VARIANT_LEFT_PTR,
-    CURSOR_VARIANT_POINTER,
-    CURSOR_VARIANT_N_RESIZE,
-    CURSOR_VARIANT_S_RESIZE,
-    CURSOR_VARIANT_W_RESIZE,
-    CURSOR_VARIANT_E_RESIZE,
-    CURSOR_VARIANT_NW_RESIZE,
-    CURSOR_VARIANT_NE_RESIZE,
-    CURSOR_VARIANT_SW_RESIZE,
-    CURSOR_VARIANT_SE_RESIZE,
-    CURSOR_VARIANT_COUNT,
+// Outputs a single window can be on at once. Further ones are ignored for its scale.
+#define WINDOW_MAX_OUTPUTS 8
+
+// A toplevel with its decor. Everything else, including the buffers' memory, is shared through the client.
+struct window
+{
+    struct wayland_client *client;
+    struct wl_list link;
+    struct wl_surface *surface;
+    // Wrapper of the surface on the render queue, for frame callbacks and presentation feedback.
+    struct wl_surface *render_surface;
+    struct xdg_surface *xdg_surface;
+    struct xdg_toplevel *xdg_toplevel;
+    // Only created if both fractional scaling and viewports are supported. The scale of the outputs is ignored then.
+    struct wp_fractional_scale_v1 *fractional_scale;
+    // Content
+    struct swapchain swapchain;
+    struct
+    {
+        struct wl_callback *callback;
+        // Needs a new frame once the pending frame callback is done.
+        bool dirty;
+        // Oldest input waiting for the next frame, zero if the frame is not caused by input.
+        struct input_tag tag;
+        // Scale and logical size last applied to the surface.
+        int32_t scale;
+        int32_t width;
+        int32_t height;
+        struct wp_viewport *viewport;
+    } content;
+    struct
+    {
+        // Canvas position of the top left content pixel.
+        double x_position;
+        double y_position;
+        // Pixels per millisecond of finger scrolling, carried on after the fingers are lifted.
+        double x_velocity;
+        double y_velocity;
+        uint32_t time;
+        bool kinetic;
+        uint32_t frame_time;
+    } scroll;
+    // Only decor
+    struct
+    {
+        struct wl_surface *surface;
+        struct wl_subsurface *subsurface;
+        // Size the input and opaque regions were last set for.
+        int32_t width;
+        int32_t height;
+        int32_t scale;
+        struct wp_viewport *viewport;
+    } decor;
+    // Outputs the content or decor surface is on, with the number of those surfaces on each.
+    struct
+    {
+        struct output *output;
+        int surfaces;
+    } outputs[WINDOW_MAX_OUTPUTS];
+    // Stored values
+    int32_t width;
+    int32_t height;
+    // Buffers are drawn at this scale, see `SCALE_DENOMINATOR`. Either the preferred fractional scale or the largest
+    // scale of the outputs the window is on.
+    int32_t scale;
+    // Acked and committed a first configure. Nothing may be committed before.
+    bool configured;
+    // Destroyed after the current dispatch, while input events may still refer to it.
+    bool closed;
 };
 
 struct wayland_client
@@ -59,531 +138,2473 @@ struct wayland_client
     struct xdg_wm_base *xdg_wm_base;
     struct wl_seat *seat;
     struct wl_subcompositor *subcompositor;
+    struct wp_cursor_shape_manager_v1 *cursor_shape_manager;
+    struct wp_presentation *presentation;
+    uint32_t presentation_clock;
+    struct wp_viewporter *viewporter;
+    struct wp_fractional_scale_manager_v1 *fractional_scale_manager;
+    struct wl_list outputs;
+    // Marks the end of the initial globals, NULL once done.
+    struct wl_callback *globals_callback;
+    struct event_loop *loop;
+    // Seat objects are dispatched before everything else. Configure and frame events go to the render queue.
+    struct wl_event_queue *input_queue;
+    struct wl_event_queue *render_queue;
+    // Threaded mode
+    struct reader_thread *reader_thread;
+    struct input_ring input_ring;
+    int input_event_fd;
+    bool input_pending;
+    // Signalled by the render thread after popping events while the reader thread waits for room in the ring.
+    int input_space_fd;
+    atomic_bool input_waiting;
+    // Pointer frame the reader thread holds back while the ring is full. Later pointer frames are merged into it.
+    struct input_event input_overflow;
+    bool input_overflow_pending;
+    struct input_ring_stats input_ring_stats;
+    // Windows, all of them drawing into the same pool.
+    struct wl_list windows;
+    int window_count;
+    struct shm_pool shm_pool;
     // Objects
-    struct wl_surface *surface;
-    struct xdg_surface *xdg_surface;
-    struct xdg_toplevel *xdg_toplevel;
     struct wl_pointer *pointer;
+    struct wl_touch *touch;
     struct wl_surface *cursor_surface;
-    struct wl_cursor_image *cursor_images[CURSOR_VARIANT_COUNT];
-    struct wl_buffer *cursor_buffers[CURSOR_VARIANT_COUNT];
+    struct wp_cursor_shape_device_v1 *cursor_shape_device;
+    struct cursor_loader *cursor_loader;
+    struct event_source *cursor_loader_source;
+    int cursor_loader_fd;
+    struct cursor_cache cursors;
+    struct
+    {
+        struct event_source *timer;
+        struct wl_cursor *cursor;
+        struct wl_buffer **buffers;
+        uint64_t start_time_ns;
+        int frame;
+    } cursor_animation;
     struct wl_keyboard *keyboard;
     struct xkb_context *xkb_context;
     struct xkb_state *xkb_state;
-    // Only decor
+    // The keymap is only compiled once it is needed.
+    int pending_keymap_fd;
+    uint32_t pending_keymap_size;
+    // Translates keys without xkb. The state is only created for keymaps that had to be compiled.
+    struct keymap_table keymap_table;
+    xkb_mod_mask_t keyboard_mods;
+    xkb_layout_index_t keyboard_layout;
+    // Masks of the last modifiers event, applied to the state of every newly compiled keymap.
     struct
     {
-        struct wl_surface *titlebar_surface;
-        struct wl_subsurface *titlebar_subsurface;
-        struct wl_surface *close_button_surface;
-        struct wl_subsurface *close_button_subsurface;
-        struct wl_surface *border_top_surface;
-        struct wl_subsurface *border_top_subsurface;
-        struct wl_surface *border_bottom_surface;
-        struct wl_subsurface *border_bottom_subsurface;
-        struct wl_surface *border_left_surface;
-        struct wl_subsurface *border_left_subsurface;
-        struct wl_surface *border_right_surface;
-        struct wl_subsurface *border_right_subsurface;
-        struct wl_surface *corner_top_left_surface;
-        struct wl_subsurface *corner_top_left_subsurface;
-        struct wl_surface *corner_top_right_surface;
-        struct wl_subsurface *corner_top_right_subsurface;
-        struct wl_surface *corner_bottom_left_surface;
-        struct wl_subsurface *corner_bottom_left_subsurface;
-        struct wl_surface *corner_bottom_right_surface;
-        struct wl_subsurface *corner_bottom_right_subsurface;
-    } decor;
-
-
-
+        xkb_mod_mask_t depressed;
+        xkb_mod_mask_t latched;
+        xkb_mod_mask_t locked;
+    } keyboard_mod_masks;
+    // Last pressed key that repeats, owned by the thread dispatching the seat objects. Its keysym is resolved again
+    // whenever the modifiers or the keymap change, so that a repeating key follows them.
+    uint32_t keyboard_held_key;
+    bool keyboard_key_held;
+    // Keysyms for the current modifiers and layout, see `keymap_table_get_syms`.
+    const xkb_keysym_t *keyboard_syms;
+    // Compose sequences, owned by the thread handling input. The table is loaded on the first key press.
+    struct
+    {
+        struct compose_table table;
+        struct compose_state state;
+        bool loaded;
+    } compose;
+    struct
+    {
+        struct event_source *timer;
+        // Repeats per second, zero disables repeat.
+        int32_t rate;
+        int32_t delay;
+        // The pressed key that is currently repeating.
+        struct input_event event;
+        // When the press was decoded. Repeat `n` is due at this time plus the delay and `n` intervals, however late the
+        // thread handling input gets to it.
+        uint64_t start_time_ns;
+        // Next repeat to deliver.
+        uint64_t index;
+        bool active;
+    } key_repeat;
+    // Pointer events of the current `wl_pointer.frame`, owned by the thread dispatching the seat objects.
+    struct input_event pointer_accumulator;
+    // Touch events of the current `wl_touch.frame`, owned by the thread dispatching the seat objects.
+    struct input_event touch_accumulator;
+    // Touch points currently down. Points beyond the capacity are ignored.
+    struct
+    {
+        bool active;
+        int32_t id;
+        struct window *window;
+        struct wl_surface *surface;
+        wl_fixed_t x_position;
+        wl_fixed_t y_position;
+        const struct decor_role_descriptor *role;
+    } touch_points[TOUCH_FRAME_CAPACITY];
+    // Frames of only motion and axis data are held back until the next display frame if enabled.
+    struct
+    {
+        bool enabled;
+        struct input_event pending;
+        // Window whose next content frame flushes the batch, NULL if none is pending.
+        struct window *window;
+        // Flushes the batch if that frame does not come in time or no frame is pending at all.
+        struct event_source *timer;
+    } pointer_batch;
     // Stored values
-    int32_t width;
-    int32_t height;
     wl_fixed_t pointer_x_position;
     wl_fixed_t pointer_y_position;
+    // Cursor the pointer should currently show, applied late if cursors were not loaded yet.
+    bool pointer_inside;
+    uint32_t pointer_enter_serial;
+    enum cursor_variant cursor_variant;
     bool should_close;
-    enum cursor_decor_position cursor_decor_position;
+    // Focus, NULL while it is on no window of this client.
+    struct window *pointer_window;
+    struct window *keyboard_window;
+    struct wl_surface *pointer_surface;
+    // Role of the decor part the pointer is over, NULL while it is outside the window.
+    const struct decor_role_descriptor *pointer_role;
+    // Input currently being handled, zero outside of input handling.
+    struct input_tag input_tag;
+    // Statistics
+    struct latency_histogram input_queue_latency;
+    struct latency_histogram input_age_latency;
+    struct queue_stats input_queue_stats;
+    struct queue_stats render_queue_stats;
+    struct request_stats request_stats;
+    struct startup_stats startup_stats;
+    struct pointer_stats pointer_stats;
+    struct content_stats content_stats;
+    struct keymap_stats keymap_stats;
+    struct input_latency_stats input_latency_stats;
 };
 
 // ####################################################################################################################
 // Helpers
 
+static void cursors_load(struct wayland_client *client);
+static void pointer_batch_flush(struct wayland_client *client);
+
+// Returns a wrapper of `proxy` that creates its new objects on `queue`. Moving an object to another queue after
+// creating it races with the reader thread, which may already have queued its first events on the default queue.
+static void *proxy_wrap(void *proxy, struct wl_event_queue *queue)
+{
+    struct wl_proxy *wrapper = wl_proxy_create_wrapper(proxy);
+
+    if (wrapper != NULL)
+    {
+        wl_proxy_set_queue(wrapper, queue);
+    }
+
+    return wrapper;
+}
+
 // ####################################################################################################################
 // Buffer
 
+// Single use buffer, freed once the compositor is done with it.
+struct pool_buffer
+{
+    struct shm_pool *pool;
+    struct shm_allocation allocation;
+};
+
 static void wl_buffer_release(void *data, struct wl_buffer *buffer)
 {
+    struct pool_buffer *pool_buffer = data;
     wl_buffer_destroy(buffer);
+    shm_pool_free(pool_buffer->pool, &pool_buffer->allocation);
+    free(pool_buffer);
 }
 
 static const struct wl_buffer_listener buffer_listener = {
     .release = wl_buffer_release,
 };
 
-static struct wl_buffer *buffer_draw(struct wl_shm *shm, int32_t width, int32_t height, uint32_t color)
+struct buffer_description
 {
-    int32_t stride = width * 4;
-    int32_t size = stride * height;
-
-    int fd = allocate_shm_file(size);
+    // Logical size, the buffer is scaled by `scale`.
+    int32_t width;
+    int32_t height;
+    int32_t scale;
+    uint32_t color;
+    // Paints the buffer instead of filling it with `color` if not NULL.
+    void (*draw)(uint32_t *pixels, int32_t width, int32_t height, int32_t scale);
+    struct wl_buffer *buffer;
+};
 
-    if (fd == -1)
+// Draws all buffers of a frame into the shared pool, so a frame costs no shm file and no fd transfer.
+static bool buffers_draw(struct wayland_client *client, struct buffer_description *buffers, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
     {
-        return NULL;
-    }
+        int32_t width = scale_length(buffers[i].width, buffers[i].scale);
+        int32_t height = scale_length(buffers[i].height, buffers[i].scale);
+        int32_t stride = width * 4;
+        struct pool_buffer *pool_buffer = malloc(sizeof(struct pool_buffer));
 
-    uint32_t *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (pool_buffer == NULL || !shm_pool_alloc(&client->shm_pool, (size_t) stride * height, &pool_buffer->allocation))
+        {
+            free(pool_buffer);
 
-    if (data == MAP_FAILED)
-    {
-        close(fd);
-        return NULL;
-    }
+            // Buffers of the frame that were already drawn are never attached.
+            for (size_t j = 0; j < i; ++j)
+            {
+                wl_buffer_release(wl_buffer_get_user_data(buffers[j].buffer), buffers[j].buffer);
+            }
 
-    struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
-    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, WL_SHM_FORMAT_ARGB8888);
-    wl_shm_pool_destroy(pool);
-    close(fd);
+            return false;
+        }
 
-    for (int y = 0; y < height; ++y)
-    {
-        for (int x = 0; x < width; ++x)
+        pool_buffer->pool = &client->shm_pool;
+        buffers[i].buffer = shm_pool_create_buffer(&pool_buffer->allocation, width, height, stride, WL_SHM_FORMAT_ARGB8888);
+        wl_buffer_add_listener(buffers[i].buffer, &buffer_listener, pool_buffer);
+
+        uint32_t *pixels = pool_buffer->allocation.data;
+
+        if (buffers[i].draw != NULL)
         {
-            data[y * width + x] = color;
+            buffers[i].draw(pixels, buffers[i].width, buffers[i].height, buffers[i].scale);
+        }
+        else
+        {
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    pixels[y * width + x] = buffers[i].color;
+                }
+            }
         }
     }
 
-    munmap(data, size);
-    wl_buffer_add_listener(buffer, &buffer_listener, NULL);
-
-    return buffer;
+    return true;
 }
 
 // ####################################################################################################################
-// XDG Toplevel
+// Content
 
-static void xdg_toplevel_configure(void *data, struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height, struct wl_array *states)
-{
-    struct wayland_client *client = data;
+static const struct wl_callback_listener content_frame_listener;
 
-    if (width == 0 || height == 0)
+// With a viewport the buffer is stretched over the logical size, otherwise the scale must be an integer.
+static void surface_apply_scale(struct wl_surface *surface, struct wp_viewport *viewport, int32_t scale, int32_t width, int32_t height)
+{
+    if (viewport != NULL)
     {
-        return;
+        wp_viewport_set_destination(viewport, width, height);
+    }
+    else
+    {
+        wl_surface_set_buffer_scale(surface, scale / SCALE_DENOMINATOR);
     }
-
-    client->width = width;
-    client->height = height;
 }
 
-static void xdg_toplevel_close(void *data, struct xdg_toplevel *xdg_toplevel)
+struct content_feedback
 {
-    struct wayland_client *client = data;
-    client->should_close = true;
-}
+    struct wayland_client *client;
+    struct input_tag tag;
+    uint64_t commit_ns;
+};
 
-static void xdg_toplevel_configure_bounds(void *data, struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height)
+static void content_feedback_sync_output(void *data, struct wp_presentation_feedback *feedback, struct wl_output *output)
 {
 }
 
-static const struct xdg_toplevel_listener xdg_toplevel_listener = {
-    .configure = xdg_toplevel_configure,
-    .close = xdg_toplevel_close,
-    .configure_bounds = xdg_toplevel_configure_bounds,
-};
+static void content_feedback_presented(void *data, struct wp_presentation_feedback *feedback, uint32_t tv_sec_hi, uint32_t tv_sec_lo,
+                                       uint32_t tv_nsec, uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo, uint32_t flags)
+{
+    struct content_feedback *content_feedback = data;
+    struct wayland_client *client = content_feedback->client;
+    struct input_latency_stats *stats = &client->input_latency_stats;
 
-// ####################################################################################################################
-// XDG Surface
+    // Timestamps on other clocks cannot be compared with ours.
+    if (client->presentation_clock == CLOCK_MONOTONIC)
+    {
+        uint64_t present_ns = (((uint64_t) tv_sec_hi << 32 | tv_sec_lo) * 1000000000) + tv_nsec;
+        uint32_t present_ms = present_ns / 1000000;
+        const struct input_tag *tag = &content_feedback->tag;
 
-static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial)
-{
-    struct wayland_client *client = data;
-    xdg_surface_ack_configure(xdg_surface, serial);
+        latency_histogram_add(&stats->commit_to_present, (present_ns - content_feedback->commit_ns) / 1000);
+        latency_histogram_add(&stats->arrival_to_present, (present_ns - tag->arrival_ns) / 1000);
 
-    uint32_t border_color = 0xffaaaaaa;
+        if (tag->time != 0)
+        {
+            latency_histogram_add(&stats->timestamp_to_present, (uint64_t) (uint32_t) (present_ms - tag->time) * 1000);
+        }
+    }
 
-    // Titlebar
+    wp_presentation_feedback_destroy(feedback);
+    free(content_feedback);
+}
 
-    struct wl_buffer *decor_buffer_titlebar = buffer_draw(client->shm, client->width - 2 * BORDER_WIDTH, TITLEBAR_WIDTH, 0xff666666);
+static void content_feedback_discarded(void *data, struct wp_presentation_feedback *feedback)
+{
+    struct content_feedback *content_feedback = data;
+    content_feedback->client->input_latency_stats.discarded += 1;
+    wp_presentation_feedback_destroy(feedback);
+    free(content_feedback);
+}
 
-    wl_surface_attach(client->decor.titlebar_surface, decor_buffer_titlebar, 0, 0);
-    wl_subsurface_set_position(client->decor.titlebar_subsurface, 0, -TITLEBAR_WIDTH);
-    wl_surface_commit(client->decor.titlebar_surface);
+static const struct wp_presentation_feedback_listener content_feedback_listener = {
+    .sync_output = content_feedback_sync_output,
+    .presented = content_feedback_presented,
+    .discarded = content_feedback_discarded,
+};
 
-    // Close Button
+// Records how long the input behind the frame that is about to be committed took so far, and asks for the time the
+// frame is presented.
+static void content_track_input(struct window *window)
+{
+    struct wayland_client *client = window->client;
+    struct input_tag *tag = &window->content.tag;
 
-    const uint32_t close_button_width = 20;
-    const uint32_t close_button_height = 20;
-    struct wl_buffer *decor_buffer_close_button = buffer_draw(client->shm, close_button_width, close_button_height, 0xffdd6666);
+    if (tag->arrival_ns == 0)
+    {
+        return;
+    }
 
-    wl_surface_attach(client->decor.close_button_surface, decor_buffer_close_button, 0, 0);
-    wl_subsurface_set_position(client->decor.close_button_subsurface, client->width - 2 * BORDER_WIDTH - close_button_width - ((TITLEBAR_WIDTH - close_button_height) / 2.0), -((float) TITLEBAR_WIDTH / 2.0 + (float) close_button_height / 2.0));
-    wl_surface_commit(client->decor.close_button_surface);
+    uint64_t now_ns = get_monotonic_time_ns();
+    latency_histogram_add(&client->input_latency_stats.arrival_to_commit, (now_ns - tag->arrival_ns) / 1000);
+    latency_histogram_add(&client->input_latency_stats.handled_to_commit, (now_ns - tag->handled_ns) / 1000);
 
-    // Edge decor
+    struct content_feedback *content_feedback = client->presentation == NULL ? NULL : malloc(sizeof(struct content_feedback));
 
-    struct wl_buffer *decor_buffer_top_bottom = buffer_draw(client->shm, client->width - 2 * BORDER_WIDTH, BORDER_WIDTH, border_color);
+    if (content_feedback != NULL)
+    {
+        content_feedback->client = client;
+        content_feedback->tag = *tag;
+        content_feedback->commit_ns = now_ns;
 
-    wl_surface_attach(client->decor.border_top_surface, decor_buffer_top_bottom, 0, 0);
-    wl_subsurface_set_position(client->decor.border_top_subsurface, 0, -BORDER_WIDTH - TITLEBAR_WIDTH);
-    wl_surface_commit(client->decor.border_top_surface);
+        struct wp_presentation_feedback *feedback = wp_presentation_feedback(client->presentation, window->render_surface);
+        wp_presentation_feedback_add_listener(feedback, &content_feedback_listener, content_feedback);
+    }
 
-    wl_surface_attach(client->decor.border_bottom_surface, decor_buffer_top_bottom, 0, 0);
-    wl_subsurface_set_position(client->decor.border_bottom_subsurface, 0, client->height - TITLEBAR_WIDTH - 2 * BORDER_WIDTH);
-    wl_surface_commit(client->decor.border_bottom_surface);
+    *tag = (struct input_tag){0};
+}
 
-    struct wl_buffer *decor_buffer_left_right = buffer_draw(client->shm, BORDER_WIDTH, client->height - 2 * BORDER_WIDTH, border_color);
+// Derives the new frame from the previous one if there is one, so scrolling only paints the exposed strips.
+static void content_render(struct window *window)
+{
+    struct wayland_client *client = window->client;
+    int32_t scale = window->scale;
+    int32_t logical_width = decor_content_width(window->width);
+    int32_t logical_height = decor_content_height(window->height);
+    int32_t width;
+    int32_t height;
+    decor_content_buffer_size(window->width, window->height, scale, &width, &height);
 
-    wl_surface_attach(client->decor.border_left_surface, decor_buffer_left_right, 0, 0);
-    wl_subsurface_set_position(client->decor.border_left_subsurface, -BORDER_WIDTH, -TITLEBAR_WIDTH);
-    wl_surface_commit(client->decor.border_left_surface);
+    if (!swapchain_resize(&window->swapchain, &client->shm_pool, width, height))
+    {
+        return;
+    }
 
-    wl_surface_attach(client->decor.border_right_surface, decor_buffer_left_right, 0, 0);
-    wl_subsurface_set_position(client->decor.border_right_subsurface, client->width - 2 * BORDER_WIDTH, -TITLEBAR_WIDTH);
-    wl_surface_commit(client->decor.border_right_surface);
+    struct swapchain_buffer *buffer = swapchain_acquire(&window->swapchain);
+    window->content.dirty = buffer == NULL;
 
-    // Corner decor
+    // Drawn again once the compositor releases a buffer, see `content_buffer_release`.
+    if (buffer == NULL)
+    {
+        return;
+    }
 
-    struct wl_buffer *decor_cornor = buffer_draw(client->shm, BORDER_WIDTH, BORDER_WIDTH, border_color);
+    if (window->content.callback == NULL)
+    {
+        window->content.callback = wl_surface_frame(window->render_surface);
+        wl_callback_add_listener(window->content.callback, &content_frame_listener, window);
+    }
 
-    wl_surface_attach(client->decor.corner_top_left_surface, decor_cornor, 0, 0);
-    wl_subsurface_set_position(client->decor.corner_top_left_subsurface, -BORDER_WIDTH, -BORDER_WIDTH - TITLEBAR_WIDTH);
-    wl_surface_commit(client->decor.corner_top_left_surface);
+    // The canvas is addressed in buffer pixels.
+    int64_t x_position = floor(window->scroll.x_position * scale / SCALE_DENOMINATOR);
+    int64_t y_position = floor(window->scroll.y_position * scale / SCALE_DENOMINATOR);
+    int32_t tile_size = scale_length(CANVAS_TILE_SIZE, scale);
+    struct swapchain_buffer *front = window->swapchain.front;
+    uint64_t painted;
 
-    wl_surface_attach(client->decor.corner_top_right_surface, decor_cornor, 0, 0);
-    wl_subsurface_set_position(client->decor.corner_top_right_subsurface, client->width - 2 * BORDER_WIDTH, -BORDER_WIDTH - TITLEBAR_WIDTH);
-    wl_surface_commit(client->decor.corner_top_right_surface);
+    // A frame at another scale can have the same size but shows the canvas at another tile size.
+    if (front != NULL && front->valid && window->content.scale == scale)
+    {
+        painted = canvas_scroll(buffer->pixels, front->pixels, width, height, front->x_position, front->y_position, x_position, y_position, tile_size);
+    }
+    else
+    {
+        canvas_draw(buffer->pixels, width, 0, 0, width, height, x_position, y_position, tile_size);
+        painted = (uint64_t) width * height;
+    }
 
-    wl_surface_attach(client->decor.corner_bottom_left_surface, decor_cornor, 0, 0);
-    wl_subsurface_set_position(client->decor.corner_bottom_left_subsurface, -BORDER_WIDTH, client->height - TITLEBAR_WIDTH - 2 * BORDER_WIDTH);
-    wl_surface_commit(client->decor.corner_bottom_left_surface);
+    buffer->x_position = x_position;
+    buffer->y_position = y_position;
+    swapchain_present(&window->swapchain, buffer);
 
-    wl_surface_attach(client->decor.corner_bottom_right_surface, decor_cornor, 0, 0);
-    wl_subsurface_set_position(client->decor.corner_bottom_right_subsurface, client->width - 2 * BORDER_WIDTH, client->height - TITLEBAR_WIDTH - 2 * BORDER_WIDTH);
-    wl_surface_commit(client->decor.corner_bottom_right_surface);
+    content_track_input(window);
 
-    // Fill window
+    // The scale must change together with the buffer, the old one does not match it.
+    bool resized = window->content.width != logical_width || window->content.height != logical_height;
 
-    struct wl_buffer *buffer = buffer_draw(client->shm, client->width - 2 * BORDER_WIDTH, client->height - TITLEBAR_WIDTH - 2 * BORDER_WIDTH, 0xff444444);
-    wl_surface_attach(client->surface, buffer, 0, 0);
+    if (window->content.scale != scale || (resized && window->content.viewport != NULL))
+    {
+        surface_apply_scale(window->surface, window->content.viewport, scale, logical_width, logical_height);
+        window->content.scale = scale;
+        window->content.width = logical_width;
+        window->content.height = logical_height;
+    }
 
-    wl_surface_commit(client->surface);
+    wl_surface_attach(window->surface, buffer->buffer, 0, 0);
+    wl_surface_damage_buffer(window->surface, 0, 0, INT32_MAX, INT32_MAX);
+    wl_surface_commit(window->surface);
+    request_stats_add_frame(&client->request_stats, atomic_load(&request_count));
+    content_stats_add(&client->content_stats, (uint64_t) width * height, painted);
 }
 
-static const struct xdg_surface_listener xdg_surface_listener = {
-    .configure = xdg_surface_configure,
-};
+// A frame that found all buffers busy is drawn as soon as one is free, unless a pending frame callback draws it anyway.
+static void content_buffer_release(void *data)
+{
+    struct window *window = data;
 
-// ####################################################################################################################
-// XDG WM Base
+    if (window->content.dirty && window->content.callback == NULL && window->configured)
+    {
+        content_render(window);
+    }
+}
 
-static void xdg_wm_base_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32_t serial)
+// Frames are only drawn while something changed, paced by the compositor.
+static void content_invalidate(struct window *window)
 {
-    xdg_wm_base_pong(xdg_wm_base, serial);
-}
+    window->content.dirty = true;
 
-static const struct xdg_wm_base_listener xdg_wm_base_listener = {
-    .ping = xdg_wm_base_ping,
-};
+    if (window->content.tag.arrival_ns == 0)
+    {
+        window->content.tag = window->client->input_tag;
+    }
 
-// ####################################################################################################################
-// Keyboard
+    // Nothing may be committed before the first configure.
+    if (window->content.callback == NULL && window->configured)
+    {
+        content_render(window);
+    }
+}
 
-static void keyboard_keymap(void *data, struct wl_keyboard *keyboard, uint32_t format, int32_t fd, uint32_t size)
+static void scroll_advance(struct window *window, uint32_t time)
 {
-    assert(format == WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1);
-    struct wayland_client *client = data;
+    if (!window->scroll.kinetic)
+    {
+        return;
+    }
 
-    char *map_shm = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
-    assert(map_shm != MAP_FAILED);
+    // The first frame after a stop and frames after a stall advance by a nominal frame.
+    uint32_t elapsed = time - window->scroll.frame_time;
 
-    struct xkb_keymap *keymap = xkb_keymap_new_from_string(client->xkb_context, map_shm, XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
-    munmap(map_shm, size);
-    close(fd);
+    if (window->scroll.frame_time == 0 || elapsed > 100)
+    {
+        elapsed = 16;
+    }
 
-    client->xkb_state = xkb_state_new(keymap);
+    window->scroll.frame_time = time;
+    window->scroll.x_position += window->scroll.x_velocity * elapsed;
+    window->scroll.y_position += window->scroll.y_velocity * elapsed;
 
-    // FIXME: Unref keymap. But when? (Wayland Book Ch. 9.2)
-}
+    // Exponential decay with a time constant of 325 ms.
+    double decay = exp(-(double) elapsed / 325.0);
+    window->scroll.x_velocity *= decay;
+    window->scroll.y_velocity *= decay;
 
-static void keyboard_enter(void *data, struct wl_keyboard *keyboard, uint32_t serial, struct wl_surface *surface, struct wl_array *keys)
-{
+    if (fabs(window->scroll.x_velocity) < 0.02 && fabs(window->scroll.y_velocity) < 0.02)
+    {
+        window->scroll.kinetic = false;
+    }
+
+    window->content.dirty = true;
 }
 
-static void keyboard_leave(void *data, struct wl_keyboard *keyboard, uint32_t serial, struct wl_surface *surface)
+static void content_frame_done(void *data, struct wl_callback *callback, uint32_t time)
 {
+    struct window *window = data;
+    wl_callback_destroy(callback);
+    window->content.callback = NULL;
+
+    scroll_advance(window, time);
+
+    // Pointer input batched until this frame goes into it.
+    if (window->client->pointer_batch.window == window)
+    {
+        pointer_batch_flush(window->client);
+    }
+
+    if (window->content.dirty)
+    {
+        content_render(window);
+    }
 }
 
-static void keyboard_key(void *data, struct wl_keyboard *keyboard, uint32_t serial, uint32_t time, uint32_t key, uint32_t key_state)
+static const struct wl_callback_listener content_frame_listener = {
+    .done = content_frame_done,
+};
+
+// ####################################################################################################################
+// XDG Toplevel
+
+static void xdg_toplevel_configure(void *data, struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height, struct wl_array *states)
 {
-    struct wayland_client *client = data;
-    xkb_keysym_t xkb_key = xkb_state_key_get_one_sym(client->xkb_state, key + 8);
+    struct window *window = data;
 
-    if (xkb_key == XKB_KEY_Escape)
+    if (width == 0 || height == 0)
     {
-        client->should_close = true;
+        return;
     }
+
+    window->width = width;
+    window->height = height;
 }
 
-static void keyboard_modifiers(void *data, struct wl_keyboard *keyboard, uint32_t serial, uint32_t depressed, uint32_t latched, uint32_t locked, uint32_t group)
+static void xdg_toplevel_close(void *data, struct xdg_toplevel *xdg_toplevel)
 {
-    struct wayland_client *client = data;
-    xkb_state_update_mask(client->xkb_state, depressed, latched, locked, 0, 0, group);
+    struct window *window = data;
+    window->closed = true;
 }
 
-static void keyboard_repeat_info(void *data, struct wl_keyboard *keyboard, int32_t rate, int32_t delay)
+static void xdg_toplevel_configure_bounds(void *data, struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height)
 {
 }
 
-static struct wl_keyboard_listener keyboard_listener = {
-    .keymap = keyboard_keymap,
-    .enter = keyboard_enter,
-    .leave = keyboard_leave,
-    .key = keyboard_key,
-    .modifiers = keyboard_modifiers,
-    .repeat_info = keyboard_repeat_info,
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+    .configure = xdg_toplevel_configure,
+    .close = xdg_toplevel_close,
+    .configure_bounds = xdg_toplevel_configure_bounds,
 };
 
 // ####################################################################################################################
-// Pointer
-
-static void set_cursor(struct wayland_client *client, uint32_t serial, enum cursor_variant cursor_variant)
-{
-    wl_surface_attach(client->cursor_surface, client->cursor_buffers[cursor_variant], 0, 0);
-    wl_surface_commit(client->cursor_surface);
-    wl_pointer_set_cursor(client->pointer, serial, client->cursor_surface, client->cursor_images[cursor_variant]->hotspot_x, client->cursor_images[cursor_variant]->hotspot_y);
-}
+// XDG Surface
 
-static void pointer_enter(void *data, struct wl_pointer *pointer, uint32_t serial, struct wl_surface *surface, wl_fixed_t x_position, wl_fixed_t y_position)
+static void decor_commit(struct window *window, struct wl_buffer *buffer)
 {
-    struct wayland_client *client = data;
+    struct wayland_client *client = window->client;
 
-    if (surface == client->decor.titlebar_surface)
-    {
-        client->cursor_decor_position |= CURSOR_DECOR_POSITION_TITLEBAR;
-        set_cursor(client, serial, CURSOR_VARIANT_LEFT_PTR);
-    }
-    else if (surface == client->decor.close_button_surface)
-    {
-        client->cursor_decor_position |= CURSOR_DECOR_POSITION_CLOSE_BUTTON;
-        set_cursor(client, serial, CURSOR_VARIANT_POINTER);
-    }
-    else if (surface == client->decor.corner_top_left_surface)
-    {
-        client->cursor_decor_position |= CURSOR_DECOR_POSITION_TOP_LEFT_CORNER;
-        set_cursor(client, serial, CURSOR_VARIANT_NW_RESIZE);
-    }
-    else if (surface == client->decor.corner_top_right_surface)
+    // The subsurface is created once the subcompositor global arrives.
+    if (window->decor.surface == NULL)
     {
-        client->cursor_decor_position |= CURSOR_DECOR_POSITION_TOP_RIGHT_CORNER;
-        set_cursor(client, serial, CURSOR_VARIANT_NE_RESIZE);
-    }
-    else if (surface == client->decor.corner_bottom_left_surface)
-    {
-        client->cursor_decor_position |= CURSOR_DECOR_POSITION_BOTTOM_LEFT_CORNER;
-        set_cursor(client, serial, CURSOR_VARIANT_SW_RESIZE);
-    }
-    else if (surface == client->decor.corner_bottom_right_surface)
-    {
-        client->cursor_decor_position |= CURSOR_DECOR_POSITION_BOTTOM_RIGHT_CORNER;
-        set_cursor(client, serial, CURSOR_VARIANT_SE_RESIZE);
-    }
-    else if (surface == client->decor.border_top_surface)
-    {
-        client->cursor_decor_position |= CURSOR_DECOR_POSITION_TOP_BORDER;
-        set_cursor(client, serial, CURSOR_VARIANT_N_RESIZE);
-    }
-    else if (surface == client->decor.border_bottom_surface)
-    {
-        client->cursor_decor_position |= CURSOR_DECOR_POSITION_BOTTOM_BORDER;
-        set_cursor(client, serial, CURSOR_VARIANT_S_RESIZE);
-    }
-    else if (surface == client->decor.border_left_surface)
-    {
-        client->cursor_decor_position |= CURSOR_DECOR_POSITION_LEFT_BORDER;
-        set_cursor(client, serial, CURSOR_VARIANT_W_RESIZE);
+        return;
     }
-    else if (surface == client->decor.border_right_surface)
+
+    bool resized = window->decor.width != window->width || window->decor.height != window->height;
+
+    if (window->decor.scale != window->scale || (resized && window->decor.viewport != NULL))
     {
-        client->cursor_decor_position |= CURSOR_DECOR_POSITION_RIGHT_BORDER;
-        set_cursor(client, serial, CURSOR_VARIANT_E_RESIZE);
+        surface_apply_scale(window->decor.surface, window->decor.viewport, window->scale, window->width, window->height);
+        window->decor.scale = window->scale;
     }
-    else
+
+    // Only the frame takes input and is opaque, the content surface covers the hole.
+    if (resized)
     {
-        set_cursor(client, serial, CURSOR_VARIANT_LEFT_PTR);
+        struct wl_region *region = wl_compositor_create_region(client->compositor);
+        wl_region_add(region, 0, 0, window->width, window->height);
+        wl_region_subtract(region, BORDER_WIDTH, BORDER_WIDTH + TITLEBAR_WIDTH, decor_content_width(window->width), decor_content_height(window->height));
+        wl_surface_set_input_region(window->decor.surface, region);
+        wl_surface_set_opaque_region(window->decor.surface, region);
+        wl_region_destroy(region);
+
+        window->decor.width = window->width;
+        window->decor.height = window->height;
     }
+
+    wl_surface_attach(window->decor.surface, buffer, 0, 0);
+    wl_surface_commit(window->decor.surface);
 }
 
-static void pointer_leave(void *data, struct wl_pointer *pointer, uint32_t serial, struct wl_surface *surface)
+// Draws the decor and the content at the current size and scale.
+static bool window_render(struct window *window)
 {
-    struct wayland_client *client = data;
+    struct wayland_client *client = window->client;
+    struct buffer_description decor_buffer = {window->width, window->height, window->scale, 0, decor_draw};
 
-    if (surface == client->decor.titlebar_surface)
+    if (!buffers_draw(client, &decor_buffer, 1))
     {
-        client->cursor_decor_position &= ~CURSOR_DECOR_POSITION_TITLEBAR;
+        return false;
     }
-    if (surface == client->decor.close_button_surface)
+
+    decor_commit(window, decor_buffer.buffer);
+
+    // Fill window. Committing the content surface also applies the decor.
+    content_render(window);
+
+    // The whole frame goes out with a single flush.
+    event_loop_flush(client->loop);
+
+    return true;
+}
+
+static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial)
+{
+    struct window *window = data;
+    struct wayland_client *client = window->client;
+    xdg_surface_ack_configure(xdg_surface, serial);
+
+    if (client->startup_stats.first_configure_ns == 0)
     {
-        client->cursor_decor_position &= ~CURSOR_DECOR_POSITION_CLOSE_BUTTON;
+        client->startup_stats.first_configure_ns = get_monotonic_time_ns();
     }
-    else if (surface == client->decor.corner_top_left_surface)
+
+    if (!window_render(window))
     {
-        client->cursor_decor_position &= ~CURSOR_DECOR_POSITION_TOP_LEFT_CORNER;
+        return;
     }
-    else if (surface == client->decor.corner_top_right_surface)
+
+    window->configured = true;
+
+    if (client->startup_stats.first_commit_ns == 0)
     {
-        client->cursor_decor_position &= ~CURSOR_DECOR_POSITION_TOP_RIGHT_CORNER;
+        client->startup_stats.first_commit_ns = get_monotonic_time_ns();
+        startup_stats_print(&client->startup_stats);
+        cursors_load(client);
     }
-    else if (surface == client->decor.corner_bottom_left_surface)
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+    .configure = xdg_surface_configure,
+};
+
+// ####################################################################################################################
+// XDG WM Base
+
+static void xdg_wm_base_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32_t serial)
+{
+    xdg_wm_base_pong(xdg_wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener xdg_wm_base_listener = {
+    .ping = xdg_wm_base_ping,
+};
+
+// ####################################################################################################################
+// Input
+
+// Input only carries surfaces, which may belong to a window that was closed since. Focus changes are rare, so a scan
+// that never touches the surface is fine.
+static struct window *window_find(struct wayland_client *client, struct wl_surface *surface)
+{
+    struct window *window;
+
+    wl_list_for_each(window, &client->windows, link)
+    {
+        if (!window->closed && (window->surface == surface || window->decor.surface == surface))
+        {
+            return window;
+        }
+    }
+
+    return NULL;
+}
+
+static void set_cursor(struct wayland_client *client, uint32_t serial, enum cursor_variant cursor_variant)
+{
+    client->pointer_inside = true;
+    client->pointer_enter_serial = serial;
+    client->cursor_variant = cursor_variant;
+
+    // Created here rather than with the pointer, which lives on the reader thread in threaded mode.
+    if (client->cursor_shape_manager != NULL && client->cursor_shape_device == NULL)
+    {
+        client->cursor_shape_device = wp_cursor_shape_manager_v1_get_pointer(client->cursor_shape_manager, client->pointer);
+    }
+
+    if (client->cursor_shape_device != NULL)
+    {
+        wp_cursor_shape_device_v1_set_shape(client->cursor_shape_device, serial, cursor_variants[cursor_variant].shape);
+        return;
+    }
+
+    // The theme is loaded in the background. Until it is ready the compositor keeps its own cursor.
+    struct wl_buffer **buffers;
+    struct wl_cursor *cursor = cursor_cache_get(&client->cursors, cursor_variant, &buffers);
+
+    if (cursor == NULL)
+    {
+        return;
+    }
+
+    struct wl_cursor_image *image = cursor->images[0];
+    wl_surface_attach(client->cursor_surface, buffers[0], 0, 0);
+    wl_surface_damage_buffer(client->cursor_surface, 0, 0, INT32_MAX, INT32_MAX);
+    wl_surface_commit(client->cursor_surface);
+    wl_pointer_set_cursor(client->pointer, serial, client->cursor_surface, image->hotspot_x, image->hotspot_y);
+
+    client->cursor_animation.cursor = cursor;
+    client->cursor_animation.buffers = buffers;
+    client->cursor_animation.frame = 0;
+    client->cursor_animation.start_time_ns = get_monotonic_time_ns();
+
+    // Zero would disarm the timer.
+    uint32_t delay = image->delay > 0 ? image->delay : 1;
+    event_source_timer_update(client->cursor_animation.timer, cursor->image_count > 1 ? delay : 0, 0);
+}
+
+// The timer is armed for exactly the remaining duration of the current frame and disarmed when the pointer leaves, so
+// an animated cursor costs nothing while the pointer is elsewhere.
+static void cursor_animation_advance(void *data, uint64_t expirations)
+{
+    struct wayland_client *client = data;
+    struct wl_cursor *cursor = client->cursor_animation.cursor;
+
+    if (!client->pointer_inside || cursor == NULL)
+    {
+        return;
+    }
+
+    uint32_t elapsed_ms = (get_monotonic_time_ns() - client->cursor_animation.start_time_ns) / 1000000;
+    uint32_t duration_ms = 0;
+    int frame = wl_cursor_frame_and_duration(cursor, elapsed_ms, &duration_ms);
+
+    if (frame != client->cursor_animation.frame)
+    {
+        struct wl_cursor_image *previous = cursor->images[client->cursor_animation.frame];
+        struct wl_cursor_image *image = cursor->images[frame];
+        client->cursor_animation.frame = frame;
+
+        wl_surface_attach(client->cursor_surface, client->cursor_animation.buffers[frame], 0, 0);
+        wl_surface_damage_buffer(client->cursor_surface, 0, 0, INT32_MAX, INT32_MAX);
+        wl_surface_commit(client->cursor_surface);
+
+        if (image->hotspot_x != previous->hotspot_x || image->hotspot_y != previous->hotspot_y)
+        {
+            wl_pointer_set_cursor(client->pointer, client->pointer_enter_serial, client->cursor_surface, image->hotspot_x, image->hotspot_y);
+        }
+    }
+
+    event_source_timer_update(client->cursor_animation.timer, duration_ms > 0 ? duration_ms : 1, 0);
+}
+
+// Everything outside the decor surface is content, so a pointer event costs at most one hit test.
+static const struct decor_role_descriptor *pointer_role_at(struct wayland_client *client, wl_fixed_t x_position, wl_fixed_t y_position)
+{
+    struct window *window = client->pointer_window;
+
+    if (client->pointer_surface != window->decor.surface)
+    {
+        return &decor_roles[DECOR_ROLE_CONTENT];
+    }
+
+    return &decor_roles[decor_hit_test(window->width, window->height, wl_fixed_to_double(x_position), wl_fixed_to_double(y_position))];
+}
+
+static void handle_pointer_enter(struct wayland_client *client, const struct pointer_frame *frame)
+{
+    client->pointer_surface = frame->surface;
+    client->pointer_window = window_find(client, frame->surface);
+    client->pointer_x_position = frame->x_position;
+    client->pointer_y_position = frame->y_position;
+
+    // Entered a window that is being closed. Its events are ignored until the pointer enters another one.
+    if (client->pointer_window == NULL)
+    {
+        client->pointer_role = NULL;
+        return;
+    }
+
+    client->pointer_role = pointer_role_at(client, frame->x_position, frame->y_position);
+    set_cursor(client, frame->enter_serial, client->pointer_role->cursor_variant);
+}
+
+static void handle_pointer_leave(struct wayland_client *client)
+{
+    client->pointer_inside = false;
+    client->pointer_surface = NULL;
+    client->pointer_window = NULL;
+    client->pointer_role = NULL;
+    event_source_timer_update(client->cursor_animation.timer, 0, 0);
+}
+
+static void handle_pointer_motion(struct wayland_client *client, const struct pointer_frame *frame)
+{
+    client->pointer_x_position = frame->x_position;
+    client->pointer_y_position = frame->y_position;
+
+    if (client->pointer_role == NULL || client->pointer_surface != client->pointer_window->decor.surface)
+    {
+        return;
+    }
+
+    const struct decor_role_descriptor *role = pointer_role_at(client, frame->x_position, frame->y_position);
+
+    if (role != client->pointer_role)
+    {
+        client->pointer_role = role;
+        set_cursor(client, client->pointer_enter_serial, role->cursor_variant);
+    }
+}
+
+static void handle_pointer_button(struct wayland_client *client, const struct pointer_frame *frame)
+{
+    const struct decor_role_descriptor *role = client->pointer_role;
+    struct window *window = client->pointer_window;
+
+    if (role == NULL || frame->button_state != WL_POINTER_BUTTON_STATE_PRESSED)
+    {
+        return;
+    }
+
+    switch (role->action)
+    {
+    case DECOR_ACTION_NONE:
+        break;
+    case DECOR_ACTION_MOVE:
+        xdg_toplevel_move(window->xdg_toplevel, client->seat, frame->button_serial);
+        break;
+    case DECOR_ACTION_CLOSE:
+        window->closed = true;
+        break;
+    case DECOR_ACTION_RESIZE:
+        xdg_toplevel_resize(window->xdg_toplevel, client->seat, frame->button_serial, role->resize_edge);
+        break;
+    }
+}
+
+// Wheel notches scroll by this many pixels.
+#define SCROLL_STEP 48
+
+static void handle_pointer_axis(struct wayland_client *client, const struct input_event *event)
+{
+    const struct pointer_frame *frame = &event->pointer_frame;
+    struct window *window = client->pointer_window;
+
+    if (client->pointer_role == NULL || client->pointer_role->role != DECOR_ROLE_CONTENT)
+    {
+        return;
+    }
+
+    if (frame->mask & POINTER_FRAME_AXIS)
+    {
+        double x_delta = wl_fixed_to_double(frame->axis_value[WL_POINTER_AXIS_HORIZONTAL_SCROLL]);
+        double y_delta = wl_fixed_to_double(frame->axis_value[WL_POINTER_AXIS_VERTICAL_SCROLL]);
+
+        if (frame->axis_source == WL_POINTER_AXIS_SOURCE_WHEEL && (frame->axis_discrete[0] != 0 || frame->axis_discrete[1] != 0))
+        {
+            x_delta = frame->axis_discrete[WL_POINTER_AXIS_HORIZONTAL_SCROLL] * SCROLL_STEP;
+            y_delta = frame->axis_discrete[WL_POINTER_AXIS_VERTICAL_SCROLL] * SCROLL_STEP;
+        }
+
+        // Smoothed velocity over the recent finger motion, used once the fingers are lifted.
+        uint32_t elapsed = event->time - window->scroll.time;
+
+        if (frame->axis_source == WL_POINTER_AXIS_SOURCE_FINGER && elapsed > 0 && elapsed < 100)
+        {
+            window->scroll.x_velocity = 0.5 * window->scroll.x_velocity + 0.5 * x_delta / elapsed;
+            window->scroll.y_velocity = 0.5 * window->scroll.y_velocity + 0.5 * y_delta / elapsed;
+        }
+        else
+        {
+            window->scroll.x_velocity = 0;
+            window->scroll.y_velocity = 0;
+        }
+
+        window->scroll.time = event->time;
+        window->scroll.kinetic = false;
+        window->scroll.x_position += x_delta;
+        window->scroll.y_position += y_delta;
+        content_invalidate(window);
+    }
+
+    if (frame->axis_stop != 0 && (window->scroll.x_velocity != 0 || window->scroll.y_velocity != 0))
+    {
+        window->scroll.kinetic = true;
+        window->scroll.frame_time = 0;
+        content_invalidate(window);
+    }
+}
+
+// The single application callback for pointer input.
+static void handle_pointer_frame(struct wayland_client *client, const struct input_event *event)
+{
+    const struct pointer_frame *frame = &event->pointer_frame;
+    client->pointer_stats.deliveries += 1;
+
+    if (frame->mask & POINTER_FRAME_LEAVE)
+    {
+        handle_pointer_leave(client);
+    }
+
+    if (frame->mask & POINTER_FRAME_ENTER)
+    {
+        handle_pointer_enter(client, frame);
+    }
+
+    if (frame->mask & POINTER_FRAME_MOTION)
+    {
+        handle_pointer_motion(client, frame);
+    }
+
+    if (frame->mask & POINTER_FRAME_BUTTON)
+    {
+        handle_pointer_button(client, frame);
+    }
+
+    if (frame->mask & (POINTER_FRAME_AXIS | POINTER_FRAME_AXIS_STOP))
+    {
+        handle_pointer_axis(client, event);
+    }
+}
+
+// Longest a batch is held back, about one frame at 60 Hz.
+#define POINTER_BATCH_TIMEOUT_MS 16
+
+static void pointer_batch_flush(struct wayland_client *client)
+{
+    struct input_event *pending = &client->pointer_batch.pending;
+
+    if (client->pointer_batch.timer != NULL)
+    {
+        event_source_timer_update(client->pointer_batch.timer, 0, 0);
+    }
+
+    client->pointer_batch.window = NULL;
+
+    if (pending->pointer_frame.mask != 0)
+    {
+        // Batched frames are handled outside of `handle_input_event`, so they are tagged here.
+        struct input_tag previous_tag = client->input_tag;
+        client->input_tag = (struct input_tag){pending->time, pending->decode_time_ns, get_monotonic_time_ns()};
+        handle_pointer_frame(client, pending);
+        client->input_tag = previous_tag;
+        pending->pointer_frame.mask = 0;
+    }
+}
+
+static void pointer_batch_timer_fire(void *data, uint64_t expirations)
+{
+    pointer_batch_flush(data);
+}
+
+// Motion and axis data are merged until the window draws its next frame, without asking for a frame of its own. While
+// no frame is pending, the timer delivers the batch after about a frame at 60 Hz. Everything else is delivered right
+// away, after the batched data that happened before it.
+static void pointer_batch_add(struct wayland_client *client, const struct input_event *event)
+{
+    const uint32_t batchable = POINTER_FRAME_MOTION | POINTER_FRAME_AXIS | POINTER_FRAME_AXIS_STOP;
+    struct input_event *pending = &client->pointer_batch.pending;
+
+    struct window *window = client->pointer_window;
+
+    if ((event->pointer_frame.mask & ~batchable) != 0 || window == NULL || client->pointer_batch.timer == NULL)
+    {
+        pointer_batch_flush(client);
+        handle_pointer_frame(client, event);
+        return;
+    }
+
+    if (pending->pointer_frame.mask == 0)
+    {
+        *pending = *event;
+
+        // The deadline is kept while more frames are merged.
+        event_source_timer_update(client->pointer_batch.timer, POINTER_BATCH_TIMEOUT_MS, 0);
+    }
+    else
+    {
+        pointer_frame_merge(&pending->pointer_frame, &event->pointer_frame);
+        pending->time = event->time;
+    }
+
+    // A pending content frame delivers the batch earlier, so that the frame after it can already show its effect.
+    client->pointer_batch.window = window->content.callback != NULL ? window : NULL;
+}
+
+// Everything outside the decor surface is content, so a touch costs at most one hit test.
+static const struct decor_role_descriptor *touch_role_at(struct window *window, struct wl_surface *surface, wl_fixed_t x_position, wl_fixed_t y_position)
+{
+    if (surface != window->decor.surface)
+    {
+        return &decor_roles[DECOR_ROLE_CONTENT];
+    }
+
+    return &decor_roles[decor_hit_test(window->width, window->height, wl_fixed_to_double(x_position), wl_fixed_to_double(y_position))];
+}
+
+static void handle_touch_down(struct wayland_client *client, const struct touch_frame_point *point)
+{
+    int slot = -1;
+
+    for (int i = 0; i < TOUCH_FRAME_CAPACITY; ++i)
+    {
+        if (!client->touch_points[i].active)
+        {
+            slot = i;
+            break;
+        }
+    }
+
+    struct window *window = window_find(client, point->surface);
+
+    if (slot == -1 || window == NULL)
+    {
+        return;
+    }
+
+    const struct decor_role_descriptor *role = touch_role_at(window, point->surface, point->x_position, point->y_position);
+    client->touch_points[slot].active = true;
+    client->touch_points[slot].id = point->id;
+    client->touch_points[slot].window = window;
+    client->touch_points[slot].surface = point->surface;
+    client->touch_points[slot].role = role;
+
+    // Moving and resizing start right away, the compositor takes over the touch point from there.
+    switch (role->action)
+    {
+    case DECOR_ACTION_MOVE:
+        xdg_toplevel_move(window->xdg_toplevel, client->seat, point->serial);
+        break;
+    case DECOR_ACTION_RESIZE:
+        xdg_toplevel_resize(window->xdg_toplevel, client->seat, point->serial, role->resize_edge);
+        break;
+    case DECOR_ACTION_NONE:
+    case DECOR_ACTION_CLOSE:
+        break;
+    }
+}
+
+static void handle_touch_up(struct wayland_client *client, int slot)
+{
+    // The close button acts like a tap, so sliding off it cancels.
+    if (client->touch_points[slot].role->action == DECOR_ACTION_CLOSE)
+    {
+        struct window *window = client->touch_points[slot].window;
+        const struct decor_role_descriptor *role = touch_role_at(window, client->touch_points[slot].surface, client->touch_points[slot].x_position, client->touch_points[slot].y_position);
+        window->closed |= role->action == DECOR_ACTION_CLOSE;
+    }
+
+    client->touch_points[slot].active = false;
+}
+
+static void handle_touch_frame(struct wayland_client *client, const struct input_event *event)
+{
+    const struct touch_frame *frame = &event->touch_frame;
+
+    if (frame->cancel)
+    {
+        memset(client->touch_points, 0, sizeof(client->touch_points));
+        return;
+    }
+
+    for (uint32_t i = 0; i < frame->count; ++i)
+    {
+        const struct touch_frame_point *point = &frame->points[i];
+
+        if (point->mask & TOUCH_POINT_DOWN)
+        {
+            handle_touch_down(client, point);
+        }
+
+        for (int slot = 0; slot < TOUCH_FRAME_CAPACITY; ++slot)
+        {
+            if (!client->touch_points[slot].active || client->touch_points[slot].id != point->id)
+            {
+                continue;
+            }
+
+            client->touch_points[slot].x_position = point->x_position;
+            client->touch_points[slot].y_position = point->y_position;
+
+            if (point->mask & TOUCH_POINT_UP)
+            {
+                handle_touch_up(client, slot);
+            }
+
+            break;
+        }
+    }
+}
+
+// Parsing the Compose file of a locale takes milliseconds, so the table is mapped from the cache when it can be.
+static void compose_ensure_table(struct wayland_client *client)
+{
+    if (client->compose.loaded)
+    {
+        return;
+    }
+
+    client->compose.loaded = true;
+
+    const char *locale = compose_locale();
+    uint64_t start_time_ns = get_monotonic_time_ns();
+    bool cached;
+
+    if (!compose_table_load(&client->compose.table, locale, &cached))
+    {
+        printf("info (compose): No compose table for locale `%s`.\n", locale);
+        return;
+    }
+
+    compose_state_init(&client->compose.state, &client->compose.table);
+    printf("info (compose): %s table for locale `%s` with %u nodes in %.2fms.\n", cached ? "Mapped cached" : "Compiled", locale,
+           client->compose.table.node_count, (get_monotonic_time_ns() - start_time_ns) / 1e6);
+}
+
+static void handle_keyboard_key(struct wayland_client *client, const struct input_event *event)
+{
+    if (event->key.state != WL_KEYBOARD_KEY_STATE_PRESSED)
+    {
+        return;
+    }
+
+    compose_ensure_table(client);
+
+    char text[64];
+
+    switch (compose_state_feed(&client->compose.state, event->key.keysym))
+    {
+    case COMPOSE_STATUS_COMPOSING:
+    case COMPOSE_STATUS_CANCELLED:
+        break;
+    case COMPOSE_STATUS_COMPOSED:
+        printf("info (keyboard): Text `%s`.\n", compose_state_get_utf8(&client->compose.state));
+        break;
+    case COMPOSE_STATUS_NOTHING:
+        // Escape only closes the focused window when it does not cancel a sequence.
+        if (event->key.keysym == XKB_KEY_Escape)
+        {
+            if (client->keyboard_window != NULL)
+            {
+                client->keyboard_window->closed = true;
+            }
+        }
+        else if (xkb_keysym_to_utf8(event->key.keysym, text, sizeof(text)) > 1 && (unsigned char) text[0] >= ' ' && text[0] != 0x7f)
+        {
+            printf("info (keyboard): Text `%s`.\n", text);
+        }
+        break;
+    }
+}
+
+static uint64_t key_repeat_interval_ns(struct wayland_client *client)
+{
+    return 1000000000 / (uint64_t) client->key_repeat.rate;
+}
+
+// Offset of the repeat from the press.
+static uint64_t key_repeat_offset_ns(struct wayland_client *client, uint64_t index)
+{
+    uint64_t delay_ns = client->key_repeat.delay > 0 ? (uint64_t) client->key_repeat.delay * 1000000 : 0;
+    return delay_ns + index * key_repeat_interval_ns(client);
+}
+
+static void key_repeat_stop(struct wayland_client *client)
+{
+    if (client->key_repeat.active)
+    {
+        client->key_repeat.active = false;
+        event_source_timer_update(client->key_repeat.timer, 0, 0);
+    }
+}
+
+static void key_repeat_start(struct wayland_client *client, const struct input_event *event)
+{
+    if (client->key_repeat.rate <= 0 || client->key_repeat.timer == NULL)
+    {
+        return;
+    }
+
+    client->key_repeat.event = *event;
+    client->key_repeat.start_time_ns = event->decode_time_ns;
+    client->key_repeat.index = 0;
+    client->key_repeat.active = true;
+    event_source_timer_set_absolute(client->key_repeat.timer, event->decode_time_ns + key_repeat_offset_ns(client, 0));
+}
+
+// Repeats follow a fixed schedule from the press, so that a busy thread neither shifts the later ones nor lowers the
+// rate. A wakeup delivers a single repeat though, the latest one that is due, and skips those the user never saw.
+static void key_repeat_fire(void *data, uint64_t expirations)
+{
+    struct wayland_client *client = data;
+
+    if (!client->key_repeat.active)
+    {
+        return;
+    }
+
+    uint64_t elapsed_ns = get_monotonic_time_ns() - client->key_repeat.start_time_ns;
+    uint64_t index = client->key_repeat.index;
+
+    if (elapsed_ns > key_repeat_offset_ns(client, index))
+    {
+        index = (elapsed_ns - key_repeat_offset_ns(client, 0)) / key_repeat_interval_ns(client);
+    }
+
+    struct input_event event = client->key_repeat.event;
+    event.time += key_repeat_offset_ns(client, index) / 1000000;
+    client->key_repeat.index = index + 1;
+    handle_keyboard_key(client, &event);
+
+    if (client->key_repeat.active)
+    {
+        event_source_timer_set_absolute(client->key_repeat.timer, client->key_repeat.start_time_ns + key_repeat_offset_ns(client, index + 1));
+    }
+}
+
+static void handle_input_event(struct wayland_client *client, const struct input_event *event)
+{
+    uint64_t now_ns = get_monotonic_time_ns();
+    latency_histogram_add(&client->input_queue_latency, (now_ns - event->decode_time_ns) / 1000);
+
+    // Assumes the compositor uses CLOCK_MONOTONIC for event timestamps, which all common ones do.
+    if (event->time != 0)
+    {
+        uint32_t now_ms = now_ns / 1000000;
+        latency_histogram_add(&client->input_age_latency, (uint64_t) (uint32_t) (now_ms - event->time) * 1000);
+    }
+
+    client->input_tag = (struct input_tag){event->time, event->decode_time_ns, now_ns};
+
+    switch (event->type)
+    {
+    case INPUT_EVENT_TYPE_POINTER_FRAME:
+        if (client->pointer_batch.enabled)
+        {
+            pointer_batch_add(client, event);
+        }
+        else
+        {
+            handle_pointer_frame(client, event);
+        }
+        break;
+    case INPUT_EVENT_TYPE_TOUCH_FRAME:
+        handle_touch_frame(client, event);
+        break;
+    case INPUT_EVENT_TYPE_KEYBOARD_ENTER:
+        client->keyboard_window = window_find(client, event->focus.surface);
+        break;
+    case INPUT_EVENT_TYPE_KEYBOARD_LEAVE:
+        client->keyboard_window = NULL;
+        key_repeat_stop(client);
+        compose_state_reset(&client->compose.state);
+        break;
+    case INPUT_EVENT_TYPE_KEYBOARD_KEY:
+        handle_keyboard_key(client, event);
+
+        if (event->key.state == WL_KEYBOARD_KEY_STATE_PRESSED && event->key.repeats)
+        {
+            key_repeat_start(client, event);
+        }
+        else if (event->key.state == WL_KEYBOARD_KEY_STATE_RELEASED && event->key.key == client->key_repeat.event.key.key)
+        {
+            key_repeat_stop(client);
+        }
+        break;
+    case INPUT_EVENT_TYPE_KEYBOARD_MODIFIERS:
+        if (client->key_repeat.active && event->key.key == client->key_repeat.event.key.key)
+        {
+            client->key_repeat.event.key.keysym = event->key.keysym;
+        }
+        break;
+    case INPUT_EVENT_TYPE_KEYBOARD_REPEAT_INFO:
+        client->key_repeat.rate = event->repeat_info.rate;
+        client->key_repeat.delay = event->repeat_info.delay;
+        key_repeat_stop(client);
+        break;
+    }
+
+    client->input_tag = (struct input_tag){0};
+}
+
+// An eventfd only refuses to count up when it is about to overflow, in which case its reader is woken anyway.
+static void input_wake(int fd)
+{
+    uint64_t value = 1;
+
+    while (write(fd, &value, sizeof(value)) == -1 && errno == EINTR)
+    {
+    }
+}
+
+static bool input_event_mergeable(const struct input_event *event)
+{
+    const uint32_t mergeable = POINTER_FRAME_MOTION | POINTER_FRAME_AXIS | POINTER_FRAME_AXIS_STOP;
+    return event->type == INPUT_EVENT_TYPE_POINTER_FRAME && (event->pointer_frame.mask & ~mergeable) == 0;
+}
+
+// Runs on the reader thread. Blocks until the render thread made room for the event, instead of spinning while it is
+// busy. Returns false if the event was dropped because the render thread stopped consuming.
+static bool input_push_wait(struct wayland_client *client, const struct input_event *event)
+{
+    if (input_ring_push(&client->input_ring, event))
+    {
+        return true;
+    }
+
+    client->input_ring_stats.waits += 1;
+    input_wake(client->input_event_fd);
+
+    while (true)
+    {
+        // Announced before pushing again, so that a pop in between is sure to see it and signal.
+        atomic_store(&client->input_waiting, true);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (input_ring_push(&client->input_ring, event))
+        {
+            atomic_store(&client->input_waiting, false);
+            return true;
+        }
+
+        if (!reader_thread_wait(client->reader_thread, client->input_space_fd))
+        {
+            atomic_store(&client->input_waiting, false);
+            return false;
+        }
+    }
+}
+
+// Hands the held back pointer frame over once there is room, or waits for room if `wait` is set.
+static bool input_overflow_push(struct wayland_client *client, bool wait)
+{
+    if (!client->input_overflow_pending)
+    {
+        return true;
+    }
+
+    bool pushed = wait ? input_push_wait(client, &client->input_overflow) : input_ring_push(&client->input_ring, &client->input_overflow);
+
+    if (pushed || reader_thread_stopping(client->reader_thread))
+    {
+        client->input_overflow_pending = false;
+        client->input_pending = true;
+    }
+
+    return !client->input_overflow_pending;
+}
+
+// Called on the thread dispatching the seat objects. In threaded mode that is the reader thread, so the event is
+// handed over to the render thread instead of being handled in place. While the ring is full, motion and axis frames
+// are merged like the pointer batching does, and anything else waits for the render thread to catch up.
+static void submit_input_event(struct wayland_client *client, struct input_event *event)
+{
+    event->decode_time_ns = get_monotonic_time_ns();
+
+    if (client->reader_thread == NULL)
+    {
+        handle_input_event(client, event);
+        return;
+    }
+
+    if (!input_overflow_push(client, false))
+    {
+        if (input_event_mergeable(event))
+        {
+            pointer_frame_merge(&client->input_overflow.pointer_frame, &event->pointer_frame);
+            client->input_overflow.time = event->time;
+            client->input_ring_stats.merged_frames += 1;
+            return;
+        }
+
+        // Events are handled in order, so the held back frame goes first.
+        if (!input_overflow_push(client, true))
+        {
+            return;
+        }
+    }
+
+    if (input_ring_push(&client->input_ring, event))
+    {
+        client->input_pending = true;
+    }
+    else if (input_event_mergeable(event))
+    {
+        client->input_overflow = *event;
+        client->input_overflow_pending = true;
+        input_wake(client->input_event_fd);
+    }
+    else if (input_push_wait(client, event))
+    {
+        client->input_pending = true;
+    }
+}
+
+// Runs on the reader thread after each dispatched batch. A frame still held back is delivered before the thread goes
+// back to reading, as no further event may come to push it.
+static void notify_input_events(void *data)
+{
+    struct wayland_client *client = data;
+    input_overflow_push(client, true);
+
+    if (client->input_pending)
+    {
+        client->input_pending = false;
+        input_wake(client->input_event_fd);
+    }
+}
+
+// Runs on the render thread.
+static void consume_input_events(void *data, int fd, uint32_t events)
+{
+    struct wayland_client *client = data;
+    uint64_t value;
+    read(fd, &value, sizeof(value));
+
+    struct input_event event;
+    bool woken = false;
+
+    while (input_ring_pop(&client->input_ring, &event))
+    {
+        // A waiting reader thread can fill the ring up again while the events are handled.
+        if (!woken)
+        {
+            atomic_thread_fence(memory_order_seq_cst);
+
+            if (atomic_load(&client->input_waiting))
+            {
+                input_wake(client->input_space_fd);
+                woken = true;
+            }
+        }
+
+        handle_input_event(client, &event);
+    }
+}
+
+// ####################################################################################################################
+// Keyboard
+
+// Drops the current keymap, its state and any keymap that was not compiled yet. The context is kept for the next one.
+static void keyboard_reset_keymap(struct wayland_client *client)
+{
+    if (client->pending_keymap_fd != -1)
+    {
+        close(client->pending_keymap_fd);
+        client->pending_keymap_fd = -1;
+    }
+
+    if (client->xkb_state != NULL)
+    {
+        xkb_state_unref(client->xkb_state);
+        client->xkb_state = NULL;
+    }
+
+    keymap_table_release(&client->keymap_table);
+    client->keyboard_syms = NULL;
+}
+
+static void keyboard_keymap(void *data, struct wl_keyboard *keyboard, uint32_t format, int32_t fd, uint32_t size)
+{
+    assert(format == WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1);
+    struct wayland_client *client = data;
+
+    if (client->pending_keymap_fd != -1)
+    {
+        close(client->pending_keymap_fd);
+    }
+
+    client->pending_keymap_fd = fd;
+    client->pending_keymap_size = size;
+}
+
+// Compiling the keymap takes milliseconds, so it is done on first use instead of during startup. The translation table
+// of a compiled keymap is cached on disk, keyed by a hash of the keymap text, so later launches with the same layout
+// skip compilation entirely.
+static bool keyboard_ensure_keymap(struct wayland_client *client)
+{
+    if (client->pending_keymap_fd == -1)
+    {
+        return client->keymap_table.keys != NULL;
+    }
+
+    int fd = client->pending_keymap_fd;
+    uint32_t size = client->pending_keymap_size;
+    client->pending_keymap_fd = -1;
+
+    char *map_shm = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    assert(map_shm != MAP_FAILED);
+
+    uint64_t start_time_ns = get_monotonic_time_ns();
+    // The size includes the terminating null byte.
+    uint32_t length = strnlen(map_shm, size);
+    uint64_t hash = hash_fnv1a(map_shm, length);
+    keyboard_reset_keymap(client);
+
+    if (keymap_cache_load(&client->keymap_table, hash, length))
+    {
+        uint64_t duration_ns = get_monotonic_time_ns() - start_time_ns;
+        client->keymap_stats.cache_hits += 1;
+        client->keymap_stats.load_ns += duration_ns;
+        printf("info (keymap): Loaded cached keymap table in %.2fms.\n", duration_ns / 1e6);
+    }
+    else
+    {
+        struct xkb_keymap *keymap = xkb_keymap_new_from_string(client->xkb_context, map_shm, XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+
+        if (keymap != NULL)
+        {
+            client->xkb_state = xkb_state_new(keymap);
+
+            // The modifiers may have been sent before the keymap was compiled.
+            if (client->xkb_state != NULL)
+            {
+                xkb_state_update_mask(client->xkb_state, client->keyboard_mod_masks.depressed, client->keyboard_mod_masks.latched, client->keyboard_mod_masks.locked, 0, 0, client->keyboard_layout);
+            }
+
+            keymap_table_build(&client->keymap_table, keymap);
+            keymap_cache_store(&client->keymap_table, hash, length);
+
+            // The state holds its own reference.
+            xkb_keymap_unref(keymap);
+        }
+
+        uint64_t duration_ns = get_monotonic_time_ns() - start_time_ns;
+        client->keymap_stats.cache_misses += 1;
+        client->keymap_stats.compile_ns += duration_ns;
+        printf("info (keymap): Compiled keymap in %.2fms.\n", duration_ns / 1e6);
+    }
+
+    munmap(map_shm, size);
+    close(fd);
+
+    if (client->keymap_table.keys == NULL)
+    {
+        return false;
+    }
+
+    client->keyboard_syms = keymap_table_get_syms(&client->keymap_table, client->keyboard_mods, client->keyboard_layout);
+
+    return true;
+}
+
+static void keyboard_enter(void *data, struct wl_keyboard *keyboard, uint32_t serial, struct wl_surface *surface, struct wl_array *keys)
+{
+    struct input_event event = {
+        .type = INPUT_EVENT_TYPE_KEYBOARD_ENTER,
+        .serial = serial,
+        .focus = {.surface = surface},
+    };
+
+    submit_input_event(data, &event);
+}
+
+static void keyboard_leave(void *data, struct wl_keyboard *keyboard, uint32_t serial, struct wl_surface *surface)
+{
+    struct wayland_client *client = data;
+    client->keyboard_key_held = false;
+
+    struct input_event event = {
+        .type = INPUT_EVENT_TYPE_KEYBOARD_LEAVE,
+        .serial = serial,
+    };
+
+    submit_input_event(client, &event);
+}
+
+// Translates an evdev key for the current modifiers and layout. The keymap must be loaded.
+static xkb_keysym_t keyboard_get_sym(struct wayland_client *client, uint32_t key, bool *repeats)
+{
+    xkb_keycode_t keycode = key + 8;
+    const struct keymap_table_key *table_key = keymap_table_get_key(&client->keymap_table, keycode);
+    xkb_keysym_t keysym = XKB_KEY_NoSymbol;
+    *repeats = false;
+
+    if (table_key != NULL)
+    {
+        *repeats = table_key->repeats;
+
+        if (client->keyboard_syms != NULL)
+        {
+            keysym = client->keyboard_syms[keycode - client->keymap_table.min_keycode];
+        }
+        else
+        {
+            keysym = table_key->fallback ? KEYMAP_TABLE_SYM_FALLBACK : keymap_table_key_get_sym(&client->keymap_table, table_key, client->keyboard_mods, client->keyboard_layout);
+        }
+
+        // Only keys the table cannot represent go through xkb.
+        if (keysym == KEYMAP_TABLE_SYM_FALLBACK)
+        {
+            keysym = client->xkb_state != NULL ? xkb_state_key_get_one_sym(client->xkb_state, keycode) : XKB_KEY_NoSymbol;
+        }
+    }
+
+    return keysym;
+}
+
+static void keyboard_key(void *data, struct wl_keyboard *keyboard, uint32_t serial, uint32_t time, uint32_t key, uint32_t key_state)
+{
+    struct wayland_client *client = data;
+
+    if (!keyboard_ensure_keymap(client))
+    {
+        return;
+    }
+
+    bool repeats;
+    xkb_keysym_t keysym = keyboard_get_sym(client, key, &repeats);
+
+    if (key_state == WL_KEYBOARD_KEY_STATE_PRESSED && repeats)
+    {
+        client->keyboard_held_key = key;
+        client->keyboard_key_held = true;
+    }
+    else if (key_state == WL_KEYBOARD_KEY_STATE_RELEASED && key == client->keyboard_held_key)
+    {
+        client->keyboard_key_held = false;
+    }
+
+    struct input_event event = {
+        .type = INPUT_EVENT_TYPE_KEYBOARD_KEY,
+        .serial = serial,
+        .time = time,
+        .key = {
+            .key = key,
+            .state = key_state,
+            .keysym = keysym,
+            .repeats = repeats,
+        },
+    };
+
+    submit_input_event(client, &event);
+}
+
+static void keyboard_modifiers(void *data, struct wl_keyboard *keyboard, uint32_t serial, uint32_t depressed, uint32_t latched, uint32_t locked, uint32_t group)
+{
+    struct wayland_client *client = data;
+    client->keyboard_mods = depressed | latched | locked;
+    client->keyboard_layout = group;
+    client->keyboard_mod_masks.depressed = depressed;
+    client->keyboard_mod_masks.latched = latched;
+    client->keyboard_mod_masks.locked = locked;
+
+    if (!keyboard_ensure_keymap(client))
+    {
+        return;
+    }
+
+    client->keyboard_syms = keymap_table_get_syms(&client->keymap_table, client->keyboard_mods, client->keyboard_layout);
+
+    // The state is only needed for keys the table could not represent.
+    if (client->xkb_state != NULL)
+    {
+        xkb_state_update_mask(client->xkb_state, depressed, latched, locked, 0, 0, group);
+    }
+
+    // A held key repeats with the keysym of the new modifiers, for example once Shift is pressed while it repeats.
+    if (client->keyboard_key_held)
+    {
+        bool repeats;
+        struct input_event event = {
+            .type = INPUT_EVENT_TYPE_KEYBOARD_MODIFIERS,
+            .key = {
+                .key = client->keyboard_held_key,
+                .keysym = keyboard_get_sym(client, client->keyboard_held_key, &repeats),
+            },
+        };
+
+        submit_input_event(client, &event);
+    }
+}
+
+static void keyboard_repeat_info(void *data, struct wl_keyboard *keyboard, int32_t rate, int32_t delay)
+{
+    struct input_event event = {
+        .type = INPUT_EVENT_TYPE_KEYBOARD_REPEAT_INFO,
+        .repeat_info = {.rate = rate, .delay = delay},
+    };
+
+    submit_input_event(data, &event);
+}
+
+static struct wl_keyboard_listener keyboard_listener = {
+    .keymap = keyboard_keymap,
+    .enter = keyboard_enter,
+    .leave = keyboard_leave,
+    .key = keyboard_key,
+    .modifiers = keyboard_modifiers,
+    .repeat_info = keyboard_repeat_info,
+};
+
+// ####################################################################################################################
+// Pointer
+
+static void pointer_frame_submit(struct wayland_client *client)
+{
+    if (client->pointer_accumulator.pointer_frame.mask == 0)
+    {
+        return;
+    }
+
+    client->pointer_accumulator.type = INPUT_EVENT_TYPE_POINTER_FRAME;
+    client->pointer_stats.frames += 1;
+    submit_input_event(client, &client->pointer_accumulator);
+    memset(&client->pointer_accumulator, 0, sizeof(client->pointer_accumulator));
+}
+
+// Adds an event to the current frame. Handlers apply a frame in a fixed order, so if the event conflicts with what is
+// already in it, the frame is submitted early and a new one started.
+static struct pointer_frame *pointer_frame_add(struct wayland_client *client, uint32_t time, enum pointer_frame_mask type, uint32_t conflicts)
+{
+    client->pointer_stats.events += 1;
+
+    if (client->pointer_accumulator.pointer_frame.mask & conflicts)
+    {
+        pointer_frame_submit(client);
+    }
+
+    if (time != 0)
+    {
+        client->pointer_accumulator.time = time;
+    }
+
+    client->pointer_accumulator.pointer_frame.mask |= type;
+
+    return &client->pointer_accumulator.pointer_frame;
+}
+
+static void pointer_enter(void *data, struct wl_pointer *pointer, uint32_t serial, struct wl_surface *surface, wl_fixed_t x_position, wl_fixed_t y_position)
+{
+    struct pointer_frame *frame = pointer_frame_add(data, 0, POINTER_FRAME_ENTER, ~POINTER_FRAME_LEAVE);
+    frame->surface = surface;
+    frame->enter_serial = serial;
+    frame->x_position = x_position;
+    frame->y_position = y_position;
+}
+
+static void pointer_leave(void *data, struct wl_pointer *pointer, uint32_t serial, struct wl_surface *surface)
+{
+    pointer_frame_add(data, 0, POINTER_FRAME_LEAVE, ~0u);
+}
+
+static void pointer_motion(void *data, struct wl_pointer *pointer, uint32_t time, wl_fixed_t x_position, wl_fixed_t y_position)
+{
+    struct pointer_frame *frame = pointer_frame_add(data, time, POINTER_FRAME_MOTION, POINTER_FRAME_BUTTON);
+    frame->x_position = x_position;
+    frame->y_position = y_position;
+}
+
+static void pointer_button(void *data, struct wl_pointer *pointer, uint32_t serial, uint32_t time, uint32_t button, uint32_t state)
+{
+    struct pointer_frame *frame = pointer_frame_add(data, time, POINTER_FRAME_BUTTON, POINTER_FRAME_BUTTON);
+    frame->button_serial = serial;
+    frame->button = button;
+    frame->button_state = state;
+}
+
+static void pointer_axis(void *data, struct wl_pointer *pointer, uint32_t time, uint32_t axis, wl_fixed_t value)
+{
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL)
+    {
+        return;
+    }
+
+    struct pointer_frame *frame = pointer_frame_add(data, time, POINTER_FRAME_AXIS, 0);
+    frame->axis_value[axis] += value;
+}
+
+static void pointer_frame(void *data, struct wl_pointer *pointer)
+{
+    pointer_frame_submit(data);
+}
+
+static void pointer_axis_source(void *data, struct wl_pointer *pointer, uint32_t axis_source)
+{
+    struct pointer_frame *frame = pointer_frame_add(data, 0, POINTER_FRAME_AXIS, 0);
+    frame->axis_source = axis_source;
+}
+
+static void pointer_axis_stop(void *data, struct wl_pointer *pointer, uint32_t time, uint32_t axis)
+{
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL)
+    {
+        return;
+    }
+
+    struct pointer_frame *frame = pointer_frame_add(data, time, POINTER_FRAME_AXIS_STOP, 0);
+    frame->axis_stop |= 1u << axis;
+}
+
+static void pointer_axis_discrete(void *data, struct wl_pointer *pointer, uint32_t axis, int32_t discrete)
+{
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL)
+    {
+        return;
+    }
+
+    struct pointer_frame *frame = pointer_frame_add(data, 0, POINTER_FRAME_AXIS, 0);
+    frame->axis_discrete[axis] += discrete;
+}
+
+static const struct wl_pointer_listener pointer_listener = {
+    .enter = pointer_enter,
+    .leave = pointer_leave,
+    .motion = pointer_motion,
+    .button = pointer_button,
+    .axis = pointer_axis,
+    .frame = pointer_frame,
+    .axis_source = pointer_axis_source,
+    .axis_stop = pointer_axis_stop,
+    .axis_discrete = pointer_axis_discrete,
+};
+
+// ####################################################################################################################
+// Touch
+
+static void touch_frame_submit(struct wayland_client *client)
+{
+    struct touch_frame *frame = &client->touch_accumulator.touch_frame;
+
+    if (frame->count == 0 && !frame->cancel)
+    {
+        return;
+    }
+
+    client->touch_accumulator.type = INPUT_EVENT_TYPE_TOUCH_FRAME;
+    submit_input_event(client, &client->touch_accumulator);
+    memset(&client->touch_accumulator, 0, sizeof(client->touch_accumulator));
+}
+
+// Returns the entry of the touch point in the current frame. If the point already did something in `conflicts`, or the
+// frame is full, the frame is submitted early and a new one started.
+static struct touch_frame_point *touch_frame_add(struct wayland_client *client, uint32_t time, int32_t id, enum touch_point_mask type, uint32_t conflicts)
+{
+    struct touch_frame *frame = &client->touch_accumulator.touch_frame;
+    struct touch_frame_point *point = NULL;
+
+    for (uint32_t i = 0; i < frame->count; ++i)
+    {
+        if (frame->points[i].id == id)
+        {
+            point = &frame->points[i];
+            break;
+        }
+    }
+
+    if ((point != NULL && (point->mask & conflicts)) || (point == NULL && frame->count == TOUCH_FRAME_CAPACITY))
+    {
+        touch_frame_submit(client);
+        point = NULL;
+    }
+
+    if (point == NULL)
+    {
+        point = &frame->points[frame->count];
+        point->id = id;
+        frame->count += 1;
+    }
+
+    if (time != 0)
+    {
+        client->touch_accumulator.time = time;
+    }
+
+    point->mask |= type;
+
+    return point;
+}
+
+static void touch_down(void *data, struct wl_touch *touch, uint32_t serial, uint32_t time, struct wl_surface *surface, int32_t id, wl_fixed_t x_position, wl_fixed_t y_position)
+{
+    struct touch_frame_point *point = touch_frame_add(data, time, id, TOUCH_POINT_DOWN, TOUCH_POINT_DOWN | TOUCH_POINT_UP);
+    point->serial = serial;
+    point->surface = surface;
+    point->x_position = x_position;
+    point->y_position = y_position;
+}
+
+static void touch_up(void *data, struct wl_touch *touch, uint32_t serial, uint32_t time, int32_t id)
+{
+    touch_frame_add(data, time, id, TOUCH_POINT_UP, TOUCH_POINT_UP);
+}
+
+static void touch_motion(void *data, struct wl_touch *touch, uint32_t time, int32_t id, wl_fixed_t x_position, wl_fixed_t y_position)
+{
+    struct touch_frame_point *point = touch_frame_add(data, time, id, TOUCH_POINT_MOTION, TOUCH_POINT_UP);
+    point->x_position = x_position;
+    point->y_position = y_position;
+}
+
+static void touch_frame(void *data, struct wl_touch *touch)
+{
+    touch_frame_submit(data);
+}
+
+static void touch_cancel(void *data, struct wl_touch *touch)
+{
+    struct wayland_client *client = data;
+
+    // Not followed by a frame event.
+    memset(&client->touch_accumulator, 0, sizeof(client->touch_accumulator));
+    client->touch_accumulator.touch_frame.cancel = true;
+    touch_frame_submit(client);
+}
+
+static void touch_shape(void *data, struct wl_touch *touch, int32_t id, wl_fixed_t major, wl_fixed_t minor)
+{
+}
+
+static void touch_orientation(void *data, struct wl_touch *touch, int32_t id, wl_fixed_t orientation)
+{
+}
+
+static const struct wl_touch_listener touch_listener = {
+    .down = touch_down,
+    .up = touch_up,
+    .motion = touch_motion,
+    .frame = touch_frame,
+    .cancel = touch_cancel,
+    .shape = touch_shape,
+    .orientation = touch_orientation,
+};
+
+// ####################################################################################################################
+// Seat
+
+static void wl_seat_capabilities(void *data, struct wl_seat *seat, uint32_t capabilities)
+{
+    struct wayland_client *client = data;
+
+    bool have_pointer = capabilities & WL_SEAT_CAPABILITY_POINTER;
+    bool have_keyboard = capabilities & WL_SEAT_CAPABILITY_KEYBOARD;
+    bool have_touch = capabilities & WL_SEAT_CAPABILITY_TOUCH;
+
+    // Capabilities are announced again whenever any of them changes, so existing objects are kept.
+    if (have_pointer && client->pointer == NULL)
+    {
+        client->pointer = wl_seat_get_pointer(client->seat);
+        wl_pointer_add_listener(client->pointer, &pointer_listener, client);
+    }
+
+    if (have_touch && client->touch == NULL)
+    {
+        client->touch = wl_seat_get_touch(client->seat);
+        wl_touch_add_listener(client->touch, &touch_listener, client);
+    }
+    else if (!have_touch && client->touch != NULL)
+    {
+        wl_touch_release(client->touch);
+        client->touch = NULL;
+
+        // Lifts all points that were still down.
+        touch_cancel(client, NULL);
+    }
+
+    if (have_keyboard && client->keyboard == NULL)
+    {
+        if (client->xkb_context == NULL)
+        {
+            client->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+        }
+
+        client->keyboard = wl_seat_get_keyboard(client->seat);
+        wl_keyboard_add_listener(client->keyboard, &keyboard_listener, client);
+    }
+    else if (!have_keyboard && client->keyboard != NULL)
+    {
+        wl_keyboard_release(client->keyboard);
+        client->keyboard = NULL;
+        client->keyboard_key_held = false;
+        keyboard_reset_keymap(client);
+
+        // Stops key repeat, which the keyboard cannot do anymore.
+        struct input_event event = {.type = INPUT_EVENT_TYPE_KEYBOARD_LEAVE};
+        submit_input_event(client, &event);
+    }
+}
+
+static void wl_seat_name(void *data, struct wl_seat *seat, const char *name)
+{
+}
+
+static const struct wl_seat_listener seat_listener = {
+    .capabilities = wl_seat_capabilities,
+    .name = wl_seat_name,
+};
+
+// ####################################################################################################################
+// Output
+
+static void window_set_scale(struct window *window, int32_t scale)
+{
+    if (scale == window->scale)
+    {
+        return;
+    }
+
+    printf("info (output): Buffer scale changed from %.3f to %.3f.\n", (double) window->scale / SCALE_DENOMINATOR, (double) scale / SCALE_DENOMINATOR);
+    window->scale = scale;
+
+    // Before the first configure there is nothing to redraw yet.
+    if (window->configured)
+    {
+        window_render(window);
+    }
+}
+
+// Buffers are drawn for the densest output the window is on. While it is on none, the last scale is kept.
+static void window_update_scale(struct window *window)
+{
+    // The compositor tells the exact scale, which already accounts for the outputs.
+    if (window->fractional_scale != NULL)
+    {
+        return;
+    }
+
+    int32_t scale = 0;
+
+    for (int i = 0; i < WINDOW_MAX_OUTPUTS; ++i)
+    {
+        struct output *output = window->outputs[i].output;
+
+        if (output != NULL && output->scale > scale)
+        {
+            scale = output->scale;
+        }
+    }
+
+    if (scale != 0)
+    {
+        window_set_scale(window, scale * SCALE_DENOMINATOR);
+    }
+}
+
+static void output_update_scale(struct wayland_client *client)
+{
+    struct window *window;
+
+    wl_list_for_each(window, &client->windows, link)
+    {
+        window_update_scale(window);
+    }
+}
+
+static void output_geometry(void *data, struct wl_output *wl_output, int32_t x, int32_t y, int32_t physical_width, int32_t physical_height,
+                            int32_t subpixel, const char *make, const char *model, int32_t transform)
+{
+}
+
+static void output_mode(void *data, struct wl_output *wl_output, uint32_t flags, int32_t width, int32_t height, int32_t refresh)
+{
+}
+
+static void output_done(void *data, struct wl_output *wl_output)
+{
+    struct output *output = data;
+
+    if (output->scale != output->pending_scale)
+    {
+        output->scale = output->pending_scale;
+        output_update_scale(output->client);
+    }
+}
+
+static void output_scale(void *data, struct wl_output *wl_output, int32_t factor)
+{
+    struct output *output = data;
+    output->pending_scale = factor;
+}
+
+static const struct wl_output_listener output_listener = {
+    .geometry = output_geometry,
+    .mode = output_mode,
+    .done = output_done,
+    .scale = output_scale,
+};
+
+static void output_create(struct wayland_client *client, uint32_t name)
+{
+    struct output *output = calloc(1, sizeof(struct output));
+
+    if (output == NULL)
+    {
+        return;
+    }
+
+    output->client = client;
+    output->name = name;
+    output->scale = 1;
+    output->pending_scale = 1;
+    output->wl_output = wl_registry_bind(client->registry, name, &wl_output_interface, 2);
+    wl_output_add_listener(output->wl_output, &output_listener, output);
+    wl_list_insert(&client->outputs, &output->link);
+}
+
+static void output_destroy(struct output *output)
+{
+    struct window *window;
+
+    wl_list_for_each(window, &output->client->windows, link)
+    {
+        for (int i = 0; i < WINDOW_MAX_OUTPUTS; ++i)
+        {
+            if (window->outputs[i].output == output)
+            {
+                window->outputs[i].output = NULL;
+                window->outputs[i].surfaces = 0;
+            }
+        }
+    }
+
+    wl_list_remove(&output->link);
+    wl_output_destroy(output->wl_output);
+    free(output);
+}
+
+// Surfaces only report outputs this client has bound, anything else is ignored.
+static struct output *output_find(struct wayland_client *client, struct wl_output *wl_output)
+{
+    struct output *output;
+
+    wl_list_for_each(output, &client->outputs, link)
+    {
+        if (output->wl_output == wl_output)
+        {
+            return output;
+        }
+    }
+
+    return NULL;
+}
+
+// Shared by the content and the decor surface, the window is on an output as long as either of them is.
+static void surface_enter(void *data, struct wl_surface *surface, struct wl_output *wl_output)
+{
+    struct window *window = data;
+    struct output *output = output_find(window->client, wl_output);
+    int slot = -1;
+
+    if (output == NULL)
+    {
+        return;
+    }
+
+    for (int i = 0; i < WINDOW_MAX_OUTPUTS; ++i)
+    {
+        if (window->outputs[i].output == output)
+        {
+            window->outputs[i].surfaces += 1;
+            return;
+        }
+
+        if (slot == -1 && window->outputs[i].output == NULL)
+        {
+            slot = i;
+        }
+    }
+
+    if (slot != -1)
     {
-        client->cursor_decor_position &= ~CURSOR_DECOR_POSITION_BOTTOM_LEFT_CORNER;
+        window->outputs[slot].output = output;
+        window->outputs[slot].surfaces = 1;
+        window_update_scale(window);
     }
-    else if (surface == client->decor.corner_bottom_right_surface)
+}
+
+static void surface_leave(void *data, struct wl_surface *surface, struct wl_output *wl_output)
+{
+    struct window *window = data;
+    struct output *output = output_find(window->client, wl_output);
+
+    if (output == NULL)
     {
-        client->cursor_decor_position &= ~CURSOR_DECOR_POSITION_BOTTOM_RIGHT_CORNER;
+        return;
     }
-    else if (surface == client->decor.border_top_surface)
+
+    for (int i = 0; i < WINDOW_MAX_OUTPUTS; ++i)
     {
-        client->cursor_decor_position &= ~CURSOR_DECOR_POSITION_TOP_BORDER;
+        if (window->outputs[i].output == output)
+        {
+            window->outputs[i].surfaces -= 1;
+
+            if (window->outputs[i].surfaces == 0)
+            {
+                window->outputs[i].output = NULL;
+                window_update_scale(window);
+            }
+
+            return;
+        }
     }
-    else if (surface == client->decor.border_bottom_surface)
+}
+
+static const struct wl_surface_listener surface_listener = {
+    .enter = surface_enter,
+    .leave = surface_leave,
+};
+
+static void fractional_scale_preferred_scale(void *data, struct wp_fractional_scale_v1 *fractional_scale, uint32_t scale)
+{
+    window_set_scale(data, scale);
+}
+
+static const struct wp_fractional_scale_v1_listener fractional_scale_listener = {
+    .preferred_scale = fractional_scale_preferred_scale,
+};
+
+// Fractional scales need a viewport per surface, since buffer sizes no longer divide by the scale. Called whenever one
+// of the objects involved is created, since their globals may arrive in any order.
+static void viewports_create(struct window *window)
+{
+    struct wayland_client *client = window->client;
+
+    if (client->viewporter == NULL || client->fractional_scale_manager == NULL)
     {
-        client->cursor_decor_position &= ~CURSOR_DECOR_POSITION_BOTTOM_BORDER;
+        return;
     }
-    else if (surface == client->decor.border_left_surface)
+
+    if (window->fractional_scale == NULL)
     {
-        client->cursor_decor_position &= ~CURSOR_DECOR_POSITION_LEFT_BORDER;
+        window->content.viewport = wp_viewporter_get_viewport(client->viewporter, window->surface);
+        window->fractional_scale = wp_fractional_scale_manager_v1_get_fractional_scale(client->fractional_scale_manager, window->surface);
+        wp_fractional_scale_v1_add_listener(window->fractional_scale, &fractional_scale_listener, window);
     }
-    else if (surface == client->decor.border_right_surface)
+
+    if (window->decor.viewport == NULL && window->decor.surface != NULL)
     {
-        client->cursor_decor_position &= ~CURSOR_DECOR_POSITION_RIGHT_BORDER;
+        window->decor.viewport = wp_viewporter_get_viewport(client->viewporter, window->decor.surface);
     }
 }
 
-static void pointer_motion(void *data, struct wl_pointer *pointer, uint32_t time, wl_fixed_t x_position, wl_fixed_t y_position)
+// ####################################################################################################################
+// Startup
+
+static void decor_create(struct window *window)
 {
-    struct wayland_client *client = data;
-    client->pointer_x_position = x_position;
-    client->pointer_y_position = y_position;
+    struct wayland_client *client = window->client;
+
+    if (window->decor.surface != NULL || client->subcompositor == NULL)
+    {
+        return;
+    }
+
+    window->decor.surface = wl_compositor_create_surface(client->compositor);
+    wl_surface_add_listener(window->decor.surface, &surface_listener, window);
+    window->decor.subsurface = wl_subcompositor_get_subsurface(client->subcompositor, window->decor.surface, window->surface);
+    wl_subsurface_set_position(window->decor.subsurface, -(int32_t) BORDER_WIDTH, -(int32_t) (BORDER_WIDTH + TITLEBAR_WIDTH));
+    wl_subsurface_place_below(window->decor.subsurface, window->surface);
+    viewports_create(window);
 }
 
-static void pointer_button(void *data, struct wl_pointer *pointer, uint32_t serial, uint32_t time, uint32_t button, uint32_t state)
+static void window_create(struct wayland_client *client)
 {
-    struct wayland_client *client = data;
+    struct window *window = calloc(1, sizeof(struct window));
 
-    if (client->cursor_decor_position & CURSOR_DECOR_POSITION_TITLEBAR)
+    if (window == NULL)
     {
-        xdg_toplevel_move(client->xdg_toplevel, client->seat, serial);
+        return;
     }
-    if (client->cursor_decor_position & CURSOR_DECOR_POSITION_CLOSE_BUTTON)
+
+    window->surface = wl_compositor_create_surface(client->compositor);
+    window->render_surface = proxy_wrap(window->surface, client->render_queue);
+    struct xdg_wm_base *render_xdg_wm_base = proxy_wrap(client->xdg_wm_base, client->render_queue);
+
+    if (window->render_surface == NULL || render_xdg_wm_base == NULL)
     {
-        client->should_close = true;
+        if (window->render_surface != NULL)
+        {
+            wl_proxy_wrapper_destroy(window->render_surface);
+        }
+
+        if (render_xdg_wm_base != NULL)
+        {
+            wl_proxy_wrapper_destroy(render_xdg_wm_base);
+        }
+
+        wl_surface_destroy(window->surface);
+        free(window);
+        return;
     }
-    else if (client->cursor_decor_position & CURSOR_DECOR_POSITION_TOP_LEFT_CORNER)
+
+    window->client = client;
+    window->width = 1280;
+    window->height = 720;
+    window->scale = SCALE_DENOMINATOR;
+    window->content.scale = SCALE_DENOMINATOR;
+    window->decor.scale = SCALE_DENOMINATOR;
+    window->swapchain.release = content_buffer_release;
+    window->swapchain.release_data = window;
+    wl_list_insert(client->windows.prev, &window->link);
+
+    wl_surface_add_listener(window->surface, &surface_listener, window);
+    // The toplevel inherits the queue of the xdg_surface.
+    window->xdg_surface = xdg_wm_base_get_xdg_surface(render_xdg_wm_base, window->surface);
+    wl_proxy_wrapper_destroy(render_xdg_wm_base);
+    xdg_surface_add_listener(window->xdg_surface, &xdg_surface_listener, window);
+    window->xdg_toplevel = xdg_surface_get_toplevel(window->xdg_surface);
+    xdg_toplevel_add_listener(window->xdg_toplevel, &xdg_toplevel_listener, window);
+    xdg_toplevel_set_title(window->xdg_toplevel, "Minimal Window");
+    xdg_toplevel_set_min_size(window->xdg_toplevel, 300, 300);
+    decor_create(window);
+    viewports_create(window);
+    wl_surface_commit(window->surface);
+}
+
+// Creates all windows at once, as soon as the globals they need have arrived. Their first configure draws right away,
+// so that includes `wl_shm`.
+static void windows_create(struct wayland_client *client)
+{
+    if (!wl_list_empty(&client->windows) || client->compositor == NULL || client->xdg_wm_base == NULL || client->shm == NULL)
     {
-        xdg_toplevel_resize(client->xdg_toplevel, client->seat, serial, XDG_TOPLEVEL_RESIZE_EDGE_TOP_LEFT);
+        return;
     }
-    else if (client->cursor_decor_position & CURSOR_DECOR_POSITION_TOP_RIGHT_CORNER)
+
+    for (int i = 0; i < client->window_count; ++i)
     {
-        xdg_toplevel_resize(client->xdg_toplevel, client->seat, serial, XDG_TOPLEVEL_RESIZE_EDGE_TOP_RIGHT);
+        window_create(client);
     }
-    else if (client->cursor_decor_position & CURSOR_DECOR_POSITION_BOTTOM_LEFT_CORNER)
+}
+
+static void window_destroy(struct window *window)
+{
+    struct wayland_client *client = window->client;
+
+    // Frame callbacks of a destroyed surface never complete. The input batched for the window is dropped with it.
+    if (client->pointer_batch.window == window)
     {
-        xdg_toplevel_resize(client->xdg_toplevel, client->seat, serial, XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM_LEFT);
+        client->pointer_batch.window = NULL;
     }
-    else if (client->cursor_decor_position & CURSOR_DECOR_POSITION_BOTTOM_RIGHT_CORNER)
+
+    if (client->pointer_window == window)
     {
-        xdg_toplevel_resize(client->xdg_toplevel, client->seat, serial, XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM_RIGHT);
+        client->pointer_batch.pending.pointer_frame.mask = 0;
+        client->pointer_window = NULL;
+        client->pointer_role = NULL;
     }
-    else if (client->cursor_decor_position & CURSOR_DECOR_POSITION_TOP_BORDER)
+
+    if (client->keyboard_window == window)
     {
-        xdg_toplevel_resize(client->xdg_toplevel, client->seat, serial, XDG_TOPLEVEL_RESIZE_EDGE_TOP);
+        client->keyboard_window = NULL;
     }
-    else if (client->cursor_decor_position & CURSOR_DECOR_POSITION_BOTTOM_BORDER)
+
+    for (int i = 0; i < TOUCH_FRAME_CAPACITY; ++i)
     {
-        xdg_toplevel_resize(client->xdg_toplevel, client->seat, serial, XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM);
+        if (client->touch_points[i].window == window)
+        {
+            client->touch_points[i].active = false;
+            client->touch_points[i].window = NULL;
+        }
     }
-    else if (client->cursor_decor_position & CURSOR_DECOR_POSITION_LEFT_BORDER)
+
+    if (window->content.callback != NULL)
     {
-        xdg_toplevel_resize(client->xdg_toplevel, client->seat, serial, XDG_TOPLEVEL_RESIZE_EDGE_LEFT);
+        wl_callback_destroy(window->content.callback);
     }
-    else if (client->cursor_decor_position & CURSOR_DECOR_POSITION_RIGHT_BORDER)
+
+    swapchain_destroy(&window->swapchain);
+
+    if (window->fractional_scale != NULL)
     {
-        xdg_toplevel_resize(client->xdg_toplevel, client->seat, serial, XDG_TOPLEVEL_RESIZE_EDGE_RIGHT);
+        wp_fractional_scale_v1_destroy(window->fractional_scale);
+        wp_viewport_destroy(window->content.viewport);
     }
-}
 
-static void pointer_axis(void *data, struct wl_pointer *pointer, uint32_t time, uint32_t axis, wl_fixed_t value)
-{
-}
+    if (window->decor.surface != NULL)
+    {
+        if (window->decor.viewport != NULL)
+        {
+            wp_viewport_destroy(window->decor.viewport);
+        }
 
-static void pointer_frame(void *data, struct wl_pointer *pointer)
-{
-}
+        wl_subsurface_destroy(window->decor.subsurface);
+        wl_surface_destroy(window->decor.surface);
+    }
 
-static void pointer_axis_source(void *data, struct wl_pointer *pointer, uint32_t axis_source)
-{
-}
+    xdg_toplevel_destroy(window->xdg_toplevel);
+    xdg_surface_destroy(window->xdg_surface);
+    wl_proxy_wrapper_destroy(window->render_surface);
+    wl_surface_destroy(window->surface);
 
-static void pointer_axis_stop(void *data, struct wl_pointer *pointer, uint32_t time, uint32_t axis)
-{
+    wl_list_remove(&window->link);
+    free(window);
 }
 
-static void pointer_axis_discrete(void *data, struct wl_pointer *pointer, uint32_t axis, int32_t discrete)
+// Windows are closed from within input and toplevel handlers, which may still use them, so they are only destroyed
+// between dispatches. The client exits with its last window.
+static void windows_reap(struct wayland_client *client)
 {
-}
+    struct window *window;
+    struct window *tmp;
+    bool closed = false;
 
-static const struct wl_pointer_listener pointer_listener = {
-    .enter = pointer_enter,
-    .leave = pointer_leave,
-    .motion = pointer_motion,
-    .button = pointer_button,
-    .axis = pointer_axis,
-    .frame = pointer_frame,
-    .axis_source = pointer_axis_source,
-    .axis_stop = pointer_axis_stop,
-    .axis_discrete = pointer_axis_discrete,
-};
+    wl_list_for_each_safe(window, tmp, &client->windows, link)
+    {
+        if (window->closed)
+        {
+            window_destroy(window);
+            closed = true;
+        }
+    }
 
-// ####################################################################################################################
-// Seat
+    if (closed && wl_list_empty(&client->windows))
+    {
+        client->should_close = true;
+    }
+}
 
-static void wl_seat_capabilities(void *data, struct wl_seat *seat, uint32_t capabilities)
+static void cursors_loaded(void *data, int fd, uint32_t events)
 {
     struct wayland_client *client = data;
+    struct cursor_loader_result result;
+    cursor_loader_finish(client->cursor_loader, &result);
+    client->cursor_loader = NULL;
+    event_source_remove(client->cursor_loader_source);
+    close(fd);
 
-    bool have_pointer = capabilities & WL_SEAT_CAPABILITY_POINTER;
-    bool have_keyboard = capabilities & WL_SEAT_CAPABILITY_KEYBOARD;
+    client->cursors.theme = result.theme;
 
-    if (have_pointer && client->pointer == NULL)
+    client->startup_stats.cursors_ns = result.duration_ns;
+    client->startup_stats.cursors_ready_ns = get_monotonic_time_ns();
+    startup_stats_print_cursors(&client->startup_stats);
+
+    if (client->pointer_inside)
     {
-        client->pointer = wl_seat_get_pointer(client->seat);
-        wl_pointer_add_listener(client->pointer, &pointer_listener, client);
+        set_cursor(client, client->pointer_enter_serial, client->cursor_variant);
     }
-    else
+}
+
+// Parsing the theme can take long on slow disks, so it runs on a worker thread.
+static void cursors_load(struct wayland_client *client)
+{
+    // The compositor draws the cursors itself, the theme is not needed at all.
+    if (client->cursor_shape_manager != NULL)
     {
-        // TODO Handle touch input?
+        return;
     }
 
-    if (have_keyboard)
+    client->cursor_surface = wl_compositor_create_surface(client->compositor);
+
+    int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    client->cursor_loader = cursor_loader_start(client->shm, 24, fd);
+
+    if (client->cursor_loader == NULL)
     {
-        client->keyboard = wl_seat_get_keyboard(client->seat);
-        client->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-        wl_keyboard_add_listener(client->keyboard, &keyboard_listener, client);
+        close(fd);
+        return;
     }
-    else
+
+    client->cursor_loader_fd = fd;
+    client->cursor_loader_source = event_loop_add_fd(client->loop, fd, EPOLLIN, cursors_loaded, client);
+}
+
+static void globals_callback_done(void *data, struct wl_callback *callback, uint32_t time)
+{
+    struct wayland_client *client = data;
+    wl_callback_destroy(callback);
+    client->globals_callback = NULL;
+    client->startup_stats.globals_ready_ns = get_monotonic_time_ns();
+
+    if (wl_list_empty(&client->windows) || client->shm == NULL || client->seat == NULL)
     {
-        // What?
+        fprintf(stderr, "error (wayland): The compositor lacks a required global.\n");
+        client->should_close = true;
     }
 }
 
-static void wl_seat_name(void *data, struct wl_seat *seat, const char *name)
+static const struct wl_callback_listener globals_callback_listener = {
+    .done = globals_callback_done,
+};
+
+// ####################################################################################################################
+// Presentation
+
+static void presentation_clock_id(void *data, struct wp_presentation *presentation, uint32_t clock_id)
 {
+    struct wayland_client *client = data;
+    client->presentation_clock = clock_id;
 }
 
-static const struct wl_seat_listener seat_listener = {
-    .capabilities = wl_seat_capabilities,
-    .name = wl_seat_name,
+static const struct wp_presentation_listener presentation_listener = {
+    .clock_id = presentation_clock_id,
 };
 
 // ####################################################################################################################
@@ -592,35 +2613,94 @@ static const struct wl_seat_listener seat_listener = {
 static void registry_global(void *data, struct wl_registry *registry, uint32_t name, const char *interface, uint32_t version)
 {
     struct wayland_client *client = data;
+    struct window *window;
     printf("info (wayland): Registred interface `%s-%d`.\n", interface, version);
 
     if (strcmp(interface, wl_shm_interface.name) == 0)
     {
         client->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+        shm_pool_init(&client->shm_pool, client->shm);
+        windows_create(client);
     }
     else if (strcmp(interface, wl_compositor_interface.name) == 0)
     {
         client->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 5);
+        windows_create(client);
     }
     else if (strcmp(interface, xdg_wm_base_interface.name) == 0)
     {
         client->xdg_wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 4);
         xdg_wm_base_add_listener(client->xdg_wm_base, &xdg_wm_base_listener, client);
+        windows_create(client);
     }
     else if (strcmp(interface, wl_seat_interface.name) == 0)
     {
-        client->seat = wl_registry_bind(registry, name, &wl_seat_interface, 5);
-        wl_seat_add_listener(client->seat, &seat_listener, client);
+        // The pointer and keyboard inherit the queue of the seat.
+        struct wl_registry *input_registry = proxy_wrap(registry, client->input_queue);
+
+        if (input_registry != NULL)
+        {
+            client->seat = wl_registry_bind(input_registry, name, &wl_seat_interface, 5);
+            wl_proxy_wrapper_destroy(input_registry);
+            wl_seat_add_listener(client->seat, &seat_listener, client);
+        }
     }
     else if (strcmp(interface, wl_subcompositor_interface.name) == 0)
     {
         client->subcompositor = wl_registry_bind(registry, name, &wl_subcompositor_interface, 1);
+
+        wl_list_for_each(window, &client->windows, link)
+        {
+            decor_create(window);
+        }
+    }
+    else if (strcmp(interface, wp_cursor_shape_manager_v1_interface.name) == 0)
+    {
+        client->cursor_shape_manager = wl_registry_bind(registry, name, &wp_cursor_shape_manager_v1_interface, 1);
+    }
+    else if (strcmp(interface, wl_output_interface.name) == 0 && version >= 2)
+    {
+        output_create(client, name);
+    }
+    else if (strcmp(interface, wp_viewporter_interface.name) == 0)
+    {
+        client->viewporter = wl_registry_bind(registry, name, &wp_viewporter_interface, 1);
+
+        wl_list_for_each(window, &client->windows, link)
+        {
+            viewports_create(window);
+        }
+    }
+    else if (strcmp(interface, wp_fractional_scale_manager_v1_interface.name) == 0)
+    {
+        client->fractional_scale_manager = wl_registry_bind(registry, name, &wp_fractional_scale_manager_v1_interface, 1);
+
+        wl_list_for_each(window, &client->windows, link)
+        {
+            viewports_create(window);
+        }
+    }
+    else if (strcmp(interface, wp_presentation_interface.name) == 0)
+    {
+        client->presentation = wl_registry_bind(registry, name, &wp_presentation_interface, 1);
+        wp_presentation_add_listener(client->presentation, &presentation_listener, client);
     }
 }
 
 static void registry_global_remove(void *data, struct wl_registry *registry, uint32_t name)
 {
-    // TODO: I have no idea what to do here.
+    struct wayland_client *client = data;
+    struct output *output;
+
+    wl_list_for_each(output, &client->outputs, link)
+    {
+        if (output->name == name)
+        {
+            output_destroy(output);
+            output_update_scale(client);
+            return;
+        }
+    }
 }
 
 static const struct wl_registry_listener registry_listener = {
@@ -628,95 +2708,250 @@ static const struct wl_registry_listener registry_listener = {
     .global_remove = registry_global_remove,
 };
 
-int main()
+// ####################################################################################################################
+// Signals
+
+static void handle_terminate_signal(void *data, int signal_number)
+{
+    struct wayland_client *client = data;
+    client->should_close = true;
+}
+
+int main(int argc, char **argv)
 {
     struct wayland_client client = {0};
-    client.width = 1280;
-    client.height = 720;
+    // The counter is shared with everything else in the process.
+    uint64_t start_request_count = atomic_load(&request_count);
+    client.request_stats.frame_request_count = start_request_count;
+    // Used until the compositor sends its own repeat info.
+    client.key_repeat.rate = 25;
+    client.key_repeat.delay = 600;
+    client.pending_keymap_fd = -1;
+    client.window_count = 1;
+    wl_list_init(&client.outputs);
+    wl_list_init(&client.windows);
+
+    bool threaded = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--threaded") == 0)
+        {
+            threaded = true;
+        }
+        else if (strcmp(argv[i], "--coalesce-pointer") == 0)
+        {
+            client.pointer_batch.enabled = true;
+        }
+        else if (strcmp(argv[i], "--windows") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+        {
+            client.window_count = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--threaded] [--coalesce-pointer] [--windows count]\n", argv[0]);
+            return 1;
+        }
+    }
 
+    client.startup_stats.start_ns = get_monotonic_time_ns();
     client.display = wl_display_connect(NULL);
+
+    if (client.display == NULL)
+    {
+        fprintf(stderr, "error (wayland): Failed to connect to the display.\n");
+        return 1;
+    }
+
+    client.startup_stats.connect_ns = get_monotonic_time_ns();
+    client.input_queue = wl_display_create_queue(client.display);
+    client.render_queue = wl_display_create_queue(client.display);
+    client.input_queue_stats.name = "input";
+    client.render_queue_stats.name = "render";
+
     client.registry = wl_display_get_registry(client.display);
     wl_registry_add_listener(client.registry, &registry_listener, &client);
-    wl_display_roundtrip(client.display);
-
-    client.surface = wl_compositor_create_surface(client.compositor);
-    client.xdg_surface = xdg_wm_base_get_xdg_surface(client.xdg_wm_base, client.surface);
-    xdg_surface_add_listener(client.xdg_surface, &xdg_surface_listener, &client);
-    client.xdg_toplevel = xdg_surface_get_toplevel(client.xdg_surface);
-    xdg_toplevel_add_listener(client.xdg_toplevel, &xdg_toplevel_listener, &client);
-    xdg_toplevel_set_title(client.xdg_toplevel, "Minimal Window");
-    xdg_toplevel_set_min_size(client.xdg_toplevel, 300, 300);
-    wl_surface_commit(client.surface);
-
-    client.decor.titlebar_surface = wl_compositor_create_surface(client.compositor);
-    client.decor.titlebar_subsurface = wl_subcompositor_get_subsurface(client.subcompositor, client.decor.titlebar_surface, client.surface);
-    client.decor.close_button_surface = wl_compositor_create_surface(client.compositor);
-    client.decor.close_button_subsurface = wl_subcompositor_get_subsurface(client.subcompositor, client.decor.close_button_surface, client.surface);
-    client.decor.border_top_surface = wl_compositor_create_surface(client.compositor);
-    client.decor.border_top_subsurface = wl_subcompositor_get_subsurface(client.subcompositor, client.decor.border_top_surface, client.surface);
-    client.decor.border_bottom_surface = wl_compositor_create_surface(client.compositor);
-    client.decor.border_bottom_subsurface = wl_subcompositor_get_subsurface(client.subcompositor, client.decor.border_bottom_surface, client.surface);
-    client.decor.border_left_surface = wl_compositor_create_surface(client.compositor);
-    client.decor.border_left_subsurface = wl_subcompositor_get_subsurface(client.subcompositor, client.decor.border_left_surface, client.surface);
-    client.decor.border_right_surface = wl_compositor_create_surface(client.compositor);
-    client.decor.border_right_subsurface = wl_subcompositor_get_subsurface(client.subcompositor, client.decor.border_right_surface, client.surface);
-    client.decor.corner_top_left_surface = wl_compositor_create_surface(client.compositor);
-    client.decor.corner_top_left_subsurface = wl_subcompositor_get_subsurface(client.subcompositor, client.decor.corner_top_left_surface, client.surface);
-    client.decor.corner_top_right_surface = wl_compositor_create_surface(client.compositor);
-    client.decor.corner_top_right_subsurface = wl_subcompositor_get_subsurface(client.subcompositor, client.decor.corner_top_right_surface, client.surface);
-    client.decor.corner_bottom_left_surface = wl_compositor_create_surface(client.compositor);
-    client.decor.corner_bottom_left_subsurface = wl_subcompositor_get_subsurface(client.subcompositor, client.decor.corner_bottom_left_surface, client.surface);
-    client.decor.corner_bottom_right_surface = wl_compositor_create_surface(client.compositor);
-    client.decor.corner_bottom_right_subsurface = wl_subcompositor_get_subsurface(client.subcompositor, client.decor.corner_bottom_right_surface, client.surface);
-
-    struct wl_cursor_theme *cursor_theme = wl_cursor_theme_load(NULL, 24, client.shm);
-
-    struct wl_cursor *cursor = wl_cursor_theme_get_cursor(cursor_theme, "left_ptr");
-    client.cursor_images[CURSOR_VARIANT_LEFT_PTR] = cursor->images[0];
-    client.cursor_buffers[CURSOR_VARIANT_LEFT_PTR] = wl_cursor_image_get_buffer(client.cursor_images[CURSOR_VARIANT_LEFT_PTR]);
-
-    cursor = wl_cursor_theme_get_cursor(cursor_theme, "pointer");
-    client.cursor_images[CURSOR_VARIANT_POINTER] = cursor->images[0];
-    client.cursor_buffers[CURSOR_VARIANT_POINTER] = wl_cursor_image_get_buffer(client.cursor_images[CURSOR_VARIANT_POINTER]);
-
-    cursor = wl_cursor_theme_get_cursor(cursor_theme, "n-resize");
-    client.cursor_images[CURSOR_VARIANT_N_RESIZE] = cursor->images[0];
-    client.cursor_buffers[CURSOR_VARIANT_N_RESIZE] = wl_cursor_image_get_buffer(client.cursor_images[CURSOR_VARIANT_N_RESIZE]);
-
-    cursor = wl_cursor_theme_get_cursor(cursor_theme, "s-resize");
-    client.cursor_images[CURSOR_VARIANT_S_RESIZE] = cursor->images[0];
-    client.cursor_buffers[CURSOR_VARIANT_S_RESIZE] = wl_cursor_image_get_buffer(client.cursor_images[CURSOR_VARIANT_S_RESIZE]);
-
-    cursor = wl_cursor_theme_get_cursor(cursor_theme, "w-resize");
-    client.cursor_images[CURSOR_VARIANT_W_RESIZE] = cursor->images[0];
-    client.cursor_buffers[CURSOR_VARIANT_W_RESIZE] = wl_cursor_image_get_buffer(client.cursor_images[CURSOR_VARIANT_W_RESIZE]);
-
-    cursor = wl_cursor_theme_get_cursor(cursor_theme, "e-resize");
-    client.cursor_images[CURSOR_VARIANT_E_RESIZE] = cursor->images[0];
-    client.cursor_buffers[CURSOR_VARIANT_E_RESIZE] = wl_cursor_image_get_buffer(client.cursor_images[CURSOR_VARIANT_E_RESIZE]);
-
-    cursor = wl_cursor_theme_get_cursor(cursor_theme, "nw-resize");
-    client.cursor_images[CURSOR_VARIANT_NW_RESIZE] = cursor->images[0];
-    client.cursor_buffers[CURSOR_VARIANT_NW_RESIZE] = wl_cursor_image_get_buffer(client.cursor_images[CURSOR_VARIANT_NW_RESIZE]);
-
-    cursor = wl_cursor_theme_get_cursor(cursor_theme, "ne-resize");
-    client.cursor_images[CURSOR_VARIANT_NE_RESIZE] = cursor->images[0];
-    client.cursor_buffers[CURSOR_VARIANT_NE_RESIZE] = wl_cursor_image_get_buffer(client.cursor_images[CURSOR_VARIANT_NE_RESIZE]);
-
-    cursor = wl_cursor_theme_get_cursor(cursor_theme, "sw-resize");
-    client.cursor_images[CURSOR_VARIANT_SW_RESIZE] = cursor->images[0];
-    client.cursor_buffers[CURSOR_VARIANT_SW_RESIZE] = wl_cursor_image_get_buffer(client.cursor_images[CURSOR_VARIANT_SW_RESIZE]);
-
-    cursor = wl_cursor_theme_get_cursor(cursor_theme, "se-resize");
-    client.cursor_images[CURSOR_VARIANT_SE_RESIZE] = cursor->images[0];
-    client.cursor_buffers[CURSOR_VARIANT_SE_RESIZE] = wl_cursor_image_get_buffer(client.cursor_images[CURSOR_VARIANT_SE_RESIZE]);
-
-    client.cursor_surface = wl_compositor_create_surface(client.compositor);
-
-    printf("Use the Escape key to close the window.\n");
-
-    while (wl_display_dispatch(client.display) != -1 && !client.should_close)
+
+    // Objects are created as soon as their globals arrive. The sync only marks the end of the initial globals.
+    client.globals_callback = wl_display_sync(client.display);
+    wl_callback_add_listener(client.globals_callback, &globals_callback_listener, &client);
+
+    client.loop = event_loop_create(client.display);
+    event_loop_set_request_stats(client.loop, &client.request_stats);
+    event_loop_add_signal(client.loop, SIGINT, handle_terminate_signal, &client);
+    event_loop_add_signal(client.loop, SIGTERM, handle_terminate_signal, &client);
+    client.key_repeat.timer = event_loop_add_timer(client.loop, key_repeat_fire, &client);
+    client.cursor_animation.timer = event_loop_add_timer(client.loop, cursor_animation_advance, &client);
+    client.pointer_batch.timer = event_loop_add_timer(client.loop, pointer_batch_timer_fire, &client);
+
+    if (threaded)
+    {
+        input_ring_init(&client.input_ring);
+        client.input_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        client.input_space_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        event_loop_add_fd(client.loop, client.input_event_fd, EPOLLIN, consume_input_events, &client);
+        client.reader_thread = reader_thread_start(client.display, client.input_queue, &client.input_queue_stats, notify_input_events, &client);
+    }
+    else
+    {
+        event_loop_add_queue(client.loop, client.input_queue, &client.input_queue_stats);
+    }
+
+    event_loop_add_queue(client.loop, client.render_queue, &client.render_queue_stats);
+
+    printf("Use the Escape key to close the focused window.\n");
+
+    while (!client.should_close && event_loop_dispatch(client.loop, -1) != -1)
+    {
+        windows_reap(&client);
+    }
+
+    // Nothing is dispatched anymore from here on, and everything is torn down in reverse order of creation.
+    if (client.reader_thread != NULL)
+    {
+        reader_thread_stop(client.reader_thread);
+        close(client.input_event_fd);
+        close(client.input_space_fd);
+    }
+
+    latency_histogram_print(&client.input_queue_latency, "input decode to handled");
+    latency_histogram_print(&client.input_age_latency, "input compositor timestamp to handled");
+    queue_stats_print(&client.input_queue_stats);
+    queue_stats_print(&client.render_queue_stats);
+    client.request_stats.requests = atomic_load(&request_count) - start_request_count;
+    request_stats_print(&client.request_stats);
+    pointer_stats_print(&client.pointer_stats);
+
+    if (threaded)
+    {
+        input_ring_stats_print(&client.input_ring_stats);
+    }
+
+    content_stats_print(&client.content_stats);
+    keymap_stats_print(&client.keymap_stats);
+    input_latency_stats_print(&client.input_latency_stats);
+    printf("info (stats): cursor buffers=%zu bytes.\n", client.cursors.buffer_bytes);
+    printf("info (stats): shm pool files=%zu size=%zu bytes allocated=%zu bytes.\n", client.shm_pool.file_count, client.shm_pool.size, client.shm_pool.allocated);
+
+    // A theme that finished loading after the last dispatch is released with the cache.
+    if (client.cursor_loader != NULL)
+    {
+        struct cursor_loader_result result;
+        cursor_loader_finish(client.cursor_loader, &result);
+        close(client.cursor_loader_fd);
+        client.cursors.theme = result.theme;
+    }
+
+    struct window *window;
+    struct window *tmp_window;
+
+    wl_list_for_each_safe(window, tmp_window, &client.windows, link)
+    {
+        window_destroy(window);
+    }
+
+    if (client.cursor_surface != NULL)
+    {
+        wl_surface_destroy(client.cursor_surface);
+    }
+
+    cursor_cache_release(&client.cursors);
+
+    if (client.cursor_shape_device != NULL)
+    {
+        wp_cursor_shape_device_v1_destroy(client.cursor_shape_device);
+    }
+
+    if (client.pointer != NULL)
+    {
+        wl_pointer_release(client.pointer);
+    }
+
+    if (client.touch != NULL)
+    {
+        wl_touch_release(client.touch);
+    }
+
+    if (client.keyboard != NULL)
+    {
+        wl_keyboard_release(client.keyboard);
+    }
+
+    keyboard_reset_keymap(&client);
+    compose_table_release(&client.compose.table);
+
+    if (client.xkb_context != NULL)
+    {
+        xkb_context_unref(client.xkb_context);
+    }
+
+    if (client.globals_callback != NULL)
     {
+        wl_callback_destroy(client.globals_callback);
+    }
+
+    struct output *output;
+    struct output *tmp_output;
+
+    wl_list_for_each_safe(output, tmp_output, &client.outputs, link)
+    {
+        output_destroy(output);
+    }
+
+    if (client.presentation != NULL)
+    {
+        wp_presentation_destroy(client.presentation);
+    }
+
+    if (client.fractional_scale_manager != NULL)
+    {
+        wp_fractional_scale_manager_v1_destroy(client.fractional_scale_manager);
+    }
+
+    if (client.viewporter != NULL)
+    {
+        wp_viewporter_destroy(client.viewporter);
+    }
+
+    if (client.cursor_shape_manager != NULL)
+    {
+        wp_cursor_shape_manager_v1_destroy(client.cursor_shape_manager);
+    }
+
+    if (client.subcompositor != NULL)
+    {
+        wl_subcompositor_destroy(client.subcompositor);
+    }
+
+    if (client.seat != NULL)
+    {
+        wl_seat_release(client.seat);
+    }
+
+    if (client.xdg_wm_base != NULL)
+    {
+        xdg_wm_base_destroy(client.xdg_wm_base);
+    }
+
+    if (client.compositor != NULL)
+    {
+        wl_compositor_destroy(client.compositor);
+    }
 
+    // The pool's files were created from the shm global.
+    if (client.shm != NULL)
+    {
+        shm_pool_finish(&client.shm_pool);
+        wl_shm_destroy(client.shm);
     }
+
+    wl_registry_destroy(client.registry);
+    event_loop_destroy(client.loop);
+    wl_event_queue_destroy(client.render_queue);
+    wl_event_queue_destroy(client.input_queue);
+    // The destructors above are only requests, they must reach the compositor before the connection closes.
+    wl_display_flush(client.display);
+    wl_display_disconnect(client.display);
+
+    return 0;
 }
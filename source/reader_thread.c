@@ -0,0 +1,174 @@
+#include "reader_thread.h"
+#include "stats.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+
+struct reader_thread
+{
+    pthread_t thread;
+    struct wl_display *display;
+    struct wl_event_queue *queue;
+    struct queue_stats *stats;
+    reader_thread_func_t after_dispatch;
+    void *data;
+    int stop_fd;
+    atomic_bool should_stop;
+};
+
+static void *reader_thread_run(void *data)
+{
+    struct reader_thread *thread = data;
+    struct wl_display *display = thread->display;
+
+    struct pollfd fds[] = {
+        {.fd = wl_display_get_fd(display), .events = POLLIN},
+        {.fd = thread->stop_fd, .events = POLLIN},
+    };
+
+    while (!atomic_load(&thread->should_stop))
+    {
+        while (wl_display_prepare_read_queue(display, thread->queue) != 0)
+        {
+            if (wl_display_dispatch_queue_pending(display, thread->queue) == -1)
+            {
+                return NULL;
+            }
+
+            thread->after_dispatch(thread->data);
+        }
+
+        wl_display_flush(display);
+
+        if (poll(fds, 2, -1) == -1 && errno != EINTR)
+        {
+            wl_display_cancel_read(display);
+            break;
+        }
+
+        uint64_t read_time_ns = get_monotonic_time_ns();
+
+        if (fds[0].revents & POLLIN)
+        {
+            if (wl_display_read_events(display) == -1)
+            {
+                break;
+            }
+
+            read_time_ns = get_monotonic_time_ns();
+        }
+        else
+        {
+            wl_display_cancel_read(display);
+        }
+
+        uint64_t start_time_ns = get_monotonic_time_ns();
+        int count = wl_display_dispatch_queue_pending(display, thread->queue);
+
+        if (count == -1)
+        {
+            break;
+        }
+
+        if (count > 0 && thread->stats != NULL)
+        {
+            queue_stats_add(thread->stats, count, (start_time_ns - read_time_ns) / 1000);
+        }
+
+        thread->after_dispatch(thread->data);
+    }
+
+    return NULL;
+}
+
+struct reader_thread *reader_thread_start(struct wl_display *display, struct wl_event_queue *queue, struct queue_stats *stats, reader_thread_func_t after_dispatch, void *data)
+{
+    struct reader_thread *thread = calloc(1, sizeof(struct reader_thread));
+
+    if (thread == NULL)
+    {
+        return NULL;
+    }
+
+    thread->display = display;
+    thread->queue = queue;
+    thread->stats = stats;
+    thread->after_dispatch = after_dispatch;
+    thread->data = data;
+    atomic_init(&thread->should_stop, false);
+    thread->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (thread->stop_fd == -1)
+    {
+        free(thread);
+        return NULL;
+    }
+
+    // Signals are handled by the event loop of the main thread.
+    sigset_t mask;
+    sigset_t old_mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, &old_mask);
+    int result = pthread_create(&thread->thread, NULL, reader_thread_run, thread);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    if (result != 0)
+    {
+        close(thread->stop_fd);
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+bool reader_thread_stopping(struct reader_thread *thread)
+{
+    return atomic_load(&thread->should_stop);
+}
+
+bool reader_thread_wait(struct reader_thread *thread, int fd)
+{
+    struct pollfd fds[] = {
+        {.fd = fd, .events = POLLIN},
+        {.fd = thread->stop_fd, .events = POLLIN},
+    };
+
+    while (!atomic_load(&thread->should_stop))
+    {
+        if (poll(fds, 2, -1) == -1 && errno != EINTR)
+        {
+            return false;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            uint64_t value;
+            read(fd, &value, sizeof(value));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void reader_thread_stop(struct reader_thread *thread)
+{
+    atomic_store(&thread->should_stop, true);
+    uint64_t value = 1;
+    write(thread->stop_fd, &value, sizeof(value));
+    pthread_join(thread->thread, NULL);
+    close(thread->stop_fd);
+    free(thread);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdbool.h>
+
+struct wl_display;
+struct wl_event_queue;
+struct queue_stats;
+struct reader_thread;
+
+typedef void (*reader_thread_func_t)(void *data);
+
+// Starts a thread that reads the Wayland socket and dispatches `queue`. `after_dispatch` runs on the reader thread
+// after every batch of dispatched events. `stats` may be NULL and must not be read before the thread is stopped.
+struct reader_thread *reader_thread_start(struct wl_display *display, struct wl_event_queue *queue, struct queue_stats *stats, reader_thread_func_t after_dispatch, void *data);
+
+// True once `reader_thread_stop` was called. Callbacks running on the thread check it instead of waiting on a thread
+// that may be joining them.
+bool reader_thread_stopping(struct reader_thread *thread);
+
+// Blocks a callback running on the thread until the eventfd `fd` is signalled, and resets it. Returns false without
+// waiting any longer once `reader_thread_stop` was called.
+bool reader_thread_wait(struct reader_thread *thread, int fd);
+
+// Wakes the thread up, waits for it to exit and frees it.
+void reader_thread_stop(struct reader_thread *thread);
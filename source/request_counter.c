@@ -0,0 +1,63 @@
+#include "request_counter.h"
+
+#include <stdarg.h>
+
+#include <wayland-client-core.h>
+#include <wayland-util.h>
+
+// libwayland can take at most this many arguments per message.
+#define REQUEST_MAX_ARGS 20
+
+atomic_uint_fast64_t request_count;
+
+// libwayland has no hook for outgoing requests, but the request helpers generated for every protocol send through
+// `wl_proxy_marshal_flags`. Defining it here in the executable interposes it for all callers, including modules and
+// libraries like libwayland-cursor, so every request is counted in this one place. The arguments are then passed on to
+// the array variant, which the original only wraps as well.
+struct wl_proxy *wl_proxy_marshal_flags(struct wl_proxy *proxy, uint32_t opcode, const struct wl_interface *interface, uint32_t version,
+                                        uint32_t flags, ...)
+{
+    atomic_fetch_add_explicit(&request_count, 1, memory_order_relaxed);
+
+    const char *signature = wl_proxy_get_interface(proxy)->methods[opcode].signature;
+    union wl_argument args[REQUEST_MAX_ARGS];
+    int count = 0;
+    va_list list;
+    va_start(list, flags);
+
+    // Same as `wl_argument_from_va_list`, which is not exported. Versions and nullability markers take no argument.
+    for (const char *type = signature; *type != '\0' && count < REQUEST_MAX_ARGS; ++type)
+    {
+        switch (*type)
+        {
+        case 'i':
+            args[count++].i = va_arg(list, int32_t);
+            break;
+        case 'u':
+            args[count++].u = va_arg(list, uint32_t);
+            break;
+        case 'f':
+            args[count++].f = va_arg(list, wl_fixed_t);
+            break;
+        case 's':
+            args[count++].s = va_arg(list, const char *);
+            break;
+        case 'o':
+        case 'n':
+            args[count++].o = va_arg(list, struct wl_object *);
+            break;
+        case 'a':
+            args[count++].a = va_arg(list, struct wl_array *);
+            break;
+        case 'h':
+            args[count++].h = va_arg(list, int32_t);
+            break;
+        default:
+            break;
+        }
+    }
+
+    va_end(list);
+
+    return wl_proxy_marshal_array_flags(proxy, opcode, interface, version, flags, args);
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Requests sent by the whole process so far, from any thread and any library, see `request_counter.c`.
+extern atomic_uint_fast64_t request_count;
@@ -0,0 +1,286 @@
+#define _GNU_SOURCE
+#include "shm_pool.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define SHM_POOL_PAGE_SIZE 4096
+// Files start at this size and at least double when they grow, so resizes stay rare.
+#define SHM_POOL_FILE_MIN_SIZE ((size_t) 4 << 20)
+
+static size_t round_to_page(size_t size)
+{
+    return (size + SHM_POOL_PAGE_SIZE - 1) & ~(size_t) (SHM_POOL_PAGE_SIZE - 1);
+}
+
+void shm_pool_init(struct shm_pool *pool, struct wl_shm *shm)
+{
+    memset(pool, 0, sizeof(struct shm_pool));
+    pool->shm = shm;
+    wl_list_init(&pool->files);
+}
+
+// Makes room for one more range, so that releasing a range cannot fail afterwards.
+static bool file_reserve_range(struct shm_file *file)
+{
+    if (file->free_count == file->free_capacity)
+    {
+        size_t capacity = file->free_capacity > 0 ? file->free_capacity * 2 : 16;
+        struct shm_range *ranges = realloc(file->free_ranges, capacity * sizeof(struct shm_range));
+
+        if (ranges == NULL)
+        {
+            return false;
+        }
+
+        file->free_ranges = ranges;
+        file->free_capacity = capacity;
+    }
+
+    return true;
+}
+
+static bool file_insert_range(struct shm_file *file, size_t index, size_t offset, size_t size)
+{
+    if (!file_reserve_range(file))
+    {
+        return false;
+    }
+
+    memmove(&file->free_ranges[index + 1], &file->free_ranges[index], (file->free_count - index) * sizeof(struct shm_range));
+    file->free_ranges[index] = (struct shm_range){offset, size};
+    file->free_count += 1;
+
+    return true;
+}
+
+static void file_remove_range(struct shm_file *file, size_t index)
+{
+    file->free_count -= 1;
+    memmove(&file->free_ranges[index], &file->free_ranges[index + 1], (file->free_count - index) * sizeof(struct shm_range));
+}
+
+// Returns the range back to the file, merged with its neighbours.
+static bool file_release_range(struct shm_file *file, size_t offset, size_t size)
+{
+    size_t index = 0;
+
+    while (index < file->free_count && file->free_ranges[index].offset < offset)
+    {
+        index += 1;
+    }
+
+    bool merge_previous = index > 0 && file->free_ranges[index - 1].offset + file->free_ranges[index - 1].size == offset;
+    bool merge_next = index < file->free_count && offset + size == file->free_ranges[index].offset;
+
+    if (merge_previous && merge_next)
+    {
+        file->free_ranges[index - 1].size += size + file->free_ranges[index].size;
+        file_remove_range(file, index);
+    }
+    else if (merge_previous)
+    {
+        file->free_ranges[index - 1].size += size;
+    }
+    else if (merge_next)
+    {
+        file->free_ranges[index].offset = offset;
+        file->free_ranges[index].size += size;
+    }
+    else
+    {
+        return file_insert_range(file, index, offset, size);
+    }
+
+    return true;
+}
+
+static struct shm_file *file_create(struct shm_pool *pool, size_t size)
+{
+    struct shm_file *file = calloc(1, sizeof(struct shm_file));
+
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    file->fd = allocate_shm_file(size);
+
+    if (file->fd == -1)
+    {
+        free(file);
+        return NULL;
+    }
+
+    // Pages beyond the end of the file are never touched, the reservation only keeps the address range free.
+    file->data = mmap(NULL, SHM_POOL_FILE_CAPACITY, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, file->fd, 0);
+
+    if (file->data == MAP_FAILED)
+    {
+        close(file->fd);
+        free(file);
+        return NULL;
+    }
+
+    if (!file_insert_range(file, 0, 0, size))
+    {
+        munmap(file->data, SHM_POOL_FILE_CAPACITY);
+        close(file->fd);
+        free(file);
+        return NULL;
+    }
+
+    file->size = size;
+    file->wl_shm_pool = wl_shm_create_pool(pool->shm, file->fd, size);
+    wl_list_insert(pool->files.prev, &file->link);
+    pool->file_count += 1;
+    pool->size += size;
+
+    return file;
+}
+
+// Extends the file so that its free tail holds at least `size` bytes.
+static bool file_grow(struct shm_pool *pool, struct shm_file *file, size_t size)
+{
+    struct shm_range *tail = file->free_count > 0 ? &file->free_ranges[file->free_count - 1] : NULL;
+    size_t tail_size = tail != NULL && tail->offset + tail->size == file->size ? tail->size : 0;
+    size_t new_size = file->size + (size - tail_size);
+
+    if (new_size > SHM_POOL_FILE_CAPACITY)
+    {
+        return false;
+    }
+
+    if (new_size < file->size * 2)
+    {
+        new_size = file->size * 2 < SHM_POOL_FILE_CAPACITY ? file->size * 2 : SHM_POOL_FILE_CAPACITY;
+    }
+
+    // Nothing may fail once the file is extended, or its size would no longer match the one recorded.
+    if (!file_reserve_range(file) || ftruncate(file->fd, new_size) == -1)
+    {
+        return false;
+    }
+
+    size_t old_size = file->size;
+    file_release_range(file, old_size, new_size - old_size);
+    wl_shm_pool_resize(file->wl_shm_pool, new_size);
+    file->size = new_size;
+    pool->size += new_size - old_size;
+
+    return true;
+}
+
+// First fit, so buffers of a steady set of windows settle at the start of the file.
+static bool file_alloc(struct shm_file *file, size_t size, struct shm_allocation *allocation)
+{
+    for (size_t i = 0; i < file->free_count; ++i)
+    {
+        struct shm_range *range = &file->free_ranges[i];
+
+        if (range->size < size)
+        {
+            continue;
+        }
+
+        allocation->file = file;
+        allocation->offset = range->offset;
+        allocation->size = size;
+        allocation->data = file->data + range->offset;
+
+        range->offset += size;
+        range->size -= size;
+
+        if (range->size == 0)
+        {
+            file_remove_range(file, i);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool shm_pool_alloc(struct shm_pool *pool, size_t size, struct shm_allocation *allocation)
+{
+    size = round_to_page(size);
+
+    // The pool is only initialized once the `wl_shm` global is bound.
+    if (pool->shm == NULL || size == 0 || size > SHM_POOL_FILE_CAPACITY)
+    {
+        return false;
+    }
+
+    struct shm_file *file;
+
+    wl_list_for_each(file, &pool->files, link)
+    {
+        if (file_alloc(file, size, allocation))
+        {
+            pool->allocated += size;
+            return true;
+        }
+    }
+
+    wl_list_for_each(file, &pool->files, link)
+    {
+        if (file_grow(pool, file, size) && file_alloc(file, size, allocation))
+        {
+            pool->allocated += size;
+            return true;
+        }
+    }
+
+    file = file_create(pool, size > SHM_POOL_FILE_MIN_SIZE ? size : SHM_POOL_FILE_MIN_SIZE);
+
+    if (file == NULL || !file_alloc(file, size, allocation))
+    {
+        return false;
+    }
+
+    pool->allocated += size;
+
+    return true;
+}
+
+struct wl_buffer *shm_pool_create_buffer(const struct shm_allocation *allocation, int32_t width, int32_t height, int32_t stride, uint32_t format)
+{
+    return wl_shm_pool_create_buffer(allocation->file->wl_shm_pool, allocation->offset, width, height, stride, format);
+}
+
+void shm_pool_free(struct shm_pool *pool, const struct shm_allocation *allocation)
+{
+    struct shm_file *file = allocation->file;
+
+    // Keeps the file size, the compositor's mapping of the pool must stay valid.
+    fallocate(file->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, allocation->offset, allocation->size);
+
+    // Without memory for the range it is lost, which only wastes address space.
+    file_release_range(file, allocation->offset, allocation->size);
+    pool->allocated -= allocation->size;
+}
+
+void shm_pool_finish(struct shm_pool *pool)
+{
+    struct shm_file *file;
+    struct shm_file *tmp;
+
+    wl_list_for_each_safe(file, tmp, &pool->files, link)
+    {
+        wl_shm_pool_destroy(file->wl_shm_pool);
+        munmap(file->data, SHM_POOL_FILE_CAPACITY);
+        close(file->fd);
+        free(file->free_ranges);
+        wl_list_remove(&file->link);
+        free(file);
+    }
+
+    pool->file_count = 0;
+    pool->size = 0;
+    pool->allocated = 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <wayland-client.h>
+
+// Largest size of a single shm file. Files are mapped at this size up front, so growing them never moves existing
+// buffers. `wl_shm_pool` sizes are 32-bit, so it must stay below 2 GiB.
+#define SHM_POOL_FILE_CAPACITY ((size_t) 1 << 30)
+
+struct shm_range
+{
+    size_t offset;
+    size_t size;
+};
+
+struct shm_file
+{
+    struct wl_shm_pool *wl_shm_pool;
+    int fd;
+    uint8_t *data;
+    size_t size;
+    // Unused ranges below `size`, sorted by offset. Adjacent ranges are always merged.
+    struct shm_range *free_ranges;
+    size_t free_count;
+    size_t free_capacity;
+    struct wl_list link;
+};
+
+// Buffers of all windows are carved out of a few shared shm files, so a window costs no file, mapping or fd of its own
+// and drawing a frame transfers no fd. Freed ranges are punched out of the file, so they cost no memory until reused.
+struct shm_pool
+{
+    struct wl_shm *shm;
+    struct wl_list files;
+    size_t file_count;
+    // Bytes of all files and of the live allocations.
+    size_t size;
+    size_t allocated;
+};
+
+struct shm_allocation
+{
+    struct shm_file *file;
+    size_t offset;
+    size_t size;
+    void *data;
+};
+
+void shm_pool_init(struct shm_pool *pool, struct wl_shm *shm);
+
+// Allocates page aligned memory, growing a file or adding one if needed. Returns false on failure.
+bool shm_pool_alloc(struct shm_pool *pool, size_t size, struct shm_allocation *allocation);
+
+// Creates a buffer at the start of the allocation.
+struct wl_buffer *shm_pool_create_buffer(const struct shm_allocation *allocation, int32_t width, int32_t height, int32_t stride, uint32_t format);
+
+// The buffers created in the allocation must be destroyed, and released by the compositor, before it is freed.
+void shm_pool_free(struct shm_pool *pool, const struct shm_allocation *allocation);
+
+void shm_pool_finish(struct shm_pool *pool);
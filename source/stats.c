@@ -0,0 +1,206 @@
+#include "stats.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+static uint32_t bucket_index(uint64_t value)
+{
+    if (value < 8)
+    {
+        return value;
+    }
+
+    if (value >= UINT64_C(1) << 32)
+    {
+        return LATENCY_HISTOGRAM_BUCKETS - 1;
+    }
+
+    uint32_t exponent = 63 - __builtin_clzll(value);
+    uint32_t mantissa = (value >> (exponent - 3)) & 7;
+
+    return (exponent - 2) * 8 + mantissa;
+}
+
+static uint64_t bucket_lower_bound(uint32_t index)
+{
+    if (index < 8)
+    {
+        return index;
+    }
+
+    uint32_t exponent = index / 8 + 2;
+    uint32_t mantissa = index % 8;
+
+    return (UINT64_C(8) + mantissa) << (exponent - 3);
+}
+
+void latency_histogram_add(struct latency_histogram *histogram, uint64_t value_us)
+{
+    histogram->count += 1;
+    histogram->sum_us += value_us;
+
+    if (value_us > histogram->max_us)
+    {
+        histogram->max_us = value_us;
+    }
+
+    histogram->buckets[bucket_index(value_us)] += 1;
+}
+
+uint64_t latency_histogram_percentile(const struct latency_histogram *histogram, double percentile)
+{
+    uint64_t target = (uint64_t) (histogram->count * percentile / 100.0);
+    uint64_t seen = 0;
+
+    for (uint32_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i)
+    {
+        seen += histogram->buckets[i];
+
+        if (seen > target)
+        {
+            return bucket_lower_bound(i);
+        }
+    }
+
+    return histogram->max_us;
+}
+
+void latency_histogram_print(const struct latency_histogram *histogram, const char *name)
+{
+    if (histogram->count == 0)
+    {
+        printf("info (stats): %s: no samples.\n", name);
+        return;
+    }
+
+    printf("info (stats): %s: n=%" PRIu64 " mean=%" PRIu64 "us p50=%" PRIu64 "us p90=%" PRIu64 "us p99=%" PRIu64 "us max=%" PRIu64 "us.\n",
+           name, histogram->count, histogram->sum_us / histogram->count, latency_histogram_percentile(histogram, 50),
+           latency_histogram_percentile(histogram, 90), latency_histogram_percentile(histogram, 99), histogram->max_us);
+}
+
+void queue_stats_add(struct queue_stats *stats, uint64_t depth, uint64_t wait_us)
+{
+    stats->dispatches += 1;
+    stats->events += depth;
+
+    if (depth > stats->max_depth)
+    {
+        stats->max_depth = depth;
+    }
+
+    latency_histogram_add(&stats->wait_latency, wait_us);
+}
+
+void queue_stats_print(const struct queue_stats *stats)
+{
+    if (stats->dispatches == 0)
+    {
+        printf("info (stats): queue `%s`: no events.\n", stats->name);
+        return;
+    }
+
+    printf("info (stats): queue `%s`: dispatches=%" PRIu64 " events=%" PRIu64 " mean depth=%.2f max depth=%" PRIu64 ".\n", stats->name,
+           stats->dispatches, stats->events, (double) stats->events / stats->dispatches, stats->max_depth);
+
+    char name[64];
+    snprintf(name, sizeof(name), "queue `%s` wait", stats->name);
+    latency_histogram_print(&stats->wait_latency, name);
+}
+
+void input_ring_stats_print(const struct input_ring_stats *stats)
+{
+    printf("info (stats): input ring merged frames=%" PRIu64 " waits=%" PRIu64 ".\n", stats->merged_frames, stats->waits);
+}
+
+void pointer_stats_print(const struct pointer_stats *stats)
+{
+    printf("info (stats): pointer events=%" PRIu64 " frames=%" PRIu64 " deliveries=%" PRIu64 ".\n", stats->events, stats->frames,
+           stats->deliveries);
+}
+
+void content_stats_add(struct content_stats *stats, uint64_t pixels, uint64_t painted_pixels)
+{
+    stats->frames += 1;
+    stats->pixels += pixels;
+    stats->painted_pixels += painted_pixels;
+}
+
+void content_stats_print(const struct content_stats *stats)
+{
+    if (stats->pixels == 0)
+    {
+        return;
+    }
+
+    printf("info (stats): content frames=%" PRIu64 " painted=%.1f%% of pixels.\n", stats->frames,
+           100.0 * stats->painted_pixels / stats->pixels);
+}
+
+void keymap_stats_print(const struct keymap_stats *stats)
+{
+    uint64_t total = stats->cache_hits + stats->cache_misses;
+
+    if (total == 0)
+    {
+        return;
+    }
+
+    printf("info (stats): keymap cache hits=%" PRIu64 " misses=%" PRIu64 " hit rate=%.0f%% load=%.2fms compile=%.2fms.\n", stats->cache_hits,
+           stats->cache_misses, 100.0 * stats->cache_hits / total, stats->load_ns / 1e6, stats->compile_ns / 1e6);
+}
+
+void input_latency_stats_print(const struct input_latency_stats *stats)
+{
+    if (stats->arrival_to_commit.count == 0)
+    {
+        return;
+    }
+
+    latency_histogram_print(&stats->arrival_to_commit, "input arrival to commit");
+    latency_histogram_print(&stats->handled_to_commit, "input handled to commit");
+    latency_histogram_print(&stats->commit_to_present, "input commit to present");
+    latency_histogram_print(&stats->arrival_to_present, "input arrival to present");
+    latency_histogram_print(&stats->timestamp_to_present, "input compositor timestamp to present");
+    printf("info (stats): input frames discarded=%" PRIu64 ".\n", stats->discarded);
+}
+
+void request_stats_add_frame(struct request_stats *stats, uint64_t request_count)
+{
+    stats->frames += 1;
+    latency_histogram_add(&stats->requests_per_frame, request_count - stats->frame_request_count);
+    stats->frame_request_count = request_count;
+}
+
+void request_stats_print(const struct request_stats *stats)
+{
+    printf("info (stats): requests=%" PRIu64 " bytes=%" PRIu64 " flushes=%" PRIu64 " blocked flushes=%" PRIu64 " frames=%" PRIu64 ".\n",
+           stats->requests, stats->bytes, stats->flushes, stats->blocked_flushes, stats->frames);
+
+    if (stats->frames > 0)
+    {
+        printf("info (stats): per frame: requests=%.1f bytes=%.1f flushes=%.2f.\n", (double) stats->requests / stats->frames,
+               (double) stats->bytes / stats->frames, (double) stats->flushes / stats->frames);
+
+        const struct latency_histogram *histogram = &stats->requests_per_frame;
+        printf("info (stats): requests per frame: p50=%" PRIu64 " p90=%" PRIu64 " p99=%" PRIu64 " max=%" PRIu64 ".\n",
+               latency_histogram_percentile(histogram, 50), latency_histogram_percentile(histogram, 90), latency_histogram_percentile(histogram, 99),
+               histogram->max_us);
+    }
+}
+
+static uint64_t since_start_us(const struct startup_stats *stats, uint64_t time_ns)
+{
+    return time_ns == 0 ? 0 : (time_ns - stats->start_ns) / 1000;
+}
+
+void startup_stats_print(const struct startup_stats *stats)
+{
+    printf("info (startup): connect=%" PRIu64 "us globals ready=%" PRIu64 "us first configure=%" PRIu64 "us first commit=%" PRIu64 "us.\n",
+           since_start_us(stats, stats->connect_ns), since_start_us(stats, stats->globals_ready_ns), since_start_us(stats, stats->first_configure_ns),
+           since_start_us(stats, stats->first_commit_ns));
+}
+
+void startup_stats_print_cursors(const struct startup_stats *stats)
+{
+    printf("info (startup): cursors loaded in %" PRIu64 "us, ready=%" PRIu64 "us.\n", stats->cursors_ns / 1000, since_start_us(stats, stats->cursors_ready_ns));
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <stdint.h>
+
+// Log-linear buckets: eight per power of two, covering up to 2^32 microseconds.
+#define LATENCY_HISTOGRAM_BUCKETS (33 * 8)
+
+struct latency_histogram
+{
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+    uint64_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+};
+
+void latency_histogram_add(struct latency_histogram *histogram, uint64_t value_us);
+
+// Returns the lower bound of the bucket containing the given percentile (0 to 100).
+uint64_t latency_histogram_percentile(const struct latency_histogram *histogram, double percentile);
+
+void latency_histogram_print(const struct latency_histogram *histogram, const char *name);
+
+struct queue_stats
+{
+    const char *name;
+    uint64_t dispatches;
+    uint64_t events;
+    uint64_t max_depth;
+    // Time events spent in the queue between being read from the socket and being dispatched.
+    struct latency_histogram wait_latency;
+};
+
+void queue_stats_add(struct queue_stats *stats, uint64_t depth, uint64_t wait_us);
+
+void queue_stats_print(const struct queue_stats *stats);
+
+struct request_stats
+{
+    uint64_t frames;
+    // Taken from `request_count` before printing.
+    uint64_t requests;
+    uint64_t bytes;
+    // Flushes that actually wrote to the socket.
+    uint64_t flushes;
+    // Flushes that hit `EAGAIN` and had to wait for the socket to become writable.
+    uint64_t blocked_flushes;
+    // Requests sent since the previous committed frame, counted for each frame. Uses the buckets of latencies.
+    struct latency_histogram requests_per_frame;
+    // Value of `request_count` at the previous committed frame.
+    uint64_t frame_request_count;
+};
+
+// Counts a committed frame, given the current `request_count`.
+void request_stats_add_frame(struct request_stats *stats, uint64_t request_count);
+
+void request_stats_print(const struct request_stats *stats);
+
+struct pointer_stats
+{
+    // Individual `wl_pointer` events, counted on the decoding thread.
+    uint64_t events;
+    // Aggregated frames handed to the application side.
+    uint64_t frames;
+    // Times the application actually handled pointer input.
+    uint64_t deliveries;
+};
+
+void pointer_stats_print(const struct pointer_stats *stats);
+
+// Threaded mode only, counted on the reader thread.
+struct input_ring_stats
+{
+    // Pointer frames folded into a held back one because the ring was full.
+    uint64_t merged_frames;
+    // Times the reader thread had to wait for the render thread to make room.
+    uint64_t waits;
+};
+
+void input_ring_stats_print(const struct input_ring_stats *stats);
+
+struct content_stats
+{
+    uint64_t frames;
+    uint64_t pixels;
+    // Pixels that were drawn rather than reused from the previous frame.
+    uint64_t painted_pixels;
+};
+
+void content_stats_add(struct content_stats *stats, uint64_t pixels, uint64_t painted_pixels);
+
+void content_stats_print(const struct content_stats *stats);
+
+struct keymap_stats
+{
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    // Total time spent loading cached tables and compiling keymaps.
+    uint64_t load_ns;
+    uint64_t compile_ns;
+};
+
+void keymap_stats_print(const struct keymap_stats *stats);
+
+// Follows input that led to a content frame. Arrival is when the event was decoded, handled when the application
+// acted on it. Each frame is measured once, from the oldest input it contains.
+struct input_latency_stats
+{
+    struct latency_histogram arrival_to_commit;
+    struct latency_histogram handled_to_commit;
+    struct latency_histogram commit_to_present;
+    struct latency_histogram arrival_to_present;
+    // From the compositor's event timestamp, so it includes the time before the event was sent.
+    struct latency_histogram timestamp_to_present;
+    // Frames the compositor replaced before they were shown.
+    uint64_t discarded;
+};
+
+void input_latency_stats_print(const struct input_latency_stats *stats);
+
+// Absolute monotonic timestamps, zero until reached.
+struct startup_stats
+{
+    uint64_t start_ns;
+    uint64_t connect_ns;
+    uint64_t globals_ready_ns;
+    uint64_t first_configure_ns;
+    uint64_t first_commit_ns;
+    uint64_t cursors_ready_ns;
+    // Time spent loading cursors on the worker thread.
+    uint64_t cursors_ns;
+};
+
+void startup_stats_print(const struct startup_stats *stats);
+
+void startup_stats_print_cursors(const struct startup_stats *stats);
@@ -0,0 +1,126 @@
+#include "swapchain.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void swapchain_buffer_free(struct swapchain_buffer *buffer)
+{
+    wl_buffer_destroy(buffer->buffer);
+    shm_pool_free(buffer->pool, &buffer->allocation);
+    free(buffer);
+}
+
+static void swapchain_buffer_release(void *data, struct wl_buffer *buffer)
+{
+    struct swapchain_buffer *swapchain_buffer = data;
+    swapchain_buffer->busy = false;
+
+    if (swapchain_buffer->retired)
+    {
+        swapchain_buffer_free(swapchain_buffer);
+    }
+    else if (swapchain_buffer->swapchain->release != NULL)
+    {
+        swapchain_buffer->swapchain->release(swapchain_buffer->swapchain->release_data);
+    }
+}
+
+static const struct wl_buffer_listener swapchain_buffer_listener = {
+    .release = swapchain_buffer_release,
+};
+
+void swapchain_destroy(struct swapchain *swapchain)
+{
+    // The memory of a busy buffer may still be read, so it cannot be handed to another buffer yet.
+    for (int i = 0; i < SWAPCHAIN_LENGTH; ++i)
+    {
+        struct swapchain_buffer *buffer = swapchain->buffers[i];
+
+        if (buffer == NULL)
+        {
+            continue;
+        }
+
+        if (buffer->busy)
+        {
+            buffer->retired = true;
+        }
+        else
+        {
+            swapchain_buffer_free(buffer);
+        }
+    }
+
+    memset(swapchain->buffers, 0, sizeof(swapchain->buffers));
+    swapchain->front = NULL;
+    swapchain->width = 0;
+    swapchain->height = 0;
+}
+
+bool swapchain_resize(struct swapchain *swapchain, struct shm_pool *pool, int32_t width, int32_t height)
+{
+    if (swapchain->buffers[0] != NULL && swapchain->width == width && swapchain->height == height)
+    {
+        return true;
+    }
+
+    swapchain_destroy(swapchain);
+
+    int32_t stride = width * 4;
+    size_t buffer_size = (size_t) stride * height;
+
+    for (int i = 0; i < SWAPCHAIN_LENGTH; ++i)
+    {
+        struct swapchain_buffer *buffer = calloc(1, sizeof(struct swapchain_buffer));
+
+        if (buffer == NULL || !shm_pool_alloc(pool, buffer_size, &buffer->allocation))
+        {
+            free(buffer);
+            swapchain_destroy(swapchain);
+            return false;
+        }
+
+        buffer->swapchain = swapchain;
+        buffer->pool = pool;
+        buffer->pixels = buffer->allocation.data;
+        buffer->buffer = shm_pool_create_buffer(&buffer->allocation, width, height, stride, WL_SHM_FORMAT_ARGB8888);
+        wl_buffer_add_listener(buffer->buffer, &swapchain_buffer_listener, buffer);
+        swapchain->buffers[i] = buffer;
+    }
+
+    swapchain->width = width;
+    swapchain->height = height;
+
+    return true;
+}
+
+struct swapchain_buffer *swapchain_acquire(struct swapchain *swapchain)
+{
+    if (swapchain->buffers[0] == NULL)
+    {
+        return NULL;
+    }
+
+    // Reusing the front buffer allows shifting its content in place.
+    if (swapchain->front != NULL && !swapchain->front->busy)
+    {
+        return swapchain->front;
+    }
+
+    for (int i = 0; i < SWAPCHAIN_LENGTH; ++i)
+    {
+        if (!swapchain->buffers[i]->busy)
+        {
+            return swapchain->buffers[i];
+        }
+    }
+
+    return NULL;
+}
+
+void swapchain_present(struct swapchain *swapchain, struct swapchain_buffer *buffer)
+{
+    buffer->busy = true;
+    buffer->valid = true;
+    swapchain->front = buffer;
+}
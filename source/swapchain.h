@@ -0,0 +1,56 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <wayland-client.h>
+
+#include "shm_pool.h"
+
+#define SWAPCHAIN_LENGTH 2
+
+struct swapchain_buffer
+{
+    struct swapchain *swapchain;
+    struct wl_buffer *buffer;
+    uint32_t *pixels;
+    struct shm_pool *pool;
+    struct shm_allocation allocation;
+    // Attached and not yet released by the compositor.
+    bool busy;
+    // No longer part of a swapchain. Freed as soon as the compositor releases it.
+    bool retired;
+    // Holds a complete frame, so later frames can be derived from it.
+    bool valid;
+    // Canvas position of the top left pixel of that frame.
+    int64_t x_position;
+    int64_t y_position;
+};
+
+// Fixed set of ARGB8888 buffers, reused across frames instead of being allocated per frame. The memory comes from a
+// pool shared with other swapchains.
+struct swapchain
+{
+    int32_t width;
+    int32_t height;
+    struct swapchain_buffer *buffers[SWAPCHAIN_LENGTH];
+    // Most recently attached buffer.
+    struct swapchain_buffer *front;
+    // Called when the compositor releases a buffer, so that a frame that found all buffers busy can be drawn then.
+    // Survives resizes and `swapchain_destroy`.
+    void (*release)(void *data);
+    void *release_data;
+};
+
+// Reallocates the buffers if the size changed. Returns false on failure, leaving the swapchain empty.
+bool swapchain_resize(struct swapchain *swapchain, struct shm_pool *pool, int32_t width, int32_t height);
+
+// Returns a buffer the compositor is not reading from, preferring the front buffer. NULL if all are busy, the release
+// callback tells when to try again.
+struct swapchain_buffer *swapchain_acquire(struct swapchain *swapchain);
+
+// Marks the buffer as busy and front. The caller attaches it.
+void swapchain_present(struct swapchain *swapchain, struct swapchain_buffer *buffer);
+
+// Buffers the compositor still reads from are kept until it releases them.
+void swapchain_destroy(struct swapchain *swapchain);
@@ -3,7 +3,12 @@
 #define _POSIX_C_SOURCE 200112L
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -63,3 +68,76 @@ int allocate_shm_file(size_t size)
 
     return fd;
 }
+
+uint64_t get_monotonic_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int32_t scale_length(int32_t value, int32_t scale)
+{
+    return ((int64_t) value * scale + SCALE_DENOMINATOR / 2) / SCALE_DENOMINATOR;
+}
+
+uint64_t hash_fnv1a(const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+
+static int make_directory(const char *path)
+{
+    return mkdir(path, 0700) == 0 || errno == EEXIST ? 0 : -1;
+}
+
+int get_cache_path(char *buffer, size_t size, const char *name)
+{
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char directory[PATH_MAX];
+    int length;
+
+    if (cache_home != NULL && cache_home[0] == '/')
+    {
+        length = snprintf(directory, sizeof(directory), "%s", cache_home);
+    }
+    else if (home != NULL)
+    {
+        length = snprintf(directory, sizeof(directory), "%s/.cache", home);
+    }
+    else
+    {
+        return -1;
+    }
+
+    if (length < 0 || (size_t) length >= sizeof(directory) || make_directory(directory) == -1)
+    {
+        return -1;
+    }
+
+    if (strlen(directory) + sizeof("/wayland-window") > sizeof(directory))
+    {
+        return -1;
+    }
+
+    strcat(directory, "/wayland-window");
+
+    if (make_directory(directory) == -1)
+    {
+        return -1;
+    }
+
+    length = snprintf(buffer, size, "%s/%s", directory, name);
+
+    return length >= 0 && (size_t) length < size ? 0 : -1;
+}
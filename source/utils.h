@@ -1,8 +1,26 @@
 #pragma once
 #include <aio.h>
+#include <stddef.h>
+#include <stdint.h>
 
 void randname(char *buffer);
 
 int create_shm_file();
 
 int allocate_shm_file(size_t size);
+
+uint64_t get_monotonic_time_ns();
+
+// Scales are fixed point with this denominator, like in `wp_fractional_scale_v1`.
+#define SCALE_DENOMINATOR 120
+
+// Converts a non-negative logical length or position to buffer pixels, rounding half up. Rounding positions rather than
+// sizes keeps adjacent areas adjacent.
+int32_t scale_length(int32_t value, int32_t scale);
+
+// 64-bit FNV-1a. Not cryptographic, only used to key caches.
+uint64_t hash_fnv1a(const void *data, size_t size);
+
+// Writes the path of `name` inside `$XDG_CACHE_HOME/wayland-window` (or `~/.cache/wayland-window`) to `buffer` and
+// creates the directory if needed. Returns -1 if there is no usable cache directory.
+int get_cache_path(char *buffer, size_t size, const char *name);